@@ -28,6 +28,11 @@ void *hw_memory_end = NULL;
 
 static int8_t boot_state = HW_BOOT_STATE_PRODUCT;
 
+#define SYSTICK_RELOAD          (72000000 / SYSTEM_TICKS_PRE_SEC)
+#define SYSTICK_IDLE_MAX        (0xFFFFFF / SYSTICK_RELOAD)
+
+static volatile uint32_t systick_idle = 0; // ticks of the stretched systick period
+
 static void hw_setup_memory(void)
 {
     hw_memory_bgn = CUPKEE_ADDR_ALIGN(&end, 16);
@@ -42,13 +47,66 @@ static void hw_setup_systick(void)
     systick_counter_enable();
 }
 
+static inline void systick_period_set(uint32_t reload)
+{
+    systick_counter_disable();
+    systick_set_reload(reload);
+    STK_CVR = 0;
+    systick_counter_enable();
+}
+
 /* systick interrupt handle routing  */
 void sys_tick_handler(void)
 {
-    _cupkee_systicks++;
+    if (systick_idle) {
+        // Stretched period elapsed, restore the normal one
+        _cupkee_systicks += systick_idle;
+        systick_idle = 0;
+        systick_period_set(SYSTICK_RELOAD - 1);
+    } else {
+        _cupkee_systicks++;
+    }
     cupkee_event_post_systick();
 }
 
+void hw_idle(uint32_t ticks)
+{
+    uint32_t reload = 0;
+    uint32_t rest = 0;
+
+    if (ticks > SYSTICK_IDLE_MAX) {
+        ticks = SYSTICK_IDLE_MAX;
+    }
+
+    // Stretch systick period, if systick is not pending
+    if (ticks > 1 && !(SCB_ICSR & SCB_ICSR_PENDSTSET)) {
+        rest = systick_get_value();
+        reload = rest + (ticks - 1) * SYSTICK_RELOAD;
+        systick_period_set(reload);
+        systick_idle = ticks;
+    }
+
+    hw_idle_usb_enter();
+    __asm__ volatile ("wfi");
+    hw_idle_usb_leave();
+
+    if (reload && !(SCB_ICSR & SCB_ICSR_PENDSTSET)) {
+        // Wake up by other interrupt, correct systicks
+        // Count from the last tick boundary, part of tick spent before sleep included
+        uint32_t total = (SYSTICK_RELOAD - rest) + (reload - systick_get_value());
+        uint32_t n = total / SYSTICK_RELOAD;
+
+        // The rest of current tick will be counted in systick handler
+        systick_period_set(SYSTICK_RELOAD - total % SYSTICK_RELOAD);
+        systick_idle = 1;
+
+        if (n) {
+            _cupkee_systicks += n;
+            cupkee_event_post_systick();
+        }
+    }
+}
+
 size_t hw_memory_size(void)
 {
     return hw_memory_end - hw_memory_bgn;
@@ -177,6 +177,9 @@ static int device_setup(int inst, void *entry)
     adc_calibrate(ADC1);
 
     device->entry = entry;
+
+    // Sample conversion step by systick, instead of every loop
+    cupkee_device_poll_set(entry, 1);
     return 0;
 }
 
@@ -174,6 +174,7 @@ static int device_query(int inst, int want)
     spi->rxcnt = 0;
 
     spi->flags |= HW_FL_BUSY;
+    cupkee_device_poll_set(spi->entry, CUPKEE_DEVICE_POLL_ALWAYS);
 
     while (SPI_SR(reg_base[inst]) & SPI_SR_BSY) {
         ;
@@ -209,6 +210,7 @@ static int device_poll(int inst)
         if (spi->done && !(SPI_SR(reg_base[inst]) & SPI_SR_BSY)) {
             spi->flags &= ~HW_FL_BUSY;
             spi->done = 0;
+            cupkee_device_poll_set(spi->entry, CUPKEE_DEVICE_POLL_NONE);
 
             cupkee_device_response_end(spi->entry);
         }
@@ -262,6 +264,9 @@ static int device_setup(int inst, void *entry)
     SPI_CR2(reg_base[inst]) = 0;
     SPI_CR1(reg_base[inst]) |= SPI_CR1_SPE;
 
+    // Only transfer in progress need poll
+    cupkee_device_poll_set(entry, CUPKEE_DEVICE_POLL_NONE);
+
     return 0;
 }
 
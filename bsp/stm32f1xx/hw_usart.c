@@ -36,6 +36,9 @@ static const uint32_t reg_base[] = {
 static const uint32_t rcc_base[] = {
     RCC_USART1, RCC_USART2, RCC_USART3, RCC_UART4, RCC_UART5
 };
+static const uint8_t irq_base[] = {
+    NVIC_USART1_IRQ, NVIC_USART2_IRQ, NVIC_USART3_IRQ, NVIC_UART4_IRQ, NVIC_UART5_IRQ
+};
 
 static int uart_gpio_setup(int inst)
 {
@@ -117,7 +120,10 @@ static int uart_reset(int inst)
     hw_uart_t *uart = uart_block(inst);
 
     if (uart) {
+        nvic_disable_irq(irq_base[inst]);
+        usart_disable_rx_interrupt(reg_base[inst]);
         usart_disable(reg_base[inst]);
+        uart->flags &= ~(HW_FL_RXE | HW_FL_TXE);
         uart->entry = NULL;
 
         return 0;
@@ -179,6 +185,10 @@ static int uart_setup(int inst, void *entry)
 
     uart->entry = entry;
 
+    // Polled only when woken by rx interrupt or tx in progress
+    cupkee_device_poll_set(entry, CUPKEE_DEVICE_POLL_NONE);
+    nvic_enable_irq(irq_base[inst]);
+
     return 0;
 }
 
@@ -212,27 +222,42 @@ static int uart_poll(int inst)
     hw_uart_t *uart = uart_block(inst);
 
     if (uart) {
-        uint8_t data;
+        uint8_t *ptr;
+        int i, n;
 
         if (uart->flags & HW_FL_RXE) {
             while (uart_has_data(inst)) {
-                data = uart_data_get(inst);
-                if (1 != cupkee_device_push(uart->entry, 1, &data)) {
+                if (0 >= (n = cupkee_device_push_reserve(uart->entry, (void **)&ptr))) {
                     uart->flags &= ~HW_FL_RXE;
                     break;
                 }
+                for (i = 0; i < n && uart_has_data(inst); i++) {
+                    ptr[i] = uart_data_get(inst);
+                }
+                cupkee_device_push_commit(uart->entry, i);
             }
         }
 
         if (uart->flags & HW_FL_TXE) {
             while (uart_not_busy(inst)) {
-                if(1 != cupkee_device_pull(uart->entry, 1, &data)) {
+                if (0 >= (n = cupkee_device_pull_reserve(uart->entry, (void **)&ptr))) {
                     uart->flags &= ~HW_FL_TXE;
                     break;
                 }
-                uart_data_put(inst, data);
+                for (i = 0; i < n && uart_not_busy(inst); i++) {
+                    uart_data_put(inst, ptr[i]);
+                }
+                cupkee_device_pull_commit(uart->entry, i);
             }
         }
+
+        if (!(uart->flags & HW_FL_TXE)) {
+            cupkee_device_poll_set(uart->entry, CUPKEE_DEVICE_POLL_NONE);
+        }
+        if (uart->flags & HW_FL_RXE) {
+            // Rx interrupt raise immediately, if data come after drained
+            usart_enable_rx_interrupt(reg_base[inst]);
+        }
         return 0;
     } else {
         return -CUPKEE_EINVAL;
@@ -255,6 +280,7 @@ static int uart_write(int inst, size_t n, const void *data)
         return i;
     } else {
         uart->flags |= HW_FL_TXE;
+        cupkee_device_poll_set(uart->entry, CUPKEE_DEVICE_POLL_ALWAYS);
         return 0;
     }
 }
@@ -280,10 +306,47 @@ static int uart_read(int inst, size_t n, void *data)
         return i;
     } else {
         uart->flags |= HW_FL_RXE;
+        usart_enable_rx_interrupt(reg_base[inst]);
         return 0;
     }
 }
 
+static inline void uart_isr(int inst)
+{
+    hw_uart_t *uart = &uarts[inst];
+
+    if (USART_SR(reg_base[inst]) & USART_SR_RXNE) {
+        // Data register is read in poll, mask rx interrupt until then
+        usart_disable_rx_interrupt(reg_base[inst]);
+        cupkee_device_ready(uart->entry);
+    }
+}
+
+void usart1_isr(void)
+{
+    uart_isr(0);
+}
+
+void usart2_isr(void)
+{
+    uart_isr(1);
+}
+
+void usart3_isr(void)
+{
+    uart_isr(2);
+}
+
+void uart4_isr(void)
+{
+    uart_isr(3);
+}
+
+void uart5_isr(void)
+{
+    uart_isr(4);
+}
+
 static const char *parity_options[] = {
     "none", "odd", "even"
 };
@@ -19,7 +19,10 @@
 
 #include "hardware.h"
 
+#define CDC_PACKET_SIZE     64
+
 static void   *cdc_entry = NULL;
+static void   *cdc_tx_buf = NULL;
 static uint8_t cdc_flags = 0;
 
 #ifndef USB_CLASS_MISCELLANEOUS
@@ -232,19 +235,57 @@ static inline int cdc_recv_byte(uint8_t *c)
     return usbd_ep_read_packet(usb_hnd, 0x01, c, 1);
 }
 
+static void cdc_tx_next(void)
+{
+    uint8_t packet[CDC_PACKET_SIZE];
+    int n;
+
+    if (!cdc_tx_buf && !(cdc_tx_buf = cupkee_device_pull_buf(cdc_entry))) {
+        return;
+    }
+
+    n = cupkee_buffer_take(cdc_tx_buf, CDC_PACKET_SIZE, packet);
+    if (n != usbd_ep_write_packet(usb_hnd, 0x82, packet, n)) {
+        // Endpoint busy, put the packet back
+        while (n) {
+            cupkee_buffer_unshift(cdc_tx_buf, packet[--n]);
+        }
+        return;
+    }
+
+    if (cupkee_buffer_is_empty(cdc_tx_buf)) {
+        cupkee_buffer_release(cdc_tx_buf);
+        cdc_tx_buf = NULL;
+    }
+}
+
 static void cdcacm_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 {
     (void)usbd_dev;
 	(void)ep;
 
     if (cdc_flags & HW_FL_RXE) {
-        uint8_t data;
+        void *buf = cupkee_buffer_alloc(CDC_PACKET_SIZE);
+        int n;
+
+        if (!buf) {
+            cdc_flags &= ~HW_FL_RXE;
+            return;
+        }
 
-        while (1 == cdc_recv_byte(&data)) {
-            if (1 != cupkee_device_push(cdc_entry, 1, &data)) {
+        n = usbd_ep_read_packet(usb_hnd, 0x01, cupkee_buffer_ptr(buf), CDC_PACKET_SIZE);
+        if (n <= 0) {
+            cupkee_buffer_release(buf);
+            return;
+        }
+        cupkee_buffer_extend(buf, n);
+
+        // Packet is merged into the rx cache, which is no smaller than a packet
+        if (0 > cupkee_device_push_buf(cdc_entry, buf)) {
+            if (n != cupkee_device_push(cdc_entry, n, cupkee_buffer_ptr(buf))) {
                 cdc_flags &= ~HW_FL_RXE;
-                break;
             }
+            cupkee_buffer_release(buf);
         }
     }
 }
@@ -255,15 +296,7 @@ static void cdcacm_data_tx_cb(usbd_device *usbd_dev, uint8_t ep)
 	(void)ep;
 
     if (cdc_flags & HW_FL_TXE) {
-        uint8_t data;
-
-        while (1 == cupkee_device_pull(cdc_entry, 1, &data)) {
-            if (1 != cdc_send_byte(data)) {
-                cupkee_unshift(cdc_entry, data);
-                cdc_flags &= ~HW_FL_TXE;
-                break;
-            }
-        }
+        cdc_tx_next();
     }
 }
 
@@ -310,6 +343,10 @@ static int cdc_request(int instance)
 static int cdc_release(int instance)
 {
     if (instance == 0) {
+        if (cdc_tx_buf) {
+            cupkee_buffer_release(cdc_tx_buf);
+            cdc_tx_buf = NULL;
+        }
         cdc_flags = 0;
         return 0;
     } else {
@@ -332,6 +369,7 @@ static int cdc_write(int instance, size_t n, const void *data)
         return i;
     }
     cdc_flags |= HW_FL_TXE;
+    cdc_tx_next();
 
     return 0;
 }
@@ -395,3 +433,16 @@ void hw_poll_usb(void)
     usbd_poll(usb_hnd);
 }
 
+/* USB is served by polling, its irq is only used to wake up the core from idle,
+ * and must be disabled before the interrupts unmasked. */
+void hw_idle_usb_enter(void)
+{
+    nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+}
+
+void hw_idle_usb_leave(void)
+{
+    nvic_disable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+    nvic_clear_pending_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+}
+
@@ -24,5 +24,8 @@
 void hw_setup_usb(void);
 void hw_poll_usb(void);
 
+void hw_idle_usb_enter(void);
+void hw_idle_usb_leave(void);
+
 #endif /* __HW_USB_INC__ */
 
@@ -39,6 +39,7 @@ static const native_t native_entries[] = {
     {"systicks",        native_systicks},
     {"require",         native_require},
     {"report",          native_report},
+    {"reports",         native_report_batch},
     {"interface",       native_interface},
 
     {"print",           native_print},
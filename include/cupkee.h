@@ -25,20 +25,68 @@
 /* Todo: cupkee_config.h ? */
 // Device config
 #define CUPKEE_DEVICE_TYPE_MAX          16
+#define CUPKEE_DEVICE_QUERY_MAX         8
+#ifndef CUPKEE_DEVICE_CACHE_RESERVE
+#define CUPKEE_DEVICE_CACHE_RESERVE     (0)     // device objects kept in slab cache, 0: no cache
+#endif
+
+// Timer config
+#ifndef CUPKEE_TIMER_CACHE_RESERVE
+#define CUPKEE_TIMER_CACHE_RESERVE      (0)     // timer objects kept in slab cache, 0: no cache
+#endif
+
+// Object config: object id = generation(15 - bits) | index(bits)
+#define CUPKEE_OBJECT_INDEX_BITS        9
 
 // Pin
 #define CUPKEE_PIN_MAX                  32
 
 // Memory config
-#define CUPKEE_ZONE_MAX                 2
+#define CUPKEE_ZONE_MAX                 4   // No more than 4, zone id take 2 bits in page flags
+#ifndef CUPKEE_ZONE_BOOT_ATTR
+#define CUPKEE_ZONE_BOOT_ATTR           (CUPKEE_MEM_FAST | CUPKEE_MEM_DMA)
+#endif
 
 #define CUPKEE_PAGE_SHIFT               (10)
 #define CUPKEE_PAGE_SIZE                (1U << CUPKEE_PAGE_SHIFT)
 #define CUPKEE_PAGE_MASK                (((intptr_t)(-1)) << CUPKEE_PAGE_SHIFT)
 #define CUPKEE_PAGE_ORDERR_MAX          (8)
 
-#define CUPKEE_MUNIT_SHIFT              (5)
+// Small block size classes: ascending, multiple of CUPKEE_MUNIT_SIZE,
+// the last one should be CUPKEE_MBLOCK_SIZE_MAX
+#define CUPKEE_MUNIT_SHIFT              (3)
 #define CUPKEE_MUNIT_SIZE               (1U << CUPKEE_MUNIT_SHIFT)
+#define CUPKEE_MBLOCK_SIZE_MAX          (256)
+#define CUPKEE_MBLOCK_CLASSES           16, 24, 32, 48, 64, 96, 128, 192, 256
+#define CUPKEE_MEMORY_SHRINKER_MAX      4
+#define CUPKEE_MEMORY_COMPACT_STEP      4   // movable blocks relocated per idle
+
+// Event config
+#ifndef CUPKEE_EVENTQ_SIZE
+#define CUPKEE_EVENTQ_SIZE              (16)
+#endif
+
+// Buffer config
+#define CUPKEE_CHAIN_SEG_SIZE           (64)    // block of chain segment, one of MBLOCK classes
+
+// Stream config
+#define CUPKEE_STREAM_BUF_SIZE          (24)
+#define CUPKEE_STREAM_BUF_MAX           (1024)
+#define CUPKEE_STREAM_IDLE_TICKS        (20)
+#define CUPKEE_STREAM_ADAPT_TICKS       (1000)
+
+// Timeout config
+#define CUPKEE_TIMEOUT_WHEEL_BITS       (4)
+#define CUPKEE_TIMEOUT_WHEEL_LEVEL      (4)
+#define CUPKEE_TIMEOUT_POOL_CHUNK       (8)
+#define CUPKEE_TIMEOUT_POOL_MAX         (32)
+
+// SDMP config
+#define CUPKEE_SDMP_RESPONSE_QUEUE      (4)
+#define CUPKEE_SDMP_REPORT_QUEUE        (8)     // pending reports, one per state id
+#ifndef CUPKEE_SDMP_SCRIPT_TAIL_MAX
+#define CUPKEE_SDMP_SCRIPT_TAIL_MAX     (1024)  // unfinished statement and chunk appended, when script is streamed
+#endif
 
 
 /* Cupkee api */
@@ -73,6 +121,8 @@
 void cupkee_init(const uint8_t *id);
 void cupkee_loop(void);
 void cupkee_event_poll(void);
+void cupkee_idle(void);
+uint32_t cupkee_idle_ticks(void);
 
 static inline void cupkee_start(void) {
     _cupkee_systicks = 0;
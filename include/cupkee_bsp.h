@@ -65,6 +65,9 @@ void hw_reset(int mode);
 
 void hw_poll(void);
 void hw_halt(void);
+/* Called with interrupts masked, should return when ticks elapsed or any
+ * interrupt pending, and _cupkee_systicks should be corrected before return */
+void hw_idle(uint32_t ticks);
 int  hw_boot_state(void);
 
 void hw_enter_critical(uint32_t *state);
@@ -20,6 +20,21 @@
 #ifndef __CUPKEE_BUFFER_INC__
 #define __CUPKEE_BUFFER_INC__
 
+typedef struct cupkee_iovec_t {
+    void  *ptr;
+    size_t len;
+} cupkee_iovec_t;
+
+/* Chained buffer: data kept in a list of small segments, so large payload
+ * is assembled without big contiguous allocation.
+ */
+typedef struct cupkee_chain_seg_t cupkee_chain_seg_t;
+typedef struct cupkee_chain_t {
+    cupkee_chain_seg_t *head;
+    cupkee_chain_seg_t *tail;
+    size_t len;
+} cupkee_chain_t;
+
 void cupkee_buffer_init(void);
 
 void *cupkee_buffer_alloc(size_t size);
@@ -27,6 +42,15 @@ void *cupkee_buffer_create(size_t n, const void *data);
 void cupkee_buffer_release(void *b);
 void cupkee_buffer_reset(void *b);
 
+void *cupkee_buffer_alloc_movable(size_t size);
+void cupkee_buffer_ref(void *b, void **ref);
+void cupkee_buffer_lock(void *b);
+void cupkee_buffer_unlock(void *b);
+
+void *cupkee_buffer_share(void *b);
+void *cupkee_buffer_writable(void *b);
+int cupkee_buffer_is_shared(void *b);
+
 size_t cupkee_buffer_capacity(void *b);
 size_t cupkee_buffer_space(void *b);
 size_t cupkee_buffer_length(void *b);
@@ -36,6 +60,7 @@ int cupkee_buffer_extend(void *b, int n);
 int cupkee_buffer_is_empty(void *b);
 int cupkee_buffer_is_full(void *b);
 
+int cupkee_buffer_peek(void *b, int offset, size_t n, void *buf);
 int cupkee_buffer_set(void *b, int offset, uint8_t d);
 int cupkee_buffer_get(void *b, int offset, uint8_t *d);
 int cupkee_buffer_push(void *b, uint8_t d);
@@ -46,6 +71,13 @@ int cupkee_buffer_shift(void *b, uint8_t *d);
 int cupkee_buffer_take(void *b, size_t n, void *buf);
 int cupkee_buffer_give(void *b, size_t n, const void *buf);
 
+size_t cupkee_buffer_space_window(void *b, void **ptr);
+size_t cupkee_buffer_data_window(void *b, void **ptr);
+int cupkee_buffer_commit(void *b, size_t n);
+int cupkee_buffer_consume(void *b, size_t n);
+size_t cupkee_buffer_space_iov(void *b, cupkee_iovec_t iov[2]);
+size_t cupkee_buffer_data_iov(void *b, cupkee_iovec_t iov[2]);
+
 void *cupkee_buffer_slice(void *b, int start, int n);
 void *cupkee_buffer_copy(void *b);
 void *cupkee_buffer_sort(void *b);
@@ -74,5 +106,19 @@ int cupkee_buffer_read_float_le(void *b, int offset, float *f);
 int cupkee_buffer_read_double_be(void *b, int offset, double *d);
 int cupkee_buffer_read_double_le(void *b, int offset, double *d);
 
+// n items of size (1, 2, 4, 8) bytes, return items read
+int cupkee_buffer_read_le(void *b, int offset, int size, int n, void *buf);
+int cupkee_buffer_read_be(void *b, int offset, int size, int n, void *buf);
+
+void   cupkee_chain_init(cupkee_chain_t *c);
+void   cupkee_chain_release(cupkee_chain_t *c);
+size_t cupkee_chain_length(cupkee_chain_t *c);
+int    cupkee_chain_append(cupkee_chain_t *c, size_t n, const void *data);
+int    cupkee_chain_prepend(cupkee_chain_t *c, size_t n, const void *data);
+int    cupkee_chain_split(cupkee_chain_t *c, size_t at, cupkee_chain_t *rest);
+int    cupkee_chain_gather(cupkee_chain_t *c, size_t off, size_t n, void *buf);
+int    cupkee_chain_consume(cupkee_chain_t *c, size_t n);
+int    cupkee_chain_iov(cupkee_chain_t *c, cupkee_iovec_t *iov, int max);
+
 #endif /* __CUPKEE_BUFFER_INC__ */
 
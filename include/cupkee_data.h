@@ -24,9 +24,18 @@ enum cupkee_data_type_e {
     CUPKEE_DATA_NONE = 0,
     CUPKEE_DATA_BOOLEAN,
     CUPKEE_DATA_NUMBER,
-    CUPKEE_DATA_STRING
+    CUPKEE_DATA_STRING,
+
+    // Compact number encoding, big endian, shifted out as CUPKEE_DATA_NUMBER
+    CUPKEE_DATA_INT8,
+    CUPKEE_DATA_INT16,
+    CUPKEE_DATA_INT32,
+    CUPKEE_DATA_FLOAT,
+    CUPKEE_DATA_VARINT,     // zigzag, 7 bits per byte, low group first
 };
 
+#define CUPKEE_DATA_NUMBER_MAX  (9)     // type and value of number encoded
+
 typedef struct cupkee_data_entry_t  {
     uint8_t end;
     uint8_t pos;
@@ -46,6 +55,7 @@ static inline void cupkee_data_init(cupkee_data_entry_t *entry, uint8_t size, ui
 };
 
 int cupkee_data_shift(cupkee_data_entry_t *entry, cupkee_data_t *av);
+int cupkee_data_put_number(uint8_t *buf, double v);
 
 #endif /* __CUPKEE_DATA_INC__ */
 
@@ -22,6 +22,11 @@
 
 #define DEVICE_FL_ENABLE    1
 #define DEVICE_FL_BUSY      2
+#define DEVICE_FL_STARTING  4
+
+/* Poll interval: every loop, or never (only when marked ready) */
+#define CUPKEE_DEVICE_POLL_ALWAYS   0
+#define CUPKEE_DEVICE_POLL_NONE     CUPKEE_TICKS_FOREVER
 
 typedef struct cupkee_device_t cupkee_device_t;
 
@@ -52,6 +57,11 @@ typedef struct cupkee_device_desc_t {
 
 struct cupkee_device_t {
     cupkee_device_t *next;
+    cupkee_device_t *poll_next;
+
+    uint32_t poll_interval;
+    uint32_t poll_stamp;
+    volatile uint8_t poll_ready;
 
     uint8_t instance;
     uint8_t type;
@@ -64,16 +74,30 @@ struct cupkee_device_t {
     void             *req;
     void             *res;
 
+    /* query queue */
+    void             *query;        // in progress
+    list_head_t       query_wait;
+    list_head_t       query_done;   // wait for RESPONSE dispatch
+    uint8_t           query_num;
+
     const cupkee_driver_t *driver;
 
     cupkee_struct_t  *conf;
     cupkee_stream_t  *s;
+
+    /* stream settings, take effect when enabled */
+    uint16_t rx_size;
+    uint16_t tx_size;
+    uint16_t rx_watermark;
+    uint16_t rx_idle;
+    uint8_t  adaptive;
 };
 
 int cupkee_device_setup(void);
 int cupkee_device_tag(void);
 void cupkee_device_sync(uint32_t systicks);
 void cupkee_device_poll(void);
+uint32_t cupkee_device_next(uint32_t systicks);
 int  cupkee_device_register(const cupkee_device_desc_t *desc);
 
 void *cupkee_device_request(const char *name, int instance);
@@ -94,6 +118,9 @@ int cupkee_device_query(void *entry, size_t req_len, void *req_data, int want, c
 int cupkee_device_query2(void *entry, void *req, int want, cupkee_callback_t cb, intptr_t param);
 
 /* used by driver */
+int  cupkee_device_poll_set(void *entry, uint32_t interval);
+void cupkee_device_ready(void *entry);
+
 void *cupkee_device_request_take(void *entry);
 void *cupkee_device_response_take(void *entry);
 
@@ -106,6 +133,14 @@ int  cupkee_device_response_push(void *entry, size_t n, void *data);
 
 int cupkee_device_push(void *entry, size_t n, const void *data);
 int cupkee_device_pull(void *entry, size_t n, void *buf);
+int cupkee_device_push_reserve(void *entry, void **ptr);
+int cupkee_device_push_commit(void *entry, size_t n);
+int cupkee_device_pull_reserve(void *entry, void **ptr);
+int cupkee_device_pull_commit(void *entry, size_t n);
+int cupkee_device_push_buf(void *entry, void *buf);
+void *cupkee_device_pull_buf(void *entry);
+int cupkee_device_read_reserve(void *entry, void **ptr);
+int cupkee_device_read_commit(void *entry, size_t n);
 
 static inline void cupkee_device_set_error(void *entry, uint8_t code) {
     cupkee_object_error_set(CUPKEE_OBJECT_PTR(entry), code);
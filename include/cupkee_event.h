@@ -23,7 +23,9 @@
 enum CUPKEE_EVENT_TYPE {
     EVENT_SYSTICK = 0,
     EVENT_OBJECT  = 1,
-    EVENT_PIN     = 2
+    EVENT_PIN     = 2,
+
+    EVENT_TYPE_MAX
 };
 
 enum CUPKEE_EVENT_OBJECT {
@@ -68,10 +70,15 @@ void cupkee_event_reset(void);
 
 int cupkee_event_post(uint8_t type, uint8_t code, uint16_t which);
 int cupkee_event_take(cupkee_event_t *event);
+int cupkee_event_is_empty(void);
 
-static inline int cupkee_event_post_systick(void) {
-    return cupkee_event_post(EVENT_SYSTICK, 0, 0);
-}
+/* Systick events not taken yet are merged, the which of event is the ticks elapsed */
+int cupkee_event_post_systick(void);
+
+/* Statistic: drops of type EVENT_TYPE_MAX count the unknown types */
+int  cupkee_event_drops(int type);
+int  cupkee_event_high_water(void);
+void cupkee_event_stat_reset(void);
 
 static inline int cupkee_event_post_pin(uint8_t which, uint8_t event) {
     return cupkee_event_post(EVENT_PIN, event, which);
@@ -20,28 +20,97 @@
 #ifndef __CUPKEE_MEMORY_INC__
 #define __CUPKEE_MEMORY_INC__
 
+/* Zone attributes, also used as allocation hint:
+ * FAST is a preference, DMA and RETAIN must be satisfied.
+ */
+#define CUPKEE_MEM_FAST     0x01    // zero wait state memory, e.g. CCM
+#define CUPKEE_MEM_DMA      0x02    // accessible by DMA
+#define CUPKEE_MEM_RETAIN   0x04    // content kept in standby, only alloc with hint
+
 typedef struct cupkee_page_t {
     list_head_t list;
 
     uint8_t flags;
     uint8_t used;
-    uint16_t order;
+    uint8_t order;
+    uint8_t cls;
 
     intptr_t blocks;
 } cupkee_page_t;
 
+/* Slab: cache of fixed size blocks, pages with free blocks in partial
+ * list and exhausted ones in full list.
+ */
+typedef struct cupkee_slab_t {
+    list_head_t partial;
+    list_head_t full;
+
+    uint16_t size;      // block size
+    uint16_t reserve;   // pages kept even though empty
+    uint16_t pages;     // pages hold
+    uint16_t inuse;     // blocks in use
+    uint16_t peak;      // max blocks in use
+    uint16_t fails;     // alloc failed
+} cupkee_slab_t;
+
+typedef struct cupkee_memory_stat_t {
+    uint16_t pages;         // pages of all zones
+    uint16_t pages_free;
+    uint16_t pages_peak;    // max pages in use
+    uint16_t malloc_fails;  // cupkee_malloc failed
+    uint16_t reclaims;      // allocation rescued by shrinker
+    uint16_t moves;         // movable blocks relocated by compactor
+    uint8_t  frag;          // fragmentation index: 0 ~ 100
+    uint16_t free_blocks[CUPKEE_PAGE_ORDERR_MAX];
+    uint16_t fails[CUPKEE_PAGE_ORDERR_MAX];
+    uint32_t allocs[CUPKEE_PAGE_ORDERR_MAX];
+} cupkee_memory_stat_t;
+
+/* Shrinker: release cached memory when allocation is going to fail,
+ * return bytes released. It must not alloc memory.
+ */
+typedef size_t (*cupkee_shrink_t)(size_t want);
+
 int cupkee_memory_setup(void);
-int cupkee_memory_extend(intptr_t base, size_t size);
+int cupkee_memory_extend(intptr_t base, size_t size, int attr);
+int cupkee_memory_attr(void *ptr);
 
 int cupkee_free_pages(int order);
 
+int    cupkee_memory_shrinker(cupkee_shrink_t shrink);
+size_t cupkee_memory_reclaim(size_t want);
+
+/* Movable block: the owner's pointer registered by cupkee_movable_ref is
+ * the handle. Compactor relocates unlocked blocks in idle time and updates
+ * the handle, so owner must reload it instead of keeping a copy.
+ * A block without ref, or locked, is never moved.
+ */
+void *cupkee_movable_alloc(size_t size, int hint);
+void  cupkee_movable_free(void *p);
+void  cupkee_movable_ref(void *p, void **ref);
+void  cupkee_movable_lock(void *p);
+void  cupkee_movable_unlock(void *p);
+int   cupkee_memory_compact(int budget);
+
+void cupkee_memory_stat(cupkee_memory_stat_t *stat);
+int  cupkee_memory_class_num(void);
+const cupkee_slab_t *cupkee_memory_class(int q);
+
 void *cupkee_page_memory(cupkee_page_t *page);
 cupkee_page_t *cupkee_memory_page(void *ptr);
 
 cupkee_page_t *cupkee_page_alloc(int order);
+cupkee_page_t *cupkee_page_alloc_hint(int order, int hint);
 void cupkee_page_free(cupkee_page_t *page);
 
+int   cupkee_slab_init(cupkee_slab_t *slab, size_t size);
+int   cupkee_slab_reserve(cupkee_slab_t *slab, int n);
+int   cupkee_slab_space(cupkee_slab_t *slab);
+void *cupkee_slab_alloc(cupkee_slab_t *slab);
+void  cupkee_slab_free(cupkee_slab_t *slab, void *p);
+
 void *cupkee_malloc(size_t s);
+void *cupkee_malloc_hint(size_t s, int hint);
 void  cupkee_free(void *p);
 
 #endif /* __CUPKEE_MEMORY_INC__ */
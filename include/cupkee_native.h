@@ -33,6 +33,7 @@ val_t native_pin_toggle(env_t *env, int ac, val_t *av);
 
 /* cupkee_shell_sdmp.c */
 val_t native_report(env_t *env, int ac, val_t *av);
+val_t native_report_batch(env_t *env, int ac, val_t *av);
 val_t native_interface(env_t *env, int ac, val_t *av);
 
 /* cupkee_module.c */
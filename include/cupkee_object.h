@@ -61,6 +61,14 @@ typedef struct cupkee_object_t {
     uint8_t entry[0];
 } cupkee_object_t;
 
+typedef struct cupkee_object_stat_t {
+    uint16_t size;      // bytes per object, header included
+    uint16_t inuse;
+    uint16_t peak;
+    uint16_t cached;    // free objects in cache
+    uint16_t pages;     // pages hold by cache
+} cupkee_object_stat_t;
+
 int  cupkee_object_setup(void);
 void cupkee_object_event_dispatch(uint16_t which, uint8_t code);
 
@@ -70,6 +78,8 @@ static inline void cupkee_object_event_post(int id, uint8_t code) {
 
 int  cupkee_object_register(size_t size, const cupkee_desc_t *desc);
 void cupkee_object_set_meta(int tag, void *meta);
+int  cupkee_object_cache(int tag, int reserve);
+int  cupkee_object_stat(int tag, cupkee_object_stat_t *stat);
 
 
 cupkee_object_t *cupkee_object_create(int tag);
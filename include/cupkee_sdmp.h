@@ -28,11 +28,22 @@ int cupkee_sdmp_set_interface_id(const char *id);
 int cupkee_sdmp_set_tty_handler(void (*handler)(int, const void *));
 int cupkee_sdmp_set_call_handler(int (*handler)(int x, void *args));
 int cupkee_sdmp_set_query_handler(int (*handler)(uint16_t flags));
+int cupkee_sdmp_set_script_executor(int (*executor)(const char *script));
 
 int cupkee_sdmp_update_state_trigger(int id);
 int cupkee_sdmp_update_state_boolean(int id, int v);
 int cupkee_sdmp_update_state_number(int id, double v);
 int cupkee_sdmp_update_state_string(int id, const char *s);
 
+/* Batch report: items are packed into one message, until flushed or full */
+int cupkee_sdmp_batch_trigger(int id);
+int cupkee_sdmp_batch_boolean(int id, int v);
+int cupkee_sdmp_batch_number(int id, double v);
+int cupkee_sdmp_batch_string(int id, const char *s);
+int cupkee_sdmp_batch_flush(void);
+int cupkee_sdmp_batch_prepare(size_t n);
+int cupkee_sdmp_batch_mark(void);
+void cupkee_sdmp_batch_rollback(int mark);
+
 #endif /* __CUPKEE_SDMP_INC__ */
 
@@ -28,7 +28,8 @@ enum {
 
     CUPKEE_STREAM_FL_NOTIFY_ERROR = 0x10,
     CUPKEE_STREAM_FL_NOTIFY_DATA  = 0x20,
-    CUPKEE_STREAM_FL_NOTIFY_DRAIN = 0x40
+    CUPKEE_STREAM_FL_NOTIFY_DRAIN = 0x40,
+    CUPKEE_STREAM_FL_ADAPTIVE     = 0x80
 };
 
 enum {
@@ -46,8 +47,20 @@ struct cupkee_stream_t {
     uint16_t rx_buf_size;
     uint16_t tx_buf_size;
 
+    uint16_t rx_watermark;  // DATA notify level, 0: half of rx_buf_size
+    uint16_t rx_idle;       // DATA notify after idle ticks
+
     uint32_t last_push;
 
+    /* adaptive sizing */
+    uint16_t rx_buf_base;
+    uint16_t tx_buf_base;
+    uint16_t rx_peak;
+    uint16_t tx_peak;
+    uint16_t rx_drops;
+    uint16_t tx_drops;
+    uint32_t adapt_stamp;
+
     void *rx_buf;
     void *tx_buf;
 
@@ -68,6 +81,10 @@ int cupkee_stream_init(
 );
 int cupkee_stream_deinit(cupkee_stream_t *s);
 
+void cupkee_stream_set_watermark(cupkee_stream_t *s, size_t level, uint32_t idle);
+void cupkee_stream_set_adaptive(cupkee_stream_t *s, int enable);
+size_t cupkee_stream_shrink(cupkee_stream_t *s);
+
 void cupkee_stream_listen(cupkee_stream_t *s, int event);
 void cupkee_stream_ignore(cupkee_stream_t *s, int event);
 
@@ -76,10 +93,18 @@ void cupkee_stream_pause(cupkee_stream_t *s);
 void cupkee_stream_shutdown(cupkee_stream_t *s, uint8_t flags);
 
 void cupkee_stream_sync(cupkee_stream_t *s, uint32_t systicks);
+uint32_t cupkee_stream_sync_wait(cupkee_stream_t *s, uint32_t systicks);
 int cupkee_stream_push(cupkee_stream_t *s, size_t n, const void *data);
 int cupkee_stream_pull(cupkee_stream_t *s, size_t n, void *data);
 
+int cupkee_stream_push_reserve(cupkee_stream_t *s, void **ptr);
+int cupkee_stream_push_commit(cupkee_stream_t *s, size_t n);
+int cupkee_stream_pull_reserve(cupkee_stream_t *s, void **ptr);
+int cupkee_stream_pull_commit(cupkee_stream_t *s, size_t n);
+
 int cupkee_stream_read(cupkee_stream_t *s, size_t n, void *buf);
+int cupkee_stream_read_reserve(cupkee_stream_t *s, void **ptr);
+int cupkee_stream_read_commit(cupkee_stream_t *s, size_t n);
 int cupkee_stream_write(cupkee_stream_t *s, size_t n, const void *data);
 
 int cupkee_stream_read_sync(cupkee_stream_t *s, size_t n, void *buf);
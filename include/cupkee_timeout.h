@@ -20,21 +20,24 @@
 #ifndef __CUPKEE_TIMEOUT_INC__
 #define __CUPKEE_TIMEOUT_INC__
 
+#define CUPKEE_TICKS_FOREVER    (0xFFFFFFFFU)
+
 extern volatile uint32_t _cupkee_systicks;
 
 typedef void (*cupkee_timeout_handle_t)(int drop, void *param);
 typedef struct cupkee_timeout_t {
-    struct cupkee_timeout_t *next;
+    list_head_t list;
     cupkee_timeout_handle_t handle;
     int      id;
     int      flags;
     uint32_t wait;
-    uint32_t from;
+    uint32_t expire;
     void    *param;
 } cupkee_timeout_t;
 
 void cupkee_timeout_setup(void);
 void cupkee_timeout_sync(uint32_t ticks);
+uint32_t cupkee_timeout_next(void);
 
 cupkee_timeout_t *cupkee_timeout_register(uint32_t wait, int repeat, cupkee_timeout_handle_t handle, void *param);
 void cupkee_timeout_unregister(cupkee_timeout_t *t);
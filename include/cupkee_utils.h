@@ -64,6 +64,19 @@ static inline void list_add_tail(list_head_t *node, list_head_t *head) {
     __list_add(node, head->prev, head);
 }
 
+static inline void list_move_all(list_head_t *head, list_head_t *to) {
+    if (list_is_empty(head)) {
+        list_head_init(to);
+    } else {
+        to->next = head->next;
+        to->prev = head->prev;
+        to->next->prev = to;
+        to->prev->next = to;
+
+        list_head_init(head);
+    }
+}
+
 #define list_for_each(pos, head) \
     for (pos = (head)->next; pos != (head); pos = pos->next)
 
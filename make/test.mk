@@ -29,6 +29,10 @@ test_CPPFLAGS = -I${INC_DIR} -I${LANG_DIR}/include
 test_CPPFLAGS += -I${TST_DIR}/cunit -I${BSP_DIR}/test
 
 test_CFLAGS   =
+ifdef BENCH
+# make test BENCH=1: run benchmarks too, results printed
+test_CFLAGS  += -DCUPKEE_TEST_BENCH
+endif
 test_LDFLAGS  = -L${BSP_BUILD_DIR} -L${SYS_BUILD_DIR} -L${LANG_BUILD_DIR} -lsys -llang
 
 include ${MAKE_DIR}/cupkee.ruls.mk
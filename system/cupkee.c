@@ -41,6 +41,36 @@ void cupkee_event_poll(void)
     }
 }
 
+uint32_t cupkee_idle_ticks(void)
+{
+    uint32_t wait = cupkee_timeout_next();
+    uint32_t next = cupkee_device_next(_cupkee_systicks);
+
+    return next < wait ? next : wait;
+}
+
+void cupkee_idle(void)
+{
+    uint32_t state;
+    uint32_t wait = cupkee_idle_ticks();
+
+    if (!wait) {
+        return;
+    }
+
+    // Spare time before sleep, tidy up the heap a little
+    cupkee_memory_compact(CUPKEE_MEMORY_COMPACT_STEP);
+
+    // Interrupts are masked here, to not lose the events posted before sleep.
+    // Any pending interrupt will wake up the board.
+    // Device may be marked ready by interrupt after wait computed, check again.
+    hw_enter_critical(&state);
+    if (cupkee_event_is_empty() && cupkee_device_next(_cupkee_systicks)) {
+        hw_idle(wait);
+    }
+    hw_exit_critical(state);
+}
+
 void cupkee_sysinfo_get(uint8_t *info_buf)
 {
     // cupkee version info
@@ -107,6 +137,8 @@ void cupkee_loop(void)
         cupkee_device_poll();
 
         cupkee_event_poll();
+
+        cupkee_idle();
     }
 }
 
@@ -17,20 +17,34 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  **/
 
+#include <assert.h>
+
 #include "cupkee.h"
 
+#define BUFFER_FL_MOVABLE   0x01
+
 typedef struct cupkee_buffer_t {
-    uint16_t flags;
+    uint8_t  flags;
+    uint8_t  refs;
     uint16_t cap;
     uint16_t bgn;
     uint16_t len;
     uint8_t  ptr[0];
 } cupkee_buffer_t;
 
+static inline int buffer_is_shared(cupkee_buffer_t *b)
+{
+    return b->refs > 1;
+}
+
+/* Shared buffer is not reset */
 void cupkee_buffer_reset(void *p)
 {
     cupkee_buffer_t *b = (cupkee_buffer_t *)p;
 
+    if (buffer_is_shared(b)) {
+        return;
+    }
     b->len = 0;
     b->bgn = 0;
 }
@@ -40,6 +54,8 @@ void *cupkee_buffer_alloc(size_t size)
     cupkee_buffer_t *buf = cupkee_malloc(size + sizeof(cupkee_buffer_t));
 
     if (buf) {
+        buf->flags = 0;
+        buf->refs = 1;
         buf->cap = size;
         buf->len = 0;
         buf->bgn = 0;
@@ -52,6 +68,8 @@ void *cupkee_buffer_create(size_t n, const void *data)
     cupkee_buffer_t *buf = cupkee_malloc(n + sizeof(cupkee_buffer_t));
 
     if (buf) {
+        buf->flags = 0;
+        buf->refs = 1;
         buf->cap = n;
         buf->len = n;
         buf->bgn = 0;
@@ -60,9 +78,101 @@ void *cupkee_buffer_create(size_t n, const void *data)
     return buf;
 }
 
+/* Movable buffer, relocated by memory compactor once cupkee_buffer_ref
+ * tell where it is kept. Non-movable buffers ignore ref, lock and unlock.
+ */
+void *cupkee_buffer_alloc_movable(size_t size)
+{
+    cupkee_buffer_t *buf = cupkee_movable_alloc(size + sizeof(cupkee_buffer_t), 0);
+
+    if (buf) {
+        buf->flags = BUFFER_FL_MOVABLE;
+        buf->refs = 1;
+        buf->cap = size;
+        buf->len = 0;
+        buf->bgn = 0;
+    }
+    return buf;
+}
+
+void cupkee_buffer_ref(void *p, void **ref)
+{
+    if (((cupkee_buffer_t *)p)->flags & BUFFER_FL_MOVABLE) {
+        cupkee_movable_ref(p, ref);
+    }
+}
+
+void cupkee_buffer_lock(void *p)
+{
+    if (((cupkee_buffer_t *)p)->flags & BUFFER_FL_MOVABLE) {
+        cupkee_movable_lock(p);
+    }
+}
+
+void cupkee_buffer_unlock(void *p)
+{
+    if (((cupkee_buffer_t *)p)->flags & BUFFER_FL_MOVABLE) {
+        cupkee_movable_unlock(p);
+    }
+}
+
 void cupkee_buffer_release(void *p)
 {
-    cupkee_free(p);
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+
+    if (b && b->refs > 1) {
+        b->refs--;
+        return;
+    }
+
+    if (b && (b->flags & BUFFER_FL_MOVABLE)) {
+        cupkee_movable_free(p);
+    } else {
+        cupkee_free(p);
+    }
+}
+
+/* Shared buffer: every holder release it once. Holders read it by peek,
+ * get, read_xxx or data_iov, and get a private one by cupkee_buffer_writable
+ * before modification (copy on write). Modifiers treat a shared buffer as
+ * full and empty: nothing is pushed, taken, set or moved.
+ */
+void *cupkee_buffer_share(void *p)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+
+    if (b->refs == 0xff) {
+        return NULL;
+    }
+    b->refs++;
+
+    // One pointer could be updated by compactor only
+    cupkee_buffer_ref(p, NULL);
+
+    return p;
+}
+
+int cupkee_buffer_is_shared(void *p)
+{
+    return buffer_is_shared((cupkee_buffer_t *)p);
+}
+
+/* Return p if not shared, or a private copy with the reference to p
+ * dropped. NULL if no memory, p is kept in that case.
+ */
+void *cupkee_buffer_writable(void *p)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    void *copy;
+
+    if (b->refs < 2) {
+        return p;
+    }
+
+    if (NULL != (copy = cupkee_buffer_copy(p))) {
+        b->refs--;
+    }
+    return copy;
 }
 
 int cupkee_buffer_is_empty(void *p)
@@ -104,6 +214,10 @@ int cupkee_buffer_extend(void *p, int n)
 {
     cupkee_buffer_t *b = (cupkee_buffer_t *)p;
 
+    if (buffer_is_shared(b)) {
+        return b->len;
+    }
+
     if (n > 0) {
         if (b->len + n <= b->cap) {
             b->len += n;
@@ -120,6 +234,10 @@ int cupkee_buffer_push(void *p, uint8_t d)
 {
     cupkee_buffer_t *b = (cupkee_buffer_t *)p;
 
+    if (buffer_is_shared(b)) {
+        return 0;
+    }
+
     if (b->len < b->cap) {
         int tail = b->bgn + b->len++;
         if (tail >= b->cap) {
@@ -136,6 +254,10 @@ int cupkee_buffer_pop(void *p, uint8_t *d)
 {
     cupkee_buffer_t *b = (cupkee_buffer_t *)p;
 
+    if (buffer_is_shared(b)) {
+        return 0;
+    }
+
     if (b->len) {
         int tail = b->bgn + (--b->len);
         if (tail >= b->cap) {
@@ -152,6 +274,10 @@ int cupkee_buffer_shift(void *p, uint8_t *d)
 {
     cupkee_buffer_t *b = (cupkee_buffer_t *)p;
 
+    if (buffer_is_shared(b)) {
+        return 0;
+    }
+
     if (b->len) {
         *d = b->ptr[b->bgn++];
         if (b->bgn >= b->cap) {
@@ -167,6 +293,10 @@ int cupkee_buffer_unshift(void *p, uint8_t d)
 {
     cupkee_buffer_t *b = (cupkee_buffer_t *)p;
 
+    if (buffer_is_shared(b)) {
+        return 0;
+    }
+
     if (b->len < b->cap) {
         b->len++;
         if (b->bgn) {
@@ -186,6 +316,10 @@ int cupkee_buffer_take(void *p, size_t n, void *buf)
 {
     cupkee_buffer_t *b = (cupkee_buffer_t *)p;
 
+    if (buffer_is_shared(b)) {
+        return 0;
+    }
+
     if (n > b->len) {
         n = b->len;
     }
@@ -215,6 +349,10 @@ int cupkee_buffer_give(void *p, size_t n, const void *buf)
 {
     cupkee_buffer_t *b = (cupkee_buffer_t *)p;
 
+    if (buffer_is_shared(b)) {
+        return 0;
+    }
+
     if (n + b->len > b->cap) {
         n = b->cap - b->len;
     }
@@ -240,23 +378,713 @@ int cupkee_buffer_give(void *p, size_t n, const void *buf)
     return n;
 }
 
+/*
+ * Contiguous windows for bulk io:
+ *  space_window: free area following the data, fill it then commit(n)
+ *  data_window : data area from the head, use it then consume(n)
+ * A wrapped buffer exposes the first segment only, ask again after commit.
+ */
+size_t cupkee_buffer_space_window(void *p, void **ptr)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    int head = b->bgn + b->len;
+    int n;
+
+    if (buffer_is_shared(b)) {
+        *ptr = NULL;
+        return 0;
+    }
+
+    if (head >= b->cap) {
+        head -= b->cap;
+        n = b->bgn - head;
+    } else {
+        n = b->cap - head;
+    }
+
+    *ptr = b->ptr + head;
+    return n;
+}
+
+size_t cupkee_buffer_data_window(void *p, void **ptr)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    int n = b->cap - b->bgn;
+
+    *ptr = b->ptr + b->bgn;
+    return n < b->len ? n : b->len;
+}
+
+int cupkee_buffer_commit(void *p, size_t n)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+
+    if (buffer_is_shared(b)) {
+        return 0;
+    }
+
+    if (n > (size_t)(b->cap - b->len)) {
+        n = b->cap - b->len;
+    }
+    b->len += n;
+
+    return n;
+}
+
+int cupkee_buffer_consume(void *p, size_t n)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+
+    if (buffer_is_shared(b)) {
+        return 0;
+    }
+
+    if (n > b->len) {
+        n = b->len;
+    }
+
+    b->len -= n;
+    if (b->len) {
+        b->bgn += n;
+        if (b->bgn >= b->cap) {
+            b->bgn -= b->cap;
+        }
+    } else {
+        b->bgn = 0;
+    }
+
+    return n;
+}
+
+/*
+ * Both segments at once, for scatter io:
+ *  space_iov: free areas following the data, fill in order then commit(n)
+ *  data_iov : data areas from the head, use in order then consume(n)
+ * Return total bytes, length of unused segment is 0.
+ */
+size_t cupkee_buffer_space_iov(void *p, cupkee_iovec_t iov[2])
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    size_t n = cupkee_buffer_space_window(p, &iov[0].ptr);
+
+    if (buffer_is_shared(b)) {
+        iov[1].ptr = NULL;
+        iov[0].len = iov[1].len = 0;
+        return 0;
+    }
+
+    iov[0].len = n;
+    iov[1].ptr = b->ptr;
+    iov[1].len = b->cap - b->len - n;
+
+    return b->cap - b->len;
+}
+
+size_t cupkee_buffer_data_iov(void *p, cupkee_iovec_t iov[2])
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    size_t n = cupkee_buffer_data_window(p, &iov[0].ptr);
+
+    iov[0].len = n;
+    iov[1].ptr = b->ptr;
+    iov[1].len = b->len - n;
+
+    return b->len;
+}
+
+static inline uint32_t buffer_swap32(uint32_t x)
+{
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+/* Word at a time from both ends, bytes left in the middle */
+static void buffer_mem_reverse(uint8_t *head, uint8_t *tail)
+{
+    while (tail - head >= 8) {
+        uint32_t h, t;
+
+        tail -= 4;
+        memcpy(&h, head, 4);
+        memcpy(&t, tail, 4);
+        h = buffer_swap32(h);
+        t = buffer_swap32(t);
+        memcpy(head, &t, 4);
+        memcpy(tail, &h, 4);
+        head += 4;
+    }
+
+    while (head < --tail) {
+        uint8_t t = *head;
+
+        *head++ = *tail;
+        *tail = t;
+    }
+}
+
+/* Make data contiguous in place, never fail. The buffer is private,
+ * holder of a shared one call cupkee_buffer_writable first.
+ */
 void *cupkee_buffer_ptr(void *buf)
 {
     cupkee_buffer_t *b = (cupkee_buffer_t *)buf;
     int wrap = b->bgn + b->len - b->cap;
 
+    assert(!buffer_is_shared(b));
+
     if (wrap > 0) {
-        int gap = b->cap - b->len;
+
         uint8_t *ptr = b->ptr;
-        if (gap >= wrap) {
-            memmove(ptr + wrap, ptr + b->bgn, b->len - wrap);
-            memcpy(ptr + b->len - wrap, ptr, wrap);
-            b->bgn = wrap;
+        int head = b->cap - b->bgn;
+
+        if (b->len <= b->bgn) {
+            // Room enough: shift the wrapped part up, put head part before it
+            memmove(ptr + head, ptr, wrap);
+            memcpy(ptr, ptr + b->bgn, head);
         } else {
-            // Todo: alloc new ptr
-            return NULL;
+            // Rotate the whole area left by bgn
+            buffer_mem_reverse(ptr, ptr + b->bgn);
+            buffer_mem_reverse(ptr + b->bgn, ptr + b->cap);
+            buffer_mem_reverse(ptr, ptr + b->cap);
         }
+        b->bgn = 0;
     }
 
     return b->ptr + b->bgn;
 }
+
+/*
+ * Random access, offset is counted from the head of data.
+ * Readers return bytes read, 0 if out of range.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define BUFFER_HOST_BE  1
+#else
+#define BUFFER_HOST_BE  0
+#endif
+
+static inline int buffer_pos(cupkee_buffer_t *b, int offset)
+{
+    int pos = b->bgn + offset;
+
+    return pos < b->cap ? pos : pos - b->cap;
+}
+
+/* Copy out n bytes from offset, data kept */
+static int buffer_peek(cupkee_buffer_t *b, int offset, int n, void *buf)
+{
+    int pos, size;
+
+    if (offset < 0 || n <= 0 || offset + n > b->len) {
+        return 0;
+    }
+
+    pos = buffer_pos(b, offset);
+    size = b->cap - pos;
+    if (size >= n) {
+        memcpy(buf, b->ptr + pos, n);
+    } else {
+        memcpy(buf, b->ptr + pos, size);
+        memcpy((uint8_t *)buf + size, b->ptr, n - size);
+    }
+
+    return n;
+}
+
+/* n items of size bytes, copied at once then byte swapped if need */
+static int buffer_read_array(void *p, int offset, int size, int n, void *buf, int be)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    uint8_t *ptr = buf;
+    int i;
+
+    if ((size != 1 && size != 2 && size != 4 && size != 8) || offset < 0 || offset > b->len) {
+        return 0;
+    }
+
+    if (n > (b->len - offset) / size) {
+        n = (b->len - offset) / size;
+    }
+
+    if (!buffer_peek(b, offset, n * size, buf)) {
+        return 0;
+    }
+
+    // Swap by word, item may be unaligned
+    if (size > 1 && be != BUFFER_HOST_BE) {
+        for (i = 0; i < n; i++, ptr += size) {
+            uint32_t w[2];
+
+            if (size == 2) {
+                uint16_t h;
+
+                memcpy(&h, ptr, 2);
+                h = (h >> 8) | (h << 8);
+                memcpy(ptr, &h, 2);
+                continue;
+            }
+
+            memcpy(w, ptr, size);
+            if (size == 4) {
+                w[0] = buffer_swap32(w[0]);
+            } else {
+                uint32_t t = buffer_swap32(w[0]);
+
+                w[0] = buffer_swap32(w[1]);
+                w[1] = t;
+            }
+            memcpy(ptr, w, size);
+        }
+    }
+
+    return n;
+}
+
+int cupkee_buffer_peek(void *b, int offset, size_t n, void *buf)
+{
+    cupkee_buffer_t *buffer = (cupkee_buffer_t *)b;
+
+    if (offset < 0 || offset > buffer->len) {
+        return 0;
+    }
+    if (n > (size_t)(buffer->len - offset)) {
+        n = buffer->len - offset;
+    }
+
+    return buffer_peek(buffer, offset, n, buf);
+}
+
+int cupkee_buffer_set(void *p, int offset, uint8_t d)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+
+    if (buffer_is_shared(b) || offset < 0 || offset >= b->len) {
+        return 0;
+    }
+    b->ptr[buffer_pos(b, offset)] = d;
+
+    return 1;
+}
+
+int cupkee_buffer_get(void *p, int offset, uint8_t *d)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+
+    if (offset < 0 || offset >= b->len) {
+        return 0;
+    }
+    *d = b->ptr[buffer_pos(b, offset)];
+
+    return 1;
+}
+
+/* New buffer hold n bytes from start */
+void *cupkee_buffer_slice(void *p, int start, int n)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    cupkee_buffer_t *slice;
+
+    if (start < 0 || start > b->len || n < 0) {
+        return NULL;
+    }
+    if (n > b->len - start) {
+        n = b->len - start;
+    }
+
+    if (NULL != (slice = cupkee_buffer_alloc(n))) {
+        slice->len = buffer_peek(b, start, n, slice->ptr);
+    }
+    return slice;
+}
+
+void *cupkee_buffer_copy(void *p)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    cupkee_buffer_t *copy = cupkee_buffer_alloc(b->cap);
+
+    if (copy) {
+        copy->len = buffer_peek(b, 0, b->len, copy->ptr);
+    }
+    return copy;
+}
+
+/* Ascending in place, counting sort over the byte domain: one pass to
+ * count and one to write back, wrapped data is not moved.
+ */
+void *cupkee_buffer_sort(void *p)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    uint16_t count[256];
+    int i, v, pos;
+
+    if (buffer_is_shared(b)) {
+        return NULL;
+    }
+
+    memset(count, 0, sizeof(count));
+    for (i = 0, pos = b->bgn; i < b->len; i++) {
+        count[b->ptr[pos]]++;
+        if (++pos == b->cap) {
+            pos = 0;
+        }
+    }
+
+    for (v = 0, pos = b->bgn; v < 256; v++) {
+        for (i = count[v]; i > 0; i--) {
+            b->ptr[pos] = v;
+            if (++pos == b->cap) {
+                pos = 0;
+            }
+        }
+    }
+
+    return p;
+}
+
+/* In place, data not moved to be contiguous. NULL if shared */
+void *cupkee_buffer_reverse(void *p)
+{
+    cupkee_buffer_t *b = (cupkee_buffer_t *)p;
+    int head = b->bgn;
+    int tail = buffer_pos(b, b->len - 1);
+    int i;
+
+    if (buffer_is_shared(b)) {
+        return NULL;
+    }
+    if (!b->len) {
+        return p;
+    }
+
+    // Contiguous data, word at a time
+    if (b->bgn + b->len <= b->cap) {
+        buffer_mem_reverse(b->ptr + b->bgn, b->ptr + b->bgn + b->len);
+        return p;
+    }
+
+    for (i = b->len / 2; i > 0; i--) {
+        uint8_t t = b->ptr[head];
+
+        b->ptr[head] = b->ptr[tail];
+        b->ptr[tail] = t;
+
+        if (++head == b->cap) {
+            head = 0;
+        }
+        if (--tail < 0) {
+            tail = b->cap - 1;
+        }
+    }
+
+    return p;
+}
+
+int cupkee_buffer_read_le(void *b, int offset, int size, int n, void *buf)
+{
+    return buffer_read_array(b, offset, size, n, buf, 0);
+}
+
+int cupkee_buffer_read_be(void *b, int offset, int size, int n, void *buf)
+{
+    return buffer_read_array(b, offset, size, n, buf, 1);
+}
+
+int cupkee_buffer_read_int8(void *b, int offset, int8_t *i)
+{
+    return buffer_read_array(b, offset, 1, 1, i, 0);
+}
+
+int cupkee_buffer_read_uint8(void *b, int offset, uint8_t *u)
+{
+    return buffer_read_array(b, offset, 1, 1, u, 0);
+}
+
+int cupkee_buffer_read_int16_le(void *b, int offset, int16_t *i)
+{
+    return buffer_read_array(b, offset, 2, 1, i, 0) * 2;
+}
+
+int cupkee_buffer_read_int16_be(void *b, int offset, int16_t *i)
+{
+    return buffer_read_array(b, offset, 2, 1, i, 1) * 2;
+}
+
+int cupkee_buffer_read_uint16_le(void *b, int offset, uint16_t *u)
+{
+    return buffer_read_array(b, offset, 2, 1, u, 0) * 2;
+}
+
+int cupkee_buffer_read_uint16_be(void *b, int offset, uint16_t *u)
+{
+    return buffer_read_array(b, offset, 2, 1, u, 1) * 2;
+}
+
+int cupkee_buffer_read_int32_le(void *b, int offset, int32_t *i)
+{
+    return buffer_read_array(b, offset, 4, 1, i, 0) * 4;
+}
+
+int cupkee_buffer_read_int32_be(void *b, int offset, int32_t *i)
+{
+    return buffer_read_array(b, offset, 4, 1, i, 1) * 4;
+}
+
+int cupkee_buffer_read_uint32_le(void *b, int offset, uint32_t *u)
+{
+    return buffer_read_array(b, offset, 4, 1, u, 0) * 4;
+}
+
+int cupkee_buffer_read_uint32_be(void *b, int offset, uint32_t *u)
+{
+    return buffer_read_array(b, offset, 4, 1, u, 1) * 4;
+}
+
+int cupkee_buffer_read_float_le(void *b, int offset, float *f)
+{
+    return buffer_read_array(b, offset, 4, 1, f, 0) * 4;
+}
+
+int cupkee_buffer_read_float_be(void *b, int offset, float *f)
+{
+    return buffer_read_array(b, offset, 4, 1, f, 1) * 4;
+}
+
+int cupkee_buffer_read_double_le(void *b, int offset, double *d)
+{
+    return buffer_read_array(b, offset, 8, 1, d, 0) * 8;
+}
+
+int cupkee_buffer_read_double_be(void *b, int offset, double *d)
+{
+    return buffer_read_array(b, offset, 8, 1, d, 1) * 8;
+}
+
+/*
+ * Chained buffer
+ *
+ * Segments are blocks of CUPKEE_CHAIN_SEG_SIZE bytes. New segment put in
+ * front keep its data at the end, leave room for more header ahead.
+ */
+struct cupkee_chain_seg_t {
+    cupkee_chain_seg_t *next;
+    uint16_t bgn;
+    uint16_t len;
+    uint8_t  ptr[0];
+};
+
+#define CHAIN_SEG_ROOM  (CUPKEE_CHAIN_SEG_SIZE - sizeof(cupkee_chain_seg_t))
+
+static cupkee_chain_seg_t *chain_seg_alloc(size_t bgn)
+{
+    cupkee_chain_seg_t *seg = cupkee_malloc(CUPKEE_CHAIN_SEG_SIZE);
+
+    if (seg) {
+        seg->next = NULL;
+        seg->bgn = bgn;
+        seg->len = 0;
+    }
+    return seg;
+}
+
+void cupkee_chain_init(cupkee_chain_t *c)
+{
+    c->head = NULL;
+    c->tail = NULL;
+    c->len = 0;
+}
+
+void cupkee_chain_release(cupkee_chain_t *c)
+{
+    while (c->head) {
+        cupkee_chain_seg_t *seg = c->head;
+
+        c->head = seg->next;
+        cupkee_free(seg);
+    }
+    c->tail = NULL;
+    c->len = 0;
+}
+
+size_t cupkee_chain_length(cupkee_chain_t *c)
+{
+    return c->len;
+}
+
+/* Return bytes appended, less than n if memory run out */
+int cupkee_chain_append(cupkee_chain_t *c, size_t n, const void *data)
+{
+    const uint8_t *src = data;
+    size_t cnt = 0;
+
+    while (cnt < n) {
+        cupkee_chain_seg_t *seg = c->tail;
+        size_t room = seg ? CHAIN_SEG_ROOM - seg->bgn - seg->len : 0;
+
+        if (!room) {
+            if (!(seg = chain_seg_alloc(0))) {
+                break;
+            }
+            if (c->tail) {
+                c->tail->next = seg;
+            } else {
+                c->head = seg;
+            }
+            c->tail = seg;
+            room = CHAIN_SEG_ROOM;
+        }
+
+        if (room > n - cnt) {
+            room = n - cnt;
+        }
+        memcpy(seg->ptr + seg->bgn + seg->len, src + cnt, room);
+        seg->len += room;
+        cnt += room;
+    }
+    c->len += cnt;
+
+    return (cnt || !n) ? (int)cnt : -CUPKEE_ENOMEM;
+}
+
+/* Put header ahead of data, all or nothing */
+int cupkee_chain_prepend(cupkee_chain_t *c, size_t n, const void *data)
+{
+    cupkee_chain_seg_t *seg = c->head;
+
+    if (n > CHAIN_SEG_ROOM) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!seg || seg->bgn < n) {
+        if (!(seg = chain_seg_alloc(CHAIN_SEG_ROOM))) {
+            return -CUPKEE_ENOMEM;
+        }
+        seg->next = c->head;
+        if (!c->head) {
+            c->tail = seg;
+        }
+        c->head = seg;
+    }
+
+    seg->bgn -= n;
+    seg->len += n;
+    memcpy(seg->ptr + seg->bgn, data, n);
+    c->len += n;
+
+    return n;
+}
+
+/* Move data from offset 'at' to rest, only the segment cut through is copied */
+int cupkee_chain_split(cupkee_chain_t *c, size_t at, cupkee_chain_t *rest)
+{
+    cupkee_chain_seg_t *seg, *prev = NULL;
+    size_t off = 0;
+
+    cupkee_chain_init(rest);
+    if (at >= c->len) {
+        return 0;
+    }
+
+    for (seg = c->head; off + seg->len <= at; seg = seg->next) {
+        off += seg->len;
+        prev = seg;
+    }
+
+    if (off < at) {
+        size_t keep = at - off;
+        cupkee_chain_seg_t *cut = chain_seg_alloc(0);
+
+        if (!cut) {
+            return -CUPKEE_ENOMEM;
+        }
+        cut->len = seg->len - keep;
+        memcpy(cut->ptr, seg->ptr + seg->bgn + keep, cut->len);
+        cut->next = seg->next;
+        seg->len = keep;
+        seg->next = NULL;
+
+        rest->head = cut;
+        rest->tail = c->tail == seg ? cut : c->tail;
+        c->tail = seg;
+    } else {
+        rest->head = seg;
+        rest->tail = c->tail;
+        c->tail = prev;
+        if (prev) {
+            prev->next = NULL;
+        } else {
+            c->head = NULL;
+        }
+    }
+
+    rest->len = c->len - at;
+    c->len = at;
+
+    return 0;
+}
+
+/* Copy out n bytes from offset, data kept */
+int cupkee_chain_gather(cupkee_chain_t *c, size_t off, size_t n, void *buf)
+{
+    cupkee_chain_seg_t *seg = c->head;
+    uint8_t *dst = buf;
+    size_t cnt = 0;
+
+    while (seg && off >= seg->len) {
+        off -= seg->len;
+        seg = seg->next;
+    }
+
+    for (; seg && cnt < n; seg = seg->next, off = 0) {
+        size_t size = seg->len - off;
+
+        if (size > n - cnt) {
+            size = n - cnt;
+        }
+        memcpy(dst + cnt, seg->ptr + seg->bgn + off, size);
+        cnt += size;
+    }
+
+    return cnt;
+}
+
+int cupkee_chain_consume(cupkee_chain_t *c, size_t n)
+{
+    size_t cnt = 0;
+
+    while (c->head && cnt < n) {
+        cupkee_chain_seg_t *seg = c->head;
+
+        if (seg->len > n - cnt) {
+            seg->bgn += n - cnt;
+            seg->len -= n - cnt;
+            cnt = n;
+        } else {
+            cnt += seg->len;
+            c->head = seg->next;
+            cupkee_free(seg);
+        }
+    }
+
+    if (!c->head) {
+        c->tail = NULL;
+    }
+    c->len -= cnt;
+
+    return cnt;
+}
+
+/* Segments as io vector, return number of vector filled */
+int cupkee_chain_iov(cupkee_chain_t *c, cupkee_iovec_t *iov, int max)
+{
+    cupkee_chain_seg_t *seg;
+    int i = 0;
+
+    for (seg = c->head; seg && i < max; seg = seg->next) {
+        if (seg->len) {
+            iov[i].ptr = seg->ptr + seg->bgn;
+            iov[i].len = seg->len;
+            i++;
+        }
+    }
+
+    return i;
+}
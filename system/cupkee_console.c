@@ -134,6 +134,9 @@ static int console_input_parse(const char *input, int end, int *ppos, int *pch)
             if (pos == end) {
                 type = CON_CTRL_ESCAPE;
             } else
+            if (pos + 1 == end) {
+                // Incomplete sequence
+            } else
             if (input[pos] == 91) {
                 key = input[pos + 1];
                 if (key == 65) {
@@ -164,7 +167,8 @@ static int console_input_parse(const char *input, int end, int *ppos, int *pch)
                     type = CON_CTRL_F4;
                 }
             }
-            pos = end; // Skip all left input
+            // Skip the sequence only, input may come in a long run
+            pos = pos + 2 < end ? pos + 2 : end;
         }
     }
     *ppos = pos;
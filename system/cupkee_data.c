@@ -61,15 +61,12 @@ static int cupkee_data_shift_number(cupkee_data_entry_t *entry, cupkee_data_t *a
             uint64_t u;
             double   d;
         } x;
+        int i;
 
-        x.u = ptr[0] * 0x100000000000000 +
-              ptr[1] * 0x1000000000000 +
-              ptr[2] * 0x10000000000 +
-              ptr[3] * 0x100000000 +
-              ptr[4] * 0x1000000 +
-              ptr[5] * 0x10000 +
-              ptr[6] * 0x100+
-              ptr[7];
+        // Byte by byte in 64 bits, int arithmetic overflow above 0x7f
+        for (x.u = 0, i = 0; i < 8; i++) {
+            x.u = (x.u << 8) | ptr[i];
+        }
 
         av->number = x.d;
         entry->pos = pos + 8;
@@ -79,9 +76,66 @@ static int cupkee_data_shift_number(cupkee_data_entry_t *entry, cupkee_data_t *a
     return CUPKEE_DATA_NONE;
 }
 
+static int cupkee_data_shift_fixed(cupkee_data_entry_t *entry, cupkee_data_t *av, int size)
+{
+    uint8_t pos = entry->pos + 1;
+    uint8_t *ptr = entry->data + pos;
+    uint32_t u = 0;
+    int i;
+
+    if (pos + size > entry->end) {
+        return CUPKEE_DATA_NONE;
+    }
+
+    for (i = 0; i < size; i++) {
+        u = (u << 8) | ptr[i];
+    }
+
+    switch (entry->data[entry->pos]) {
+    case CUPKEE_DATA_INT8:  av->number = (int8_t) u; break;
+    case CUPKEE_DATA_INT16: av->number = (int16_t) u; break;
+    case CUPKEE_DATA_INT32: av->number = (int32_t) u; break;
+    default: {
+            union {
+                uint32_t u;
+                float    f;
+            } x;
+
+            x.u = u;
+            av->number = x.f;
+        }
+    }
+
+    entry->pos = pos + size;
+    return CUPKEE_DATA_NUMBER;
+}
+
+static int cupkee_data_shift_varint(cupkee_data_entry_t *entry, cupkee_data_t *av)
+{
+    uint8_t pos = entry->pos + 1;
+    uint8_t end = entry->end;
+    uint64_t u = 0;
+    int shift;
+
+    for (shift = 0; pos < end && shift < 64; shift += 7) {
+        uint8_t b = entry->data[pos++];
+
+        u |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            int64_t i = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+
+            av->number = i;
+            entry->pos = pos;
+            return CUPKEE_DATA_NUMBER;
+        }
+    }
+
+    return CUPKEE_DATA_NONE;
+}
+
 int cupkee_data_shift(cupkee_data_entry_t *entry, cupkee_data_t *av)
 {
-    if (!entry || !av) {
+    if (!entry || !av || entry->pos >= entry->end) {
         return CUPKEE_DATA_NONE;
     }
 
@@ -89,7 +143,92 @@ int cupkee_data_shift(cupkee_data_entry_t *entry, cupkee_data_t *av)
     case CUPKEE_DATA_BOOLEAN: return cupkee_data_shift_boolean(entry, av);
     case CUPKEE_DATA_NUMBER:  return cupkee_data_shift_number(entry, av);
     case CUPKEE_DATA_STRING:  return cupkee_data_shift_string(entry, av);
+    case CUPKEE_DATA_INT8:    return cupkee_data_shift_fixed(entry, av, 1);
+    case CUPKEE_DATA_INT16:   return cupkee_data_shift_fixed(entry, av, 2);
+    case CUPKEE_DATA_INT32:   return cupkee_data_shift_fixed(entry, av, 4);
+    case CUPKEE_DATA_FLOAT:   return cupkee_data_shift_fixed(entry, av, 4);
+    case CUPKEE_DATA_VARINT:  return cupkee_data_shift_varint(entry, av);
     default: return CUPKEE_DATA_NONE;
     }
 }
 
+static int cupkee_data_put_fixed(uint8_t *buf, uint8_t type, uint64_t u, int size)
+{
+    int i;
+
+    buf[0] = type;
+    for (i = size; i > 0; i--) {
+        buf[i] = (uint8_t) u;
+        u >>= 8;
+    }
+
+    return size + 1;
+}
+
+static int cupkee_data_varint_size(uint64_t u)
+{
+    int n = 1;
+
+    while (u >= 0x80) {
+        u >>= 7;
+        n++;
+    }
+    return n;
+}
+
+/* Encode number in the shortest form keep its value,
+ * buf should have CUPKEE_DATA_NUMBER_MAX bytes at least, return bytes used.
+ */
+int cupkee_data_put_number(uint8_t *buf, double v)
+{
+    union {
+        uint64_t u;
+        double   d;
+    } x;
+    union {
+        uint32_t u;
+        float    f;
+    } y;
+
+    x.d = v;
+
+    // Range checked first, out of range conversion is undefined; -0 keep its sign
+    if (v > -9.2e18 && v < 9.2e18 && v == (double)(int64_t) v && x.u != 0x8000000000000000ULL) {
+        int64_t  i = (int64_t) v;
+        uint64_t z = ((uint64_t) i << 1) ^ (uint64_t)(i >> 63);
+        int size = i >= INT8_MIN  && i <= INT8_MAX  ? 1 :
+                   i >= INT16_MIN && i <= INT16_MAX ? 2 :
+                   i >= INT32_MIN && i <= INT32_MAX ? 4 : 8;
+        int n = cupkee_data_varint_size(z);
+
+        if (n < size) {
+            int pos = 1;
+
+            buf[0] = CUPKEE_DATA_VARINT;
+            while (z >= 0x80) {
+                buf[pos++] = (uint8_t) z | 0x80;
+                z >>= 7;
+            }
+            buf[pos++] = (uint8_t) z;
+            return pos;
+        }
+
+        if (size == 1) {
+            return cupkee_data_put_fixed(buf, CUPKEE_DATA_INT8, i, 1);
+        } else
+        if (size == 2) {
+            return cupkee_data_put_fixed(buf, CUPKEE_DATA_INT16, i, 2);
+        } else
+        if (size == 4) {
+            return cupkee_data_put_fixed(buf, CUPKEE_DATA_INT32, i, 4);
+        }
+    }
+
+    y.f = (float) v;
+    if ((double) y.f == v) {
+        return cupkee_data_put_fixed(buf, CUPKEE_DATA_FLOAT, y.u, 4);
+    }
+
+    return cupkee_data_put_fixed(buf, CUPKEE_DATA_NUMBER, x.u, 8);
+}
+
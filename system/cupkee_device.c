@@ -20,11 +20,25 @@
 #include "cupkee.h"
 #include "cupkee_shell_device.h"
 
+typedef struct device_query_t {
+    list_head_t list;
+
+    void *req;
+    void *res;
+    int   want;
+    int   error;
+
+    cupkee_callback_t cb;
+    intptr_t          param;
+} device_query_t;
+
 static uint8_t device_tag = 0xff;
 static uint8_t device_type_num = 0;
 
 static cupkee_device_desc_t const *device_descs[CUPKEE_DEVICE_TYPE_MAX];
 static cupkee_device_t      *device_work = NULL;
+static cupkee_device_t      *device_poll = NULL;
+static volatile uint8_t      device_ready = 0;
 
 static inline int is_device(void *entry) {
     return entry && (CUPKEE_OBJECT_PTR(entry)->tag == device_tag);
@@ -68,6 +82,47 @@ static void device_drop_work_list(cupkee_device_t *device)
     device->next = NULL;
 }
 
+static int device_poll_is_joined(cupkee_device_t *device)
+{
+    cupkee_device_t *cur = device_poll;
+
+    while (cur) {
+        if (cur == device) {
+            return 1;
+        }
+        cur = cur->poll_next;
+    }
+    return 0;
+}
+
+static void device_join_poll_list(cupkee_device_t *device)
+{
+    if (!device_poll_is_joined(device)) {
+        device->poll_next = device_poll;
+        device_poll = device;
+    }
+}
+
+static void device_drop_poll_list(cupkee_device_t *device)
+{
+    cupkee_device_t **pp = &device_poll;
+
+    while (*pp) {
+        if (*pp == device) {
+            *pp = device->poll_next;
+            break;
+        }
+        pp = &(*pp)->poll_next;
+    }
+    device->poll_next = NULL;
+}
+
+static void device_poll_one(cupkee_device_t *dev, uint32_t systicks)
+{
+    dev->poll_stamp = systicks;
+    dev->driver->poll(dev->instance);
+}
+
 static int device_type(const char *name)
 {
     int i;
@@ -80,17 +135,94 @@ static int device_type(const char *name)
     return -1;
 }
 
+static void device_query_release(cupkee_device_t *dev, device_query_t *q)
+{
+    if (q->req) {
+        cupkee_buffer_release(q->req);
+    }
+    if (q->res) {
+        cupkee_buffer_release(q->res);
+    }
+    cupkee_free(q);
+    dev->query_num--;
+}
+
+/* Response buffer is movable while query waiting or done, and locked when
+ * driver is filling it.
+ */
+static void device_response_hold(cupkee_device_t *dev, device_query_t *q)
+{
+    if ((dev->res = q->res) != NULL) {
+        cupkee_buffer_ref(dev->res, &dev->res);
+        cupkee_buffer_lock(dev->res);
+        q->res = NULL;
+    }
+}
+
+static void device_response_back(cupkee_device_t *dev, device_query_t *q)
+{
+    if ((q->res = dev->res) != NULL) {
+        cupkee_buffer_unlock(q->res);
+        cupkee_buffer_ref(q->res, &q->res);
+        dev->res = NULL;
+    }
+}
+
+static void device_response_dispatch(cupkee_device_t *dev);
+
+/* Abort all queries, callbacks are invoked with the error and no response */
+static void device_query_flush(cupkee_device_t *dev, int error)
+{
+    if (dev->query) {
+        device_query_t *q = dev->query;
+
+        q->req = dev->req;
+        device_response_back(dev, q);
+        dev->req = NULL;
+        dev->query = NULL;
+        list_add(&q->list, &dev->query_wait);
+    }
+    dev->flags &= ~DEVICE_FL_BUSY;
+
+    while (!list_is_empty(&dev->query_wait)) {
+        device_query_t *q = CUPKEE_CONTAINER_OF(dev->query_wait.next, device_query_t, list);
+
+        if (q->res) {
+            cupkee_buffer_release(q->res);
+            q->res = NULL;
+        }
+        q->error = error;
+
+        list_del(&q->list);
+        list_add_tail(&q->list, &dev->query_done);
+    }
+
+    device_response_dispatch(dev);
+}
+
+static void device_stream_conf_reset(cupkee_device_t *dev)
+{
+    dev->rx_size = CUPKEE_STREAM_BUF_SIZE;
+    dev->tx_size = CUPKEE_STREAM_BUF_SIZE;
+    dev->rx_watermark = 0;
+    dev->rx_idle = CUPKEE_STREAM_IDLE_TICKS;
+    dev->adaptive = 0;
+}
+
 static void device_reset(cupkee_device_t *dev)
 {
     const cupkee_device_desc_t *desc = device_descs[dev->type];
     dev->driver->reset(dev->instance);
 
     device_drop_work_list(dev);
+    device_drop_poll_list(dev);
+    device_query_flush(dev, -CUPKEE_ENOTENABLED);
     dev->flags = 0;
 
     if (dev->conf && desc->conf_init) {
         desc->conf_init(dev->conf);
     }
+    device_stream_conf_reset(dev);
 
     if (dev->s) {
         cupkee_stream_deinit(dev->s);
@@ -129,12 +261,23 @@ static cupkee_device_t *device_request(int type, int instance)
     }
 
     dev->s    = NULL;
+    device_stream_conf_reset(dev);
+
+    dev->poll_next = NULL;
+    dev->poll_interval = CUPKEE_DEVICE_POLL_NONE;
+    dev->poll_stamp = 0;
+    dev->poll_ready = 0;
 
     dev->handle = NULL;
     dev->handle_param = 0;
 
     dev->req = dev->res = NULL;
 
+    dev->query = NULL;
+    dev->query_num = 0;
+    list_head_init(&dev->query_wait);
+    list_head_init(&dev->query_done);
+
     return dev;
 }
 
@@ -187,58 +330,120 @@ static void device_stream_init(cupkee_device_t *dev, int id)
     size_t rx_size, tx_size;
     cupkee_stream_t *s;
 
-    if (dev->driver->read) {
-        // todo: get from conf
-        rx_size = 24;
-    } else {
-        rx_size = 0;
-    }
-
-    if (dev->driver->write) {
-        tx_size = 24;
-    } else {
-        tx_size = 0;
-    }
+    rx_size = dev->driver->read  ? dev->rx_size : 0;
+    tx_size = dev->driver->write ? dev->tx_size : 0;
 
     s = cupkee_malloc(sizeof(cupkee_stream_t));
     if (s) {
         if (0 != cupkee_stream_init(s, id, rx_size, tx_size, device_read, device_write)) {
             cupkee_free(s);
         } else {
+            cupkee_stream_set_watermark(s, dev->rx_watermark, dev->rx_idle);
+            cupkee_stream_set_adaptive(s, dev->adaptive);
             dev->s = s;
         }
     }
 }
 
+static void device_query_complete(cupkee_device_t *dev, int error)
+{
+    device_query_t *q = dev->query;
+
+    q->req = dev->req;
+    device_response_back(dev, q);
+    q->error = error;
+    dev->req = NULL;
+    dev->query = NULL;
+    dev->flags &= ~DEVICE_FL_BUSY;
+
+    list_add_tail(&q->list, &dev->query_done);
+    cupkee_object_event_post(CUPKEE_ENTRY_ID(dev), CUPKEE_EVENT_RESPONSE);
+}
+
+/*
+ * Start queued queries, until the driver is busy with one.
+ * A query may complete while driver->query is running (response_end called
+ * from inside), the loop pick the next one instead of recursion.
+ */
+static int device_query_next(cupkee_device_t *dev)
+{
+    int err = 0;
+
+    while (!(dev->flags & (DEVICE_FL_BUSY | DEVICE_FL_STARTING)) && !list_is_empty(&dev->query_wait)) {
+        device_query_t *q = CUPKEE_CONTAINER_OF(dev->query_wait.next, device_query_t, list);
+
+        list_del(&q->list);
+
+        dev->query = q;
+        dev->req = q->req;
+        q->req = NULL;
+
+        // Response buffer may be reclaimed while waiting
+        if (q->want > 0 && !q->res && !(q->res = cupkee_buffer_alloc_movable(q->want))) {
+            device_query_complete(dev, -CUPKEE_ENOMEM);
+            continue;
+        }
+        device_response_hold(dev, q);
+
+        dev->flags |= DEVICE_FL_BUSY | DEVICE_FL_STARTING;
+        err = dev->driver->query(dev->instance, q->want);
+        dev->flags &= ~DEVICE_FL_STARTING;
+
+        if (err < 0 && dev->query == q) {
+            device_query_complete(dev, err);
+        }
+    }
+
+    return err;
+}
+
 static int device_query_start(cupkee_device_t *dev, void *req, int want, cupkee_callback_t cb, intptr_t param)
 {
+    device_query_t *q;
     int err;
 
-    if (dev->flags & DEVICE_FL_BUSY) {
+    if (dev->query_num >= CUPKEE_DEVICE_QUERY_MAX) {
         return -CUPKEE_EBUSY;
     }
 
+    if (!(q = cupkee_malloc(sizeof(device_query_t)))) {
+        return -CUPKEE_ENOMEM;
+    }
+
     if (want <= 0) {
-        dev->res = NULL;
+        q->res = NULL;
     } else
-    if (!(dev->res = cupkee_buffer_alloc(want))) {
+    if (!(q->res = cupkee_buffer_alloc_movable(want))) {
+        cupkee_free(q);
         return -CUPKEE_ENOMEM;
+    } else {
+        cupkee_buffer_ref(q->res, &q->res);
     }
 
-    dev->handle = cb;
-    dev->handle_param = param;
+    q->req = req;
+    q->want = want;
+    q->error = 0;
+    q->cb = cb;
+    q->param = param;
+
+    list_add_tail(&q->list, &dev->query_wait);
+    dev->query_num++;
 
-    dev->req = req;
-    dev->flags |= DEVICE_FL_BUSY;
+    if (dev->flags & DEVICE_FL_BUSY) {
+        // Start later, from response end
+        return 0;
+    }
 
-    err = dev->driver->query(dev->instance, want);
+    err = device_query_next(dev);
     if (err < 0) {
-        if (dev->res) {
-            cupkee_buffer_release(dev->res);
-            dev->res = NULL;
+        // Fail to start immediately: caller keep the request
+        device_query_t *done = CUPKEE_CONTAINER_OF(dev->query_done.prev, device_query_t, list);
+
+        if (done == q) {
+            list_del(&q->list);
+            q->req = NULL;
+            device_query_release(dev, q);
         }
-        dev->req = NULL;
-        dev->flags &= ~DEVICE_FL_BUSY;
     }
 
     return err;
@@ -253,24 +458,34 @@ static void device_error_handle(void *entry, int error)
     }
 }
 
+static void device_response_dispatch(cupkee_device_t *dev)
+{
+    // Response of the head query is available by cupkee_device_response_take in callback
+    while (!list_is_empty(&dev->query_done)) {
+        device_query_t *q = CUPKEE_CONTAINER_OF(dev->query_done.next, device_query_t, list);
+
+        if (q->cb) {
+            if (q->error) {
+                dev->error = -q->error;
+            }
+            q->cb(dev, CUPKEE_EVENT_RESPONSE, q->param);
+        }
+        list_del(&q->list);
+        device_query_release(dev, q);
+    }
+}
+
 static void device_event_handle(void *entry, uint8_t event)
 {
     cupkee_device_t *dev = entry;
 
     if (is_device(dev)) {
+        if (event == CUPKEE_EVENT_RESPONSE) {
+            device_response_dispatch(dev);
+        } else
         if (dev->handle) {
             dev->handle(entry, event, dev->handle_param);
         }
-        if (event == CUPKEE_EVENT_RESPONSE) {
-            if (dev->res) {
-                cupkee_buffer_release(dev->res);
-            }
-            if (dev->req) {
-                cupkee_buffer_release(dev->req);
-            }
-
-            dev->flags &= ~DEVICE_FL_BUSY;
-        }
     }
 }
 
@@ -369,6 +584,84 @@ static int device_conf_set(cupkee_device_t *dev, const char *k, int t, intptr_t
     return retval;
 }
 
+static int device_stream_conf_get(cupkee_device_t *dev, const char *k, intptr_t *p)
+{
+    cupkee_stream_t *s = dev->s;
+
+    if (!strcmp("rxBufSize", k)) {
+        *p = s ? s->rx_buf_size : dev->rx_size;
+    } else
+    if (!strcmp("txBufSize", k)) {
+        *p = s ? s->tx_buf_size : dev->tx_size;
+    } else
+    if (!strcmp("rxWatermark", k)) {
+        *p = dev->rx_watermark;
+    } else
+    if (!strcmp("rxIdle", k)) {
+        *p = dev->rx_idle;
+    } else
+    if (!strcmp("adaptive", k)) {
+        *p = dev->adaptive;
+        return CUPKEE_OBJECT_ELEM_BOOL;
+    } else {
+        return CUPKEE_OBJECT_ELEM_NV;
+    }
+
+    return CUPKEE_OBJECT_ELEM_INT;
+}
+
+static int device_stream_conf_set(cupkee_device_t *dev, const char *k, int t, intptr_t v)
+{
+    if (device_is_enabled(dev)) {
+        return 0;
+    }
+
+    if (t != CUPKEE_OBJECT_ELEM_INT && t != CUPKEE_OBJECT_ELEM_BOOL) {
+        return 0;
+    }
+
+    if (!strcmp("adaptive", k)) {
+        dev->adaptive = v ? 1 : 0;
+        return 1;
+    }
+
+    // Idle time in systicks, not a size
+    if (!strcmp("rxIdle", k)) {
+        if (v < 0 || v > 0xffff) {
+            return -CUPKEE_EINVAL;
+        }
+        dev->rx_idle = v;
+        return 1;
+    }
+
+    if (v < 0 || v > CUPKEE_STREAM_BUF_MAX) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!strcmp("rxBufSize", k)) {
+        if (v == 0 || v < dev->rx_watermark) {
+            return -CUPKEE_EINVAL;
+        }
+        dev->rx_size = v;
+    } else
+    if (!strcmp("txBufSize", k)) {
+        if (v == 0) {
+            return -CUPKEE_EINVAL;
+        }
+        dev->tx_size = v;
+    } else
+    if (!strcmp("rxWatermark", k)) {
+        if (v > dev->rx_size) {
+            return -CUPKEE_EINVAL;
+        }
+        dev->rx_watermark = v;
+    } else {
+        return 0;
+    }
+
+    return 1;
+}
+
 static int device_prop_get(void *entry, const char *key, intptr_t *p)
 {
     int retval;
@@ -382,6 +675,8 @@ static int device_prop_get(void *entry, const char *key, intptr_t *p)
         if (!strcmp("isEnabled", key)) {
             *p = device_is_enabled(entry);
             retval = CUPKEE_OBJECT_ELEM_BOOL;
+        } else {
+            retval = device_stream_conf_get(entry, key, p);
         }
     }
 
@@ -398,7 +693,7 @@ static int device_prop_set(void *entry, const char *k, int t, intptr_t v)
 
     retval = device_conf_set(entry, k, t, v);
     if (retval <= CUPKEE_OBJECT_ELEM_NV) {
-        // Nothing
+        retval = device_stream_conf_set(entry, k, t, v);
     }
 
     return retval;
@@ -451,6 +746,31 @@ static const cupkee_desc_t device_desc = {
     .destroy      = device_destroy,
 };
 
+/* Shrinker: release idle stream caches and buffers of waiting queries */
+static size_t device_shrink(size_t want)
+{
+    cupkee_device_t *dev;
+    size_t n = 0;
+
+    for (dev = device_work; dev && n < want; dev = dev->next) {
+        list_head_t *pos;
+
+        n += cupkee_stream_shrink(dev->s);
+
+        list_for_each(pos, &dev->query_wait) {
+            device_query_t *q = CUPKEE_CONTAINER_OF(pos, device_query_t, list);
+
+            if (q->res) {
+                n += cupkee_buffer_capacity(q->res);
+                cupkee_buffer_release(q->res);
+                q->res = NULL;
+            }
+        }
+    }
+
+    return n;
+}
+
 int cupkee_device_setup(void)
 {
     int tag = cupkee_object_register(sizeof(cupkee_device_t), &device_desc);
@@ -459,8 +779,18 @@ int cupkee_device_setup(void)
         return -1;
     }
 
+#if CUPKEE_DEVICE_CACHE_RESERVE > 0
+    if (cupkee_object_cache(tag, CUPKEE_DEVICE_CACHE_RESERVE) < 0) {
+        return -1;
+    }
+#endif
+
+    cupkee_memory_shrinker(device_shrink);
+
     device_tag  = tag;
     device_work = NULL;
+    device_poll = NULL;
+    device_ready = 0;
     device_type_num = 0;
 
     return 0;
@@ -503,16 +833,68 @@ void cupkee_device_sync(uint32_t systicks)
     }
 }
 
+uint32_t cupkee_device_next(uint32_t systicks)
+{
+    cupkee_device_t *dev;
+    uint32_t next = CUPKEE_TICKS_FOREVER;
+
+    if (device_ready) {
+        return 0;
+    }
+
+    for (dev = device_poll; dev; dev = dev->poll_next) {
+        uint32_t past = systicks - dev->poll_stamp;
+
+        if (past >= dev->poll_interval) {
+            // Device should be polled in next loop
+            return 0;
+        }
+
+        if (dev->poll_interval - past < next) {
+            next = dev->poll_interval - past;
+        }
+    }
+
+    for (dev = device_work; dev; dev = dev->next) {
+        if (dev->s) {
+            uint32_t wait = cupkee_stream_sync_wait(dev->s, systicks);
+
+            if (wait < next) {
+                next = wait;
+            }
+        }
+    }
+
+    return next;
+}
+
 void cupkee_device_poll(void)
 {
-    cupkee_device_t *dev = device_work;
+    cupkee_device_t *dev, *next;
+    uint32_t systicks = _cupkee_systicks;
 
     hw_poll();
-    while (dev) {
-        if (dev->driver->poll) {
-            dev->driver->poll(dev->instance);
+
+    // Devices marked ready from interrupt
+    if (device_ready) {
+        device_ready = 0;
+        for (dev = device_work; dev; dev = next) {
+            next = dev->next;
+            if (dev->poll_ready) {
+                dev->poll_ready = 0;
+                if (dev->driver->poll) {
+                    device_poll_one(dev, systicks);
+                }
+            }
+        }
+    }
+
+    // Devices need to be polled: always or periodically
+    for (dev = device_poll; dev; dev = next) {
+        next = dev->poll_next;
+        if (systicks - dev->poll_stamp >= dev->poll_interval) {
+            device_poll_one(dev, systicks);
         }
-        dev = dev->next;
     }
 }
 
@@ -596,8 +978,16 @@ int cupkee_device_enable(void *entry)
         return -CUPKEE_EBUSY;
     }
 
+    // Driver with poll is polled always, until it tell another way in setup
+    if (dev->driver->poll) {
+        dev->poll_interval = CUPKEE_DEVICE_POLL_ALWAYS;
+        dev->poll_stamp = _cupkee_systicks;
+        device_join_poll_list(dev);
+    }
+
     err = dev->driver->setup(dev->instance, entry);
     if (err) {
+        device_drop_poll_list(dev);
         return err;
     }
 
@@ -641,6 +1031,46 @@ int cupkee_device_is_enabled(void *entry)
     return device_is_enabled(dev);
 }
 
+/*
+ * Declare how the device should be polled:
+ *  CUPKEE_DEVICE_POLL_ALWAYS: in every loop
+ *  CUPKEE_DEVICE_POLL_NONE  : only after cupkee_device_ready
+ *  others                   : every interval ticks
+ */
+int cupkee_device_poll_set(void *entry, uint32_t interval)
+{
+    cupkee_device_t *dev = entry;
+
+    if (!is_device(entry)) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!dev->driver->poll) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+
+    dev->poll_interval = interval;
+    if (interval == CUPKEE_DEVICE_POLL_NONE) {
+        device_drop_poll_list(dev);
+    } else {
+        dev->poll_stamp = _cupkee_systicks;
+        device_join_poll_list(dev);
+    }
+
+    return 0;
+}
+
+/* Mark device has work to do, it will be polled in next loop. Interrupt safe */
+void cupkee_device_ready(void *entry)
+{
+    cupkee_device_t *dev = entry;
+
+    if (dev) {
+        dev->poll_ready = 1;
+        device_ready = 1;
+    }
+}
+
 void *cupkee_device_request_take(void *entry)
 {
     cupkee_device_t *dev = entry;
@@ -666,10 +1096,14 @@ void *cupkee_device_response_take(void *entry)
         return NULL;
     }
 
-    if (device_is_enabled(dev)) {
-        void *res = dev->res;
+    if (!list_is_empty(&dev->query_done)) {
+        device_query_t *q = CUPKEE_CONTAINER_OF(dev->query_done.next, device_query_t, list);
+        void *res = q->res;
 
-        dev->res = NULL;
+        q->res = NULL;
+        if (res) {
+            cupkee_buffer_ref(res, NULL);
+        }
         return res;
     } else {
         return NULL;
@@ -752,8 +1186,9 @@ void cupkee_device_response_end(void *entry)
     cupkee_device_t *dev = entry;
 
     if (is_device(entry)) {
-        if (device_is_enabled(dev) && (dev->flags & DEVICE_FL_BUSY)) {
-            cupkee_object_event_post(CUPKEE_ENTRY_ID(entry), CUPKEE_EVENT_RESPONSE);
+        if (device_is_enabled(dev) && (dev->flags & DEVICE_FL_BUSY) && dev->query) {
+            device_query_complete(dev, 0);
+            device_query_next(dev);
         }
     }
 }
@@ -837,3 +1272,118 @@ int cupkee_device_pull(void *entry, size_t n, void *buf)
     return cupkee_stream_pull(dev->s, n, buf);
 }
 
+int cupkee_device_push_reserve(void *entry, void **ptr)
+{
+    cupkee_device_t *dev = entry;
+
+    if (!is_device(entry)) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!dev->s) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+
+    return cupkee_stream_push_reserve(dev->s, ptr);
+}
+
+int cupkee_device_push_commit(void *entry, size_t n)
+{
+    cupkee_device_t *dev = entry;
+
+    if (!is_device(entry)) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!dev->s) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+
+    return cupkee_stream_push_commit(dev->s, n);
+}
+
+int cupkee_device_pull_reserve(void *entry, void **ptr)
+{
+    cupkee_device_t *dev = entry;
+
+    if (!is_device(entry)) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!dev->s) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+
+    return cupkee_stream_pull_reserve(dev->s, ptr);
+}
+
+int cupkee_device_pull_commit(void *entry, size_t n)
+{
+    cupkee_device_t *dev = entry;
+
+    if (!is_device(entry)) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!dev->s) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+
+    return cupkee_stream_pull_commit(dev->s, n);
+}
+
+int cupkee_device_push_buf(void *entry, void *buf)
+{
+    cupkee_device_t *dev = entry;
+
+    if (!is_device(entry)) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!dev->s) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+
+    return cupkee_stream_push_buf(dev->s, buf);
+}
+
+void *cupkee_device_pull_buf(void *entry)
+{
+    cupkee_device_t *dev = entry;
+
+    if (!is_device(entry) || !dev->s) {
+        return NULL;
+    }
+
+    return cupkee_stream_pull_buf(dev->s);
+}
+
+int cupkee_device_read_reserve(void *entry, void **ptr)
+{
+    cupkee_device_t *dev = entry;
+
+    if (!is_device(entry)) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!dev->s) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+
+    return cupkee_stream_read_reserve(dev->s, ptr);
+}
+
+int cupkee_device_read_commit(void *entry, size_t n)
+{
+    cupkee_device_t *dev = entry;
+
+    if (!is_device(entry)) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!dev->s) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+
+    return cupkee_stream_read_commit(dev->s, n);
+}
@@ -18,59 +18,162 @@
  **/
 
 #include "cupkee.h"
-#include "rbuff.h"
 
-#define EVENTQ_SIZE         16
-#define EMITTER_CODE_MAX    65535
-
-static rbuff_t eventq;
-static cupkee_event_t eventq_mem[EVENTQ_SIZE];
+/* Event queue
+ *******************************************************
+ * Bounded multi-producer single-consumer ring, which is
+ * posted by ISRs and taken by main loop, without masking
+ * interrupts. Each slot carry a sequence number:
+ *   seq == pos       : slot is free for the producer of pos
+ *   seq == pos + 1   : slot is filled, ready to be taken
+ ******************************************************/
+#define EVENTQ_SIZE         CUPKEE_EVENTQ_SIZE
+#define EVENTQ_MASK         (EVENTQ_SIZE - 1)
+
+#if (EVENTQ_SIZE & EVENTQ_MASK)
+#error "CUPKEE_EVENTQ_SIZE should be power of 2"
+#endif
+
+#define EVENT_LOAD(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define EVENT_STORE(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define EVENT_ADD(p, v)     __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define EVENT_XCHG(p, v)    __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+
+typedef struct eventq_slot_t {
+    uint32_t seq;
+    cupkee_event_t event;
+} eventq_slot_t;
+
+static eventq_slot_t eventq_mem[EVENTQ_SIZE];
+static uint32_t eventq_head;            // only used by consumer
+static uint32_t eventq_tail;            // claimed by producers
+static uint32_t eventq_high_water;
+static uint32_t eventq_drops[EVENT_TYPE_MAX + 1];
+static uint32_t eventq_systicks;        // ticks merged into the pending systick event
 
 void cupkee_event_setup(void)
 {
-    rbuff_init(&eventq, EVENTQ_SIZE);
+    cupkee_event_reset();
+    cupkee_event_stat_reset();
 }
 
 void cupkee_event_reset(void)
 {
-    rbuff_reset(&eventq);
+    uint32_t i;
+
+    for (i = 0; i < EVENTQ_SIZE; i++) {
+        eventq_mem[i].seq = i;
+    }
+    eventq_head = 0;
+    eventq_tail = 0;
+    eventq_systicks = 0;
 }
 
 int cupkee_event_post(uint8_t type, uint8_t code, uint16_t which)
 {
-    uint32_t state;
-    int pos;
+    uint32_t pos = EVENT_LOAD(&eventq_tail);
+    uint32_t used;
+    eventq_slot_t *slot;
+
+    while (1) {
+        int32_t dif;
+
+        slot = &eventq_mem[pos & EVENTQ_MASK];
+        dif = EVENT_LOAD(&slot->seq) - pos;
+
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&eventq_tail, &pos, pos + 1, 1,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            // pos is reloaded by compare_exchange failure
+        } else
+        if (dif < 0) {
+            // queue full
+            EVENT_ADD(&eventq_drops[type < EVENT_TYPE_MAX ? type : EVENT_TYPE_MAX], 1);
+            return 0;
+        } else {
+            pos = EVENT_LOAD(&eventq_tail);
+        }
+    }
 
-    hw_enter_critical(&state);
-    pos = rbuff_push(&eventq);
-    hw_exit_critical(state);
+    slot->event.type  = type;
+    slot->event.code  = code;
+    slot->event.which = which;
 
-    if (pos < 0) {
-        return 0;
+    // Publish the slot, after it is filled
+    EVENT_STORE(&slot->seq, pos + 1);
+
+    // Statistic only, race between producers is acceptable
+    used = pos + 1 - EVENT_LOAD(&eventq_head);
+    if (used > eventq_high_water) {
+        eventq_high_water = used;
     }
 
-    eventq_mem[pos].type  = type;
-    eventq_mem[pos].code  = code;
-    eventq_mem[pos].which = which;
+    return 1;
+}
+
+int cupkee_event_post_systick(void)
+{
+    // Only one systick event is keep in queue, others are merged into it
+    if (EVENT_ADD(&eventq_systicks, 1)) {
+        return 1;
+    }
 
+    if (!cupkee_event_post(EVENT_SYSTICK, 0, 0)) {
+        EVENT_STORE(&eventq_systicks, 0);
+        return 0;
+    }
     return 1;
 }
 
-int cupkee_event_take(cupkee_event_t *e)
+int cupkee_event_is_empty(void)
 {
-    uint32_t state;
-    int pos;
+    return EVENT_LOAD(&eventq_tail) == eventq_head;
+}
 
-    hw_enter_critical(&state);
-    pos = rbuff_shift(&eventq);
-    hw_exit_critical(state);
+int cupkee_event_take(cupkee_event_t *e)
+{
+    eventq_slot_t *slot = &eventq_mem[eventq_head & EVENTQ_MASK];
+    uint32_t pos = eventq_head;
 
-    if (pos < 0) {
+    if (EVENT_LOAD(&slot->seq) != pos + 1) {
+        // empty, or the producer have not filled it yet
         return 0;
     }
 
-    *e = eventq_mem[pos];
+    *e = slot->event;
+
+    // Release the slot for the producer of next round
+    EVENT_STORE(&slot->seq, pos + EVENTQ_SIZE);
+    eventq_head = pos + 1;
+
+    if (e->type == EVENT_SYSTICK) {
+        uint32_t ticks = EVENT_XCHG(&eventq_systicks, 0);
+
+        if (ticks) {
+            e->which = ticks > 0xFFFF ? 0xFFFF : ticks;
+        }
+    }
 
     return 1;
 }
 
+int cupkee_event_drops(int type)
+{
+    if (type < 0 || type > EVENT_TYPE_MAX) {
+        return 0;
+    }
+    return eventq_drops[type];
+}
+
+int cupkee_event_high_water(void)
+{
+    return eventq_high_water;
+}
+
+void cupkee_event_stat_reset(void)
+{
+    memset(eventq_drops, 0, sizeof(eventq_drops));
+    eventq_high_water = 0;
+}
@@ -25,25 +25,40 @@
  * | 7 | 6 | 5 | 4 | 3 | 2 | 1 | 0 |
  * +---+---+---+---+---+---+---+---+
  *   \   \   \   \   \   \   \___\____ ZONE_ID
- *    \   \   \   \___\___\___________ Reserved
- *     \   \   \______________________ Page is in MBCQ
- *      \   \_________________________ Page is in used
- *       \____________________________ Page is head of pages
+ *    \   \   \   \   \   \___________ Reserved
+ *     \   \   \   \   \______________ Page is head of span
+ *      \   \   \   \_________________ Page is in slab
+ *       \   \   \____________________ Page is in MBCQ
+ *        \   \_______________________ Page is in used
+ *         \__________________________ Page is head of pages
  ******************************************************/
 #define PAGE_HEAD       (0x80)
 #define PAGE_INUSED     (0x40)
 #define PAGE_MBCQ       (0x20)
+#define PAGE_SLAB       (0x10)
+#define PAGE_SPAN       (0x08)
 #define PAGE_ZONE_MASK  (0x03)
 
-/* Memory Block Cache queue */
-#define CUPKEE_MBCQ_MAX    (4)
-
+/* Memory Block Cache queue
+ *
+ * One slab per size class, every slab keep pages with free blocks in
+ * partial list and exhausted pages in full list, so that alloc and free
+ * never need to search. Page is given back to buddy as soon as its last
+ * block is freed, unless it is reserved by slab.
+ */
 #define MBLOCK_MAGIC    (0xF1)
-#define MBLOCK_SIZE(b)  (CUPKEE_MUNIT_SIZE << (b))
+
+#define MBLOCK_SLOT(s)  (((s) + CUPKEE_MUNIT_SIZE - 1) >> CUPKEE_MUNIT_SHIFT)
+
+static const uint16_t mblock_class[] = { CUPKEE_MBLOCK_CLASSES };
+
+#define CUPKEE_MBCQ_MAX     (sizeof(mblock_class) / sizeof(mblock_class[0]))
+#define MBLOCK_SLOT_MAX     MBLOCK_SLOT(CUPKEE_MBLOCK_SIZE_MAX)
 
 typedef struct cupkee_zone_t {
     intptr_t base;
     uint32_t page_num;
+    uint8_t  attr;
     list_head_t   pages_free[CUPKEE_PAGE_ORDERR_MAX];
     cupkee_page_t pages[0];
 } cupkee_zone_t;
@@ -53,10 +68,36 @@ typedef struct mblock_head_t {
     intptr_t comp;
 } mblock_head_t;
 
+/* Movable block head, ahead of user data */
+typedef struct movable_head_t {
+    list_head_t list;
+    void   **ref;
+    uint16_t size;
+    uint16_t lock;
+} movable_head_t;
+
 static uint8_t memory_zone_num = 0;
 
 static cupkee_zone_t *memory_zone[CUPKEE_ZONE_MAX];
-static list_head_t    memory_mbcq[CUPKEE_MBCQ_MAX];
+static cupkee_slab_t  memory_mbcq[CUPKEE_MBCQ_MAX];
+static uint8_t        memory_mbcq_map[MBLOCK_SLOT_MAX + 1];
+
+/* Statistics */
+static uint16_t       memory_page_used;
+static uint16_t       memory_page_peak;
+static uint16_t       memory_malloc_fails;
+static uint32_t       memory_page_allocs[CUPKEE_PAGE_ORDERR_MAX];
+static uint16_t       memory_page_fails[CUPKEE_PAGE_ORDERR_MAX];
+static uint16_t       memory_reclaims;
+
+/* Reclaim */
+static cupkee_shrink_t memory_shrinker[CUPKEE_MEMORY_SHRINKER_MAX];
+static uint8_t         memory_shrinker_num;
+static uint8_t         memory_reclaiming;
+
+/* Compaction */
+static list_head_t     memory_movable;
+static uint16_t        memory_moves;
 
 static inline size_t zone_block_size(int pages)
 {
@@ -69,29 +110,34 @@ static inline cupkee_zone_t *page_zone(cupkee_page_t *page) {
     return id < memory_zone_num ? memory_zone[id] : NULL;
 }
 
-static int page_clip(int page_num, uint16_t *order)
+static int page_clip(int page_num, uint8_t *order)
 {
     int i;
 
     for (i = CUPKEE_PAGE_ORDERR_MAX - 1; i >= 0; i--) {
         int n = 1 << i;
         if (page_num >= n) {
-            *order = (uint16_t)i;
+            *order = (uint8_t)i;
             return n;
         }
     }
     return 0;
 }
 
-static int zone_init(cupkee_zone_t *zone, intptr_t page_base, int page_num)
+static inline int zone_match(cupkee_zone_t *zone, int hint)
+{
+    // Retained memory is only given to whom ask for it
+    if ((zone->attr & CUPKEE_MEM_RETAIN) && !(hint & CUPKEE_MEM_RETAIN)) {
+        return 0;
+    }
+    return (zone->attr & hint) == hint;
+}
+
+static int zone_init(cupkee_zone_t *zone, intptr_t page_base, int page_num, int attr)
 {
     int page_off = 0;
     int i;
 
-    if (memory_zone_num >= CUPKEE_ZONE_MAX) {
-        return -1;
-    }
-
     memset(zone, 0, sizeof(cupkee_zone_t));
     for (i = 0; i < CUPKEE_PAGE_ORDERR_MAX; i++) {
         list_head_init(&zone->pages_free[i]);
@@ -108,7 +154,7 @@ static int zone_init(cupkee_zone_t *zone, intptr_t page_base, int page_num)
     }
 
     while (page_num > page_off) {
-        uint16_t order;
+        uint8_t order;
         int pages = page_clip(page_num - page_off, &order);
 
         if (pages) {
@@ -125,34 +171,55 @@ static int zone_init(cupkee_zone_t *zone, intptr_t page_base, int page_num)
 
     zone->base = page_base;
     zone->page_num = page_num;
+    zone->attr = attr;
 
     memory_zone[memory_zone_num++] = zone;
 
     return 0;
 }
 
-int cupkee_memory_setup(void)
+static inline int slab_is_mbcq(cupkee_slab_t *slab)
+{
+    return slab >= memory_mbcq && slab < memory_mbcq + CUPKEE_MBCQ_MAX;
+}
+
+static void slab_init(cupkee_slab_t *slab, size_t size)
+{
+    memset(slab, 0, sizeof(cupkee_slab_t));
+
+    list_head_init(&slab->partial);
+    list_head_init(&slab->full);
+    slab->size = size;
+}
+
+static void mbcq_init(void)
+{
+    unsigned i, slot;
+
+    for (i = 0, slot = 0; i < CUPKEE_MBCQ_MAX; i++) {
+        cupkee_slab_t *q = &memory_mbcq[i];
+
+        slab_init(q, mblock_class[i]);
+
+        while (slot <= MBLOCK_SLOT(q->size) && slot <= MBLOCK_SLOT_MAX) {
+            memory_mbcq_map[slot++] = i;
+        }
+    }
+}
+
+static int zone_create(intptr_t mem_base, size_t mem_size, int attr)
 {
-    size_t mem_size;
     size_t zone_size;
-    size_t page_size;
-    intptr_t mem_base;
     intptr_t mem_end;
     intptr_t zone_base;
     intptr_t page_base;
-    cupkee_zone_t *zone;
-    int i;
 
-    memory_zone_num = 0;
-    for (i = 0; i < CUPKEE_MBCQ_MAX; i++) {
-        list_head_init(&memory_mbcq[i]);
+    if (memory_zone_num >= CUPKEE_ZONE_MAX) {
+        return -CUPKEE_ELIMIT;
     }
 
-    /* boot zone init */
-    mem_size = hw_memory_size();
-    mem_base = (intptr_t) hw_memory_alloc(mem_size, 1);
     if (!mem_base) {
-        return -1;
+        return -CUPKEE_EINVAL;
     }
     mem_end = mem_base + mem_size;
 
@@ -162,21 +229,56 @@ int cupkee_memory_setup(void)
     // printf("zone block size: %lu = %lu + %lu * %lu\n", zone_size, sizeof(cupkee_zone_t), sizeof(cupkee_page_t), mem_size / CUPKEE_PAGE_SIZE);
 
     page_base = (intptr_t) CUPKEE_ADDR_ALIGN((zone_base + zone_size), CUPKEE_PAGE_SIZE);
-    page_size = mem_end - page_base;
+    if (page_base + CUPKEE_PAGE_SIZE > mem_end) {
+        return -CUPKEE_ENOMEM;
+    }
+
+    // printf("page base: %p, size: %lu\n", page_base, mem_end - page_base);
 
-    // printf("page base: %p, size: %lu\n", page_base, page_size);
+    return zone_init((cupkee_zone_t *) zone_base, page_base, (mem_end - page_base) / CUPKEE_PAGE_SIZE, attr);
+}
 
-    zone = (cupkee_zone_t *) zone_base;
+int cupkee_memory_setup(void)
+{
+    size_t mem_size;
+
+    memory_zone_num = 0;
+    mbcq_init();
 
-    return zone_init(zone, page_base, page_size / CUPKEE_PAGE_SIZE);
+    memory_page_used = 0;
+    memory_page_peak = 0;
+    memory_malloc_fails = 0;
+    memset(memory_page_allocs, 0, sizeof(memory_page_allocs));
+    memset(memory_page_fails, 0, sizeof(memory_page_fails));
+    memory_reclaims = 0;
+
+    memory_shrinker_num = 0;
+    memory_reclaiming = 0;
+
+    list_head_init(&memory_movable);
+    memory_moves = 0;
+
+    /* boot zone init */
+    mem_size = hw_memory_size();
+
+    return zone_create((intptr_t) hw_memory_alloc(mem_size, 1), mem_size, CUPKEE_ZONE_BOOT_ATTR);
+}
+
+int cupkee_memory_extend(intptr_t base, size_t size, int attr)
+{
+    if (memory_zone_num < 1) {
+        return -CUPKEE_EINVAL;
+    }
+
+    return zone_create(base, size, attr);
 }
 
-int cupkee_memory_extend(intptr_t base, size_t size)
+int cupkee_memory_attr(void *ptr)
 {
-    (void) base;
-    (void) size;
+    cupkee_page_t *page = cupkee_memory_page(ptr);
+    cupkee_zone_t *zone = page ? page_zone(page) : NULL;
 
-    return -1;
+    return zone ? zone->attr : -CUPKEE_EINVAL;
 }
 
 cupkee_page_t *cupkee_memory_page(void *ptr)
@@ -240,7 +342,7 @@ static cupkee_page_t *page_division(cupkee_page_t *page)
 {
     cupkee_zone_t *zone;
     cupkee_page_t *buddy;
-    uint16_t order = page->order - 1;
+    uint8_t order = page->order - 1;
 
     if (order >= CUPKEE_PAGE_ORDERR_MAX || NULL == (zone = page_zone(page))) {
         return NULL;
@@ -332,16 +434,23 @@ static cupkee_page_t *zone_page_alloc(cupkee_zone_t *zone, int order)
     return NULL;
 }
 
-static void page_block_init(cupkee_page_t *page, size_t block_size)
+static void page_block_init(cupkee_page_t *page, cupkee_slab_t *slab)
 {
-    void *mem = cupkee_page_memory(page);
+    uint8_t *mem = cupkee_page_memory(page);
+    size_t block_size = slab->size;
     int i, max = CUPKEE_PAGE_SIZE / block_size;
     intptr_t head = 0;
 
-    page->flags |= PAGE_MBCQ;
+    if (slab_is_mbcq(slab)) {
+        page->flags |= PAGE_MBCQ;
+        page->cls    = slab - memory_mbcq;
+    } else {
+        page->flags |= PAGE_SLAB;
+        page->cls    = 0;
+    }
     page->used   = 0;
 
-    for (i = 0; i < max; i++) {
+    for (i = max - 1; i >= 0; i--) {
         mblock_head_t *mb = (mblock_head_t *)(mem + block_size * i);
 
         mb->next = head;
@@ -353,7 +462,7 @@ static void page_block_init(cupkee_page_t *page, size_t block_size)
     page->blocks = head;
 }
 
-static void *page_block_alloc(cupkee_page_t *page)
+static void *page_block_alloc(cupkee_slab_t *slab, cupkee_page_t *page)
 {
     mblock_head_t *mb = (mblock_head_t *)page->blocks;
 
@@ -361,84 +470,303 @@ static void *page_block_alloc(cupkee_page_t *page)
         // assert(mb->comp + mb->next == 0);
         page->used++;
         page->blocks = mb->next;
+
+        if (!page->blocks) {
+            list_del(&page->list);
+            list_add(&page->list, &slab->full);
+        }
+
+        if (++slab->inuse > slab->peak) {
+            slab->peak = slab->inuse;
+        }
     }
 
     return mb;
 }
 
-static void page_block_free(cupkee_page_t *page, void *b)
+static void page_block_free(cupkee_slab_t *slab, cupkee_page_t *page, void *b)
 {
     mblock_head_t *mb = (mblock_head_t *)b;
 
+    if (!page->blocks) {
+        list_del(&page->list);
+        list_add(&page->list, &slab->partial);
+    }
+
     mb->next = page->blocks;
     mb->comp = ~(mb->next) + 1;
 
     page->blocks = (intptr_t) mb;
-    if (--page->used == 0) {
+    slab->inuse--;
+    if (--page->used == 0 && slab->pages > slab->reserve) {
         list_del(&page->list);
+        slab->pages--;
         cupkee_page_free(page);
     }
 }
 
-static inline cupkee_page_t *mbcq_page_first(int q)
+static cupkee_page_t *zones_page_alloc(int order, int hint)
 {
-    list_head_t *head = &memory_mbcq[q];
+    cupkee_page_t *page = NULL;
+    int zone_id;
 
-    return list_is_empty(head) ? NULL : (cupkee_page_t *)(head->next);
+    for (zone_id = 0; !page && zone_id < memory_zone_num; zone_id++) {
+        cupkee_zone_t *zone = memory_zone[zone_id];
+
+        if (zone_match(zone, hint)) {
+            page = zone_page_alloc(zone, order);
+        }
+    }
+
+    if (page) {
+        memory_page_allocs[order]++;
+        memory_page_used += 1 << order;
+        if (memory_page_used > memory_page_peak) {
+            memory_page_peak = memory_page_used;
+        }
+    }
+
+    return page;
 }
 
-static void *mbcq_alloc(size_t size)
+static cupkee_page_t *slab_page_find(cupkee_slab_t *slab, int hint)
 {
-    int q;
+    list_head_t *pos;
 
-    if (size > MBLOCK_SIZE(2)) {
-        q = 3;
-    } else {
-    if (size > MBLOCK_SIZE(1)) {
-        q = 2;
-    } else
-    if (size > MBLOCK_SIZE(0)) {
-        q = 1;
-    } else
-        q = 0;
+    list_for_each(pos, &slab->partial) {
+        cupkee_page_t *page = (cupkee_page_t *)pos;
+
+        if (zone_match(page_zone(page), hint)) {
+            return page;
+        }
     }
 
-    while (q < CUPKEE_MBCQ_MAX) {
-        cupkee_page_t *page = mbcq_page_first(q);
+    return NULL;
+}
 
-        if (!page || !page->blocks) {
-            page = cupkee_page_alloc(0);
-            if (page) {
-                page_block_init(page, MBLOCK_SIZE(q));
-                list_add(&page->list, &memory_mbcq[q]);
-            } else {
-                q++;
-                continue;
-            }
+static cupkee_page_t *slab_page_new(cupkee_slab_t *slab, int hint)
+{
+    cupkee_page_t *page = zones_page_alloc(0, hint);
+
+    if (page) {
+        page_block_init(page, slab);
+        list_add(&page->list, &slab->partial);
+        slab->pages++;
+    }
+
+    return page;
+}
+
+static cupkee_page_t *slab_page_get(cupkee_slab_t *slab, int hint)
+{
+    cupkee_page_t *page;
+
+    if (hint & CUPKEE_MEM_FAST) {
+        if (NULL != (page = slab_page_find(slab, hint)) ||
+            NULL != (page = slab_page_new(slab, hint))) {
+            return page;
+        }
+        hint &= ~CUPKEE_MEM_FAST;
+    }
+
+    if (NULL != (page = slab_page_find(slab, hint))) {
+        return page;
+    }
+    return slab_page_new(slab, hint);
+}
+
+/* Call shrinkers from *next, till one of them release something.
+ * Shrinker may free memory, but should not alloc.
+ */
+static int memory_reclaim_next(int *next, size_t want)
+{
+    size_t released = 0;
+
+    if (memory_reclaiming) {
+        return 0;
+    }
+
+    memory_reclaiming = 1;
+    while (!released && *next < memory_shrinker_num) {
+        released = memory_shrinker[(*next)++](want);
+    }
+    memory_reclaiming = 0;
+
+    if (released) {
+        memory_reclaims++;
+    }
+    return released > 0;
+}
+
+int cupkee_memory_shrinker(cupkee_shrink_t shrink)
+{
+    int i;
+
+    if (!shrink) {
+        return -CUPKEE_EINVAL;
+    }
+
+    for (i = 0; i < memory_shrinker_num; i++) {
+        if (memory_shrinker[i] == shrink) {
+            return 0;
+        }
+    }
+
+    if (memory_shrinker_num >= CUPKEE_MEMORY_SHRINKER_MAX) {
+        return -CUPKEE_ELIMIT;
+    }
+    memory_shrinker[memory_shrinker_num++] = shrink;
+
+    return 0;
+}
+
+size_t cupkee_memory_reclaim(size_t want)
+{
+    size_t released = 0;
+    int i;
+
+    if (memory_reclaiming) {
+        return 0;
+    }
+
+    memory_reclaiming = 1;
+    for (i = 0; i < memory_shrinker_num && released < want; i++) {
+        released += memory_shrinker[i](want - released);
+    }
+    memory_reclaiming = 0;
+
+    return released;
+}
+
+static void slab_shrink(cupkee_slab_t *slab)
+{
+    list_head_t *pos = slab->partial.next;
+
+    while (pos != &slab->partial && slab->pages > slab->reserve) {
+        cupkee_page_t *page = (cupkee_page_t *)pos;
+
+        pos = pos->next;
+        if (page->used == 0) {
+            list_del(&page->list);
+            slab->pages--;
+            cupkee_page_free(page);
         }
+    }
+}
+
+static void *mbcq_alloc(size_t size, int hint)
+{
+    unsigned q = memory_mbcq_map[MBLOCK_SLOT(size)];
+
+    while (q < CUPKEE_MBCQ_MAX) {
+        cupkee_page_t *page = slab_page_get(&memory_mbcq[q], hint);
 
-        return page_block_alloc(page);
+        if (page) {
+            return page_block_alloc(&memory_mbcq[q], page);
+        }
+        q++;
     }
 
     return NULL;
 }
 
-cupkee_page_t *cupkee_page_alloc(int order)
+int cupkee_slab_init(cupkee_slab_t *slab, size_t size)
+{
+    size = CUPKEE_SIZE_ALIGN(size, sizeof(intptr_t));
+    if (size < sizeof(mblock_head_t)) {
+        size = sizeof(mblock_head_t);
+    }
+
+    // A page hold 2 blocks at least, and no more than 255 (page->used)
+    if (!slab || size > CUPKEE_PAGE_SIZE / 2 || CUPKEE_PAGE_SIZE / size > 255) {
+        return -CUPKEE_EINVAL;
+    }
+
+    slab_init(slab, size);
+
+    return 0;
+}
+
+int cupkee_slab_reserve(cupkee_slab_t *slab, int n)
+{
+    int per_page = CUPKEE_PAGE_SIZE / slab->size;
+
+    slab->reserve = (n + per_page - 1) / per_page;
+
+    while (slab->pages < slab->reserve) {
+        if (!slab_page_new(slab, 0)) {
+            return -CUPKEE_ENOMEM;
+        }
+    }
+    slab_shrink(slab);
+
+    return 0;
+}
+
+int cupkee_slab_space(cupkee_slab_t *slab)
+{
+    return slab->pages * (CUPKEE_PAGE_SIZE / slab->size) - slab->inuse;
+}
+
+void *cupkee_slab_alloc(cupkee_slab_t *slab)
 {
-    int zone_id;
     cupkee_page_t *page;
+    int next = 0;
+
+    while (NULL == (page = slab_page_get(slab, 0))) {
+        if (!memory_reclaim_next(&next, slab->size)) {
+            slab->fails++;
+            memory_page_fails[0]++;
+            return NULL;
+        }
+    }
+    return page_block_alloc(slab, page);
+}
+
+void cupkee_slab_free(cupkee_slab_t *slab, void *p)
+{
+    cupkee_page_t *page = cupkee_memory_page(p);
+
+    if (page && (page->flags & PAGE_SLAB)) {
+        page_block_free(slab, page, p);
+    }
+}
+
+static cupkee_page_t *page_alloc_hint(int order, int hint)
+{
+    cupkee_page_t *page;
+
+    // Fast is a preference, others are requirement
+    if ((hint & CUPKEE_MEM_FAST) && NULL != (page = zones_page_alloc(order, hint))) {
+        return page;
+    }
+
+    return zones_page_alloc(order, hint & ~CUPKEE_MEM_FAST);
+}
+
+cupkee_page_t *cupkee_page_alloc_hint(int order, int hint)
+{
+    cupkee_page_t *page;
+    int next = 0;
 
     if (order >= CUPKEE_PAGE_ORDERR_MAX) {
         return NULL;
     }
 
-    for (zone_id = 0, page = NULL; !page && zone_id < memory_zone_num; zone_id++) {
-        page = zone_page_alloc(memory_zone[zone_id], order);
+    while (NULL == (page = page_alloc_hint(order, hint))) {
+        if (!memory_reclaim_next(&next, CUPKEE_PAGE_SIZE << order)) {
+            memory_page_fails[order]++;
+            break;
+        }
     }
-
     return page;
 }
 
+cupkee_page_t *cupkee_page_alloc(int order)
+{
+    return cupkee_page_alloc_hint(order, 0);
+}
+
 void cupkee_page_free(cupkee_page_t *page)
 {
     cupkee_page_t *super;
@@ -450,7 +778,9 @@ void cupkee_page_free(cupkee_page_t *page)
 
     // printf("\nfree: %d, %u\n", page - zone->pages, page->order);
 
-    page->flags &= ~(PAGE_INUSED | PAGE_MBCQ);
+    page->flags &= ~(PAGE_INUSED | PAGE_MBCQ | PAGE_SLAB | PAGE_SPAN);
+    page->cls = 0;
+    memory_page_used -= 1 << page->order;
 
     while (NULL != (super = page_combine(page, zone))) {
         page = super;
@@ -461,23 +791,91 @@ void cupkee_page_free(cupkee_page_t *page)
     list_add(&page->list, &zone->pages_free[page->order]);
 }
 
-void *cupkee_malloc(size_t size)
+static inline void page_span_mark(cupkee_page_t *page, int order)
 {
-    if (size <= MBLOCK_SIZE(CUPKEE_MBCQ_MAX - 1)) {
-        return mbcq_alloc(size);
-    } else {
-        int order = 0;
+    page->flags = (page->flags & PAGE_ZONE_MASK) | PAGE_HEAD | PAGE_INUSED;
+    page->order = order;
+}
 
-        while (size > (CUPKEE_PAGE_SIZE << order)) {
-            if (++order >= CUPKEE_PAGE_ORDERR_MAX) {
-                break;
-            }
+/* Cut a block to n pages: kept pages become buddy blocks in descending
+ * order from head, the tail is given back to free lists.
+ */
+static void page_span_trim(cupkee_page_t *head, int n)
+{
+    int total = 1 << head->order;
+    int off, order;
+
+    if (n >= total) {
+        return;
+    }
+
+    for (off = 0, order = head->order - 1; order >= 0; order--) {
+        if (n & (1 << order)) {
+            page_span_mark(head + off, order);
+            off += 1 << order;
+        }
+    }
+    head->flags |= PAGE_SPAN;
+    head->blocks = n;
+
+    while (off < total) {
+        cupkee_page_t *page = head + off;
+
+        // The largest block aligned at off
+        for (order = 0; !(off & (1 << order)); order++)
+            ;
+        page_span_mark(page, order);
+        off += 1 << order;
+
+        cupkee_page_free(page);
+    }
+}
+
+static void page_span_free(cupkee_page_t *head)
+{
+    cupkee_page_t *page = head;
+    int n = head->blocks;
+    int order;
+
+    head->flags &= ~PAGE_SPAN;
+    head->blocks = 0;
+
+    for (order = CUPKEE_PAGE_ORDERR_MAX - 1; order >= 0; order--) {
+        if (n & (1 << order)) {
+            cupkee_page_t *curr = page;
+
+            page += 1 << order;
+            cupkee_page_free(curr);
         }
+    }
+}
+
+/* Order of pages wanted by size, small blocks live in order 0 pages */
+static int memory_alloc_order(size_t size)
+{
+    size_t pages = (size + CUPKEE_PAGE_SIZE - 1) >> CUPKEE_PAGE_SHIFT;
+    int order = 0;
+
+    while (pages > (1U << order) && order < CUPKEE_PAGE_ORDERR_MAX) {
+        order++;
+    }
+
+    return order;
+}
+
+static void *memory_alloc(size_t size, int hint)
+{
+    if (size <= CUPKEE_MBLOCK_SIZE_MAX) {
+        return mbcq_alloc(size, hint);
+    } else {
+        size_t pages = (size + CUPKEE_PAGE_SIZE - 1) >> CUPKEE_PAGE_SHIFT;
+        int order = memory_alloc_order(size);
 
         while (order < CUPKEE_PAGE_ORDERR_MAX) {
-            cupkee_page_t *page = cupkee_page_alloc(order++);
+            cupkee_page_t *page = page_alloc_hint(order++, hint);
 
             if (page) {
+                page_span_trim(page, pages);
                 return cupkee_page_memory(page);
             }
         }
@@ -486,6 +884,35 @@ void *cupkee_malloc(size_t size)
     return NULL;
 }
 
+void *cupkee_malloc_hint(size_t size, int hint)
+{
+    void *p;
+    int next = 0;
+
+    while (NULL == (p = memory_alloc(size, hint))) {
+        if (!memory_reclaim_next(&next, size)) {
+            int order = memory_alloc_order(size);
+
+            // Counted once, by the class and the order wanted
+            if (size <= CUPKEE_MBLOCK_SIZE_MAX) {
+                memory_mbcq[memory_mbcq_map[MBLOCK_SLOT(size)]].fails++;
+            }
+            if (order < CUPKEE_PAGE_ORDERR_MAX) {
+                memory_page_fails[order]++;
+            }
+            memory_malloc_fails++;
+            break;
+        }
+    }
+
+    return p;
+}
+
+void *cupkee_malloc(size_t size)
+{
+    return cupkee_malloc_hint(size, 0);
+}
+
 void  cupkee_free(void *p)
 {
     cupkee_page_t *page = cupkee_memory_page(p);
@@ -496,9 +923,227 @@ void  cupkee_free(void *p)
     // assert(page->flags & (PAGE_HEAD | PAGE_INUSED);
 
     if (page->flags & PAGE_MBCQ) {
-        page_block_free(page, p);
-    } else {
+        page_block_free(&memory_mbcq[page->cls], page, p);
+    } else
+    if (page->flags & PAGE_SPAN) {
+        page_span_free(page);
+    } else
+    if (!(page->flags & PAGE_SLAB)) {
         cupkee_page_free(page);
     }
 }
 
+void *cupkee_movable_alloc(size_t size, int hint)
+{
+    movable_head_t *m = cupkee_malloc_hint(size + sizeof(movable_head_t), hint);
+
+    if (!m) {
+        return NULL;
+    }
+
+    m->ref = NULL;
+    m->size = size;
+    m->lock = 0;
+    list_add_tail(&m->list, &memory_movable);
+
+    return m + 1;
+}
+
+void cupkee_movable_free(void *p)
+{
+    if (p) {
+        movable_head_t *m = (movable_head_t *)p - 1;
+
+        list_del(&m->list);
+        cupkee_free(m);
+    }
+}
+
+void cupkee_movable_ref(void *p, void **ref)
+{
+    if (p) {
+        ((movable_head_t *)p - 1)->ref = ref;
+    }
+}
+
+void cupkee_movable_lock(void *p)
+{
+    if (p) {
+        ((movable_head_t *)p - 1)->lock++;
+    }
+}
+
+void cupkee_movable_unlock(void *p)
+{
+    movable_head_t *m = (movable_head_t *)p - 1;
+
+    if (p && m->lock) {
+        m->lock--;
+    }
+}
+
+/* The lowest free block of the order under limit, larger ones are not
+ * split up: it would make thing worse.
+ */
+static cupkee_page_t *zone_page_below(cupkee_zone_t *zone, int order, cupkee_page_t *limit)
+{
+    cupkee_page_t *best = NULL;
+    list_head_t *pos;
+
+    list_for_each(pos, &zone->pages_free[order]) {
+        cupkee_page_t *page = (cupkee_page_t *)pos;
+
+        if (page < limit && (!best || page < best)) {
+            best = page;
+        }
+    }
+
+    return best;
+}
+
+/* Pages: slide down into holes, free space gather at the top and merge */
+static void *movable_span_dest(cupkee_page_t *head)
+{
+    cupkee_zone_t *zone = page_zone(head);
+    cupkee_page_t *page;
+    int n = (head->flags & PAGE_SPAN) ? (int)head->blocks : 1 << head->order;
+    int order = 0;
+
+    while ((1 << order) < n) {
+        order++;
+    }
+
+    if (!zone || NULL == (page = zone_page_below(zone, order, head))) {
+        return NULL;
+    }
+
+    list_del(&page->list);
+    page->flags |= PAGE_INUSED;
+    memory_page_used += 1 << order;
+    if (memory_page_used > memory_page_peak) {
+        memory_page_peak = memory_page_used;
+    }
+    page_span_trim(page, n);
+
+    return cupkee_page_memory(page);
+}
+
+/* Blocks: leave sparse page for a denser one, so that pages run empty */
+static void *movable_block_dest(cupkee_page_t *from)
+{
+    cupkee_slab_t *slab = &memory_mbcq[from->cls];
+    list_head_t *pos;
+
+    list_for_each(pos, &slab->partial) {
+        cupkee_page_t *page = (cupkee_page_t *)pos;
+
+        if (page != from && page->used >= from->used && page_zone(page) == page_zone(from)) {
+            return page_block_alloc(slab, page);
+        }
+    }
+
+    return NULL;
+}
+
+static movable_head_t *movable_move(movable_head_t *m)
+{
+    cupkee_page_t *page = cupkee_memory_page(m);
+    movable_head_t *to;
+    list_head_t *prev;
+    uint32_t state;
+
+    if (!page) {
+        return NULL;
+    }
+
+    if (page->flags & PAGE_MBCQ) {
+        to = movable_block_dest(page);
+    } else {
+        to = movable_span_dest(page);
+    }
+
+    if (!to) {
+        return NULL;
+    }
+
+    // Owner may touch the block in interrupt
+    hw_enter_critical(&state);
+    prev = m->list.prev;
+    list_del(&m->list);
+    memcpy(to, m, m->size + sizeof(movable_head_t));
+    list_add(&to->list, prev);
+    *to->ref = to + 1;
+    hw_exit_critical(state);
+
+    cupkee_free(m);
+    memory_moves++;
+
+    return to;
+}
+
+/* Relocate no more than budget blocks, return the number moved */
+int cupkee_memory_compact(int budget)
+{
+    list_head_t *pos = memory_movable.next;
+    int moved = 0;
+
+    while (pos != &memory_movable && moved < budget) {
+        movable_head_t *m = (movable_head_t *)pos;
+
+        if (!m->lock && m->ref) {
+            movable_head_t *to = movable_move(m);
+
+            if (to) {
+                m = to;
+                moved++;
+            }
+        }
+        pos = m->list.next;
+    }
+
+    return moved;
+}
+
+void cupkee_memory_stat(cupkee_memory_stat_t *stat)
+{
+    int largest = 0;
+    int i, order;
+
+    memset(stat, 0, sizeof(cupkee_memory_stat_t));
+
+    for (i = 0; i < memory_zone_num; i++) {
+        stat->pages += memory_zone[i]->page_num;
+    }
+
+    for (order = 0; order < CUPKEE_PAGE_ORDERR_MAX; order++) {
+        int n = cupkee_free_pages(order);
+
+        if (n) {
+            largest = 1 << order;
+        }
+        stat->free_blocks[order] = n;
+        stat->pages_free += n << order;
+        stat->allocs[order] = memory_page_allocs[order];
+        stat->fails[order] = memory_page_fails[order];
+    }
+
+    stat->pages_peak = memory_page_peak;
+    stat->malloc_fails = memory_malloc_fails;
+    stat->reclaims = memory_reclaims;
+    stat->moves = memory_moves;
+
+    // Share of free pages can not be used by the largest request possible
+    if (stat->pages_free) {
+        stat->frag = 100 - largest * 100 / stat->pages_free;
+    }
+}
+
+int cupkee_memory_class_num(void)
+{
+    return CUPKEE_MBCQ_MAX;
+}
+
+const cupkee_slab_t *cupkee_memory_class(int q)
+{
+    return (unsigned)q < CUPKEE_MBCQ_MAX ? &memory_mbcq[q] : NULL;
+}
@@ -20,18 +20,37 @@
 #include "cupkee.h"
 
 #define CUPKEE_OBJECT_TAG_MAX   (16)
-#define CUPKEE_OBJECT_NUM_DEF   (32)
+
+/* Object id: | generation | index |
+ * Generation of slot is changed every time it is released, so that
+ * a stale id can not reach the object reuse the slot.
+ */
+#define OBJECT_INDEX_MAX        (1 << CUPKEE_OBJECT_INDEX_BITS)
+#define OBJECT_INDEX_MASK       (OBJECT_INDEX_MAX - 1)
+#define OBJECT_GEN_MASK         ((1 << (15 - CUPKEE_OBJECT_INDEX_BITS)) - 1)
+#define OBJECT_SLOT_NUM         (CUPKEE_PAGE_SIZE / sizeof(object_slot_t))
+#define OBJECT_CHUNK_MAX        ((OBJECT_INDEX_MAX + OBJECT_SLOT_NUM - 1) / OBJECT_SLOT_NUM)
 
 typedef struct cupkee_object_info_t {
     size_t size;
     const cupkee_desc_t *desc;
     void *meta;
+    cupkee_slab_t *cache;
+    uint16_t inuse;
+    uint16_t peak;
 } cupkee_object_info_t;
 
+typedef struct object_slot_t {
+    cupkee_object_t *obj;
+    int16_t next;
+    uint8_t gen;
+} object_slot_t;
+
 static list_head_t      obj_list_head;
 
-static cupkee_object_t **obj_map;
-static int              obj_map_size;
+static object_slot_t   *obj_chunk[OBJECT_CHUNK_MAX];
+static int              obj_chunk_num;
+static int              obj_free;
 static int              obj_map_num;
 
 static uint8_t              obj_tag_end;
@@ -45,60 +64,122 @@ static inline const cupkee_desc_t *object_desc(cupkee_object_t *obj) {
     }
 }
 
-static inline void object_map(cupkee_object_t *obj, int id)
+static inline object_slot_t *id_slot(int index)
+{
+    return &obj_chunk[index / OBJECT_SLOT_NUM][index % OBJECT_SLOT_NUM];
+}
+
+static int id_grow(void)
 {
-    if (!obj_map[id]) {
-        obj->id = id;
-        obj_map[id] = obj;
-        ++obj_map_num;
+    cupkee_page_t *page;
+    object_slot_t *chunk;
+    int i, base, num;
+
+    if (obj_chunk_num >= (int)OBJECT_CHUNK_MAX || !(page = cupkee_page_alloc(0))) {
+        return -1;
+    }
+    chunk = (object_slot_t *)cupkee_page_memory(page);
+
+    base = obj_chunk_num * OBJECT_SLOT_NUM;
+    num  = OBJECT_INDEX_MAX - base;
+    if (num > (int)OBJECT_SLOT_NUM) {
+        num = OBJECT_SLOT_NUM;
+    }
+
+    for (i = 0; i < num; i++) {
+        chunk[i].obj  = NULL;
+        chunk[i].gen  = 0;
+        chunk[i].next = i + 1 < num ? base + i + 1 : obj_free;
     }
+    obj_free = base;
+    obj_chunk[obj_chunk_num++] = chunk;
+
+    return 0;
 }
 
-static inline void object_unmap(cupkee_object_t *obj)
+static int object_map(cupkee_object_t *obj)
 {
-    if (obj->id < obj_map_size && obj == obj_map[obj->id]) {
-        obj_map[obj->id] = NULL;
-        --obj_map_num;
+    object_slot_t *slot;
+    int index;
+
+    if (obj_free < 0 && id_grow()) {
+        return -1;
     }
+
+    index = obj_free;
+    slot = id_slot(index);
+    obj_free = slot->next;
+
+    slot->obj = obj;
+    obj->id = (slot->gen << CUPKEE_OBJECT_INDEX_BITS) | index;
+    ++obj_map_num;
+
+    return obj->id;
 }
 
-static int id_alloc(void)
+static inline void object_unmap(cupkee_object_t *obj)
 {
-    if (obj_map_num < obj_map_size) {
-        int id;
-        for (id = 0; id < obj_map_size; id++) {
-            if (!obj_map[id]) {
-                return id;
-            }
-        }
+    int index = obj->id & OBJECT_INDEX_MASK;
+    object_slot_t *slot;
+
+    if (obj->id < 0 || index >= obj_chunk_num * (int)OBJECT_SLOT_NUM) {
+        return;
+    }
+
+    slot = id_slot(index);
+    if (slot->obj == obj) {
+        slot->obj  = NULL;
+        slot->gen  = (slot->gen + 1) & OBJECT_GEN_MASK;
+        slot->next = obj_free;
+        obj_free = index;
+        --obj_map_num;
     }
-    return -1;
 }
 
 static inline cupkee_object_t *id_object(int id) {
-    if ((unsigned)id >= (unsigned)obj_map_size) {
+    int index = id & OBJECT_INDEX_MASK;
+    object_slot_t *slot;
+
+    if (id < 0 || index >= obj_chunk_num * (int)OBJECT_SLOT_NUM) {
+        return NULL;
+    }
+
+    slot = id_slot(index);
+    if (slot->gen != (id >> CUPKEE_OBJECT_INDEX_BITS)) {
         return NULL;
     }
 
-    return obj_map[id];
+    return slot->obj;
+}
+
+static inline void object_free(cupkee_object_t *obj)
+{
+    cupkee_object_info_t *info = &obj_infos[obj->tag];
+
+    list_del(&obj->list);
+    info->inuse--;
+
+    if (info->cache) {
+        cupkee_slab_free(info->cache, obj);
+    } else {
+        cupkee_free(obj);
+    }
 }
 
 int cupkee_object_setup(void)
 {
-    obj_map_size = CUPKEE_OBJECT_NUM_DEF;
-    obj_map = (cupkee_object_t **)cupkee_malloc(obj_map_size * sizeof(void *));
-    if (!obj_map) {
+    obj_chunk_num = 0;
+    obj_free = -1;
+    obj_map_num = 0;
+    if (id_grow()) {
         return -1;
     }
-    memset(obj_map, 0, obj_map_size * sizeof(void *));
 
     list_head_init(&obj_list_head);
 
     obj_tag_end = 0;
     memset(obj_infos, 0, CUPKEE_OBJECT_TAG_MAX * sizeof(cupkee_object_info_t));
 
-    obj_map_num = 0;
-
     return 0;
 }
 
@@ -153,16 +234,83 @@ const void *cupkee_object_meta(cupkee_object_t *obj)
     }
 }
 
+int cupkee_object_cache(int tag, int reserve)
+{
+    cupkee_object_info_t *info;
+    cupkee_slab_t *cache;
+    int err;
+
+    if ((unsigned)tag >= obj_tag_end || reserve < 0) {
+        return -CUPKEE_EINVAL;
+    }
+    info = &obj_infos[tag];
+
+    if (!info->cache) {
+        // Objects already malloc'ed can not go back to cache
+        if (info->inuse) {
+            return -CUPKEE_EBUSY;
+        }
+
+        if (!(cache = cupkee_malloc(sizeof(cupkee_slab_t)))) {
+            return -CUPKEE_ENOMEM;
+        }
+
+        if (0 != (err = cupkee_slab_init(cache, sizeof(cupkee_object_t) + info->size))) {
+            cupkee_free(cache);
+            return err;
+        }
+        info->cache = cache;
+    }
+
+    return cupkee_slab_reserve(info->cache, reserve);
+}
+
+int cupkee_object_stat(int tag, cupkee_object_stat_t *stat)
+{
+    cupkee_object_info_t *info;
+
+    if ((unsigned)tag >= obj_tag_end || !stat) {
+        return -CUPKEE_EINVAL;
+    }
+    info = &obj_infos[tag];
+
+    stat->inuse = info->inuse;
+    stat->peak  = info->peak;
+    if (info->cache) {
+        stat->size   = info->cache->size;
+        stat->pages  = info->cache->pages;
+        stat->cached = cupkee_slab_space(info->cache);
+    } else {
+        stat->size   = sizeof(cupkee_object_t) + info->size;
+        stat->pages  = 0;
+        stat->cached = 0;
+    }
+
+    return 0;
+}
+
 cupkee_object_t *cupkee_object_create(int tag)
 {
     if ((unsigned)tag < obj_tag_end) {
-        cupkee_object_t *obj = (cupkee_object_t *)cupkee_malloc(sizeof(cupkee_object_t) + obj_infos[tag].size);
+        cupkee_object_info_t *info = &obj_infos[tag];
+        cupkee_object_t *obj;
+
+        if (info->cache) {
+            obj = (cupkee_object_t *)cupkee_slab_alloc(info->cache);
+        } else {
+            obj = (cupkee_object_t *)cupkee_malloc(sizeof(cupkee_object_t) + info->size);
+        }
+
         if (obj) {
             obj->tag = tag;
             obj->ref = 1;
             obj->id  = CUPKEE_ID_INVALID;
 
             list_add_tail(&obj->list, &obj_list_head);
+
+            if (++info->inuse > info->peak) {
+                info->peak = info->inuse;
+            }
         }
         return obj;
     }
@@ -172,19 +320,18 @@ cupkee_object_t *cupkee_object_create(int tag)
 
 cupkee_object_t *cupkee_object_create_with_id(int tag)
 {
-    int id;
     cupkee_object_t *obj;
 
-    if (0 > (id = id_alloc())) {
+    if (!(obj = cupkee_object_create(tag))) {
         return NULL;
     }
 
-    if (!(obj = cupkee_object_create(tag))) {
+    if (0 > object_map(obj)) {
+        object_free(obj);
         return NULL;
-    } else {
-        object_map(obj, id);
-        return obj;
     }
+
+    return obj;
 }
 
 void cupkee_object_destroy(cupkee_object_t *obj)
@@ -196,10 +343,7 @@ void cupkee_object_destroy(cupkee_object_t *obj)
             desc->destroy(obj->entry);
         }
         object_unmap(obj);
-
-        list_del(&obj->list);
-
-        cupkee_free(obj);
+        object_free(obj);
     }
 }
 
@@ -319,15 +463,14 @@ int cupkee_id(int tag)
     int id;
     cupkee_object_t *obj;
 
-    if (0 > (id = id_alloc())) {
-        return -CUPKEE_ERESOURCE;
-    }
-
     if (!(obj = cupkee_object_create(tag))) {
         return -CUPKEE_ENOMEM;
     }
 
-    object_map(obj, id);
+    if (0 > (id = object_map(obj))) {
+        object_free(obj);
+        return -CUPKEE_ERESOURCE;
+    }
 
     return id;
 }
@@ -28,7 +28,13 @@
 #define SDMP_BODY_MAX_SIZE      256
 
 #define SDMP_SEND_BUF_SIZE      248
-#define SDMP_MSG_BUF_SIZE       (SDMP_HEAD_SIZE + SDMP_BODY_MAX_SIZE)
+#define SDMP_RECV_CHUNK_SIZE    64
+
+#define SDMP_SECTOR_BLOCKS      (CUPKEE_SECTOR_SIZE / CUPKEE_BLOCK_SIZE)
+#define SDMP_WINDOW_MAX         32      // blocks in window, one bit each in mask
+#define SDMP_WINDOW_ACK         0x80    // flag in block index: status wanted
+
+#define SDMP_BATCH_SIZE         240     // frame of batch report, buffer fit in a small block
 
 enum sdmp_demux_state_e {
     DEMUX_KEY = 0,
@@ -63,12 +69,17 @@ enum sdmp_message_code_e {
     SDMP_REQ_QUERY_APPSTATE,
     SDMP_REQ_QUERY_APPDATA,
     SDMP_REQ_WRITE_APPDATA,
+    SDMP_REQ_QUERY_MEMINFO,
+    SDMP_REQ_READ_SYSDATA_WINDOW,
+    SDMP_REQ_WRITE_SYSDATA_WINDOW,
 
     SDMP_RESPONSE = 0x80,
     SDMP_REPORT   = 0x81,
+    SDMP_REPORT_BATCH = 0x82,
 };
 
 typedef struct sdmp_message_t {
+    void    *buf;
     uint8_t *param;
     uint8_t *data;
 } sdmp_message_t;
@@ -80,91 +91,174 @@ static uint16_t sdmp_request_pos;
 static uint8_t  sdmp_request_buf[256];
 static uint8_t  sdmp_app_interface[CUPKEE_UID_SIZE];
 
-static uint16_t sdmp_message_pos = 0;
-static uint16_t sdmp_message_end = 0;
-static uint8_t  sdmp_message_buf[SDMP_MSG_BUF_SIZE];
+/* Outbound: message in sending, then responses, reports and text */
+static void *   sdmp_message_sending = NULL;
+static uint8_t  sdmp_response_num = 0;
+static uint8_t  sdmp_report_num = 0;
+static void *   sdmp_response_queue[CUPKEE_SDMP_RESPONSE_QUEUE];
+static void *   sdmp_report_queue[CUPKEE_SDMP_REPORT_QUEUE];
 
 static void *   sdmp_mux_text_buf = NULL;
 
-static uint16_t sdmp_script_buf_size = 0;
+/* Sysdata window: blocks addressed by sector * SDMP_SECTOR_BLOCKS + block */
+static uint16_t sdmp_window_rd_start;
+static uint32_t sdmp_window_rd_mask = 0;   // blocks wait to be sent
+static uint16_t sdmp_window_wr_start;
+static uint8_t  sdmp_window_wr_num = 0;
+static uint32_t sdmp_window_wr_mask;       // blocks written
+
+/* Batch report in building, items: id, type, value */
+static sdmp_message_t sdmp_batch;
+static uint16_t sdmp_batch_len = 0;
+static uint16_t sdmp_batch_seq = 0;     // batches sent, tell if a mark is stale
+
+/* Script is executed by statement as chunks arrive, unfinished tail is held
+ * in a buffer of CUPKEE_SDMP_SCRIPT_TAIL_MAX, till the last chunk.
+ */
+static uint16_t sdmp_script_len = 0;
+static uint8_t  sdmp_script_next = 0;
 static char *   sdmp_script_buf = NULL;
 
+static int sdmp_script_execute(const char *script)
+{
+    return cupkee_execute_string(script, NULL);
+}
+
 static void (*sdmp_text_handler)(int, const void *) = NULL;
 static int (*sdmp_user_call_handler)(int, void *) = NULL;
 static int (*sdmp_user_query_handler)(uint16_t flags) = NULL;
+static int (*sdmp_script_executor)(const char *script) = sdmp_script_execute;
+
+/* Input chunk, the rest is held while response queue is full */
+static uint8_t  sdmp_recv_pos = 0;
+static uint8_t  sdmp_recv_end = 0;
+static uint8_t  sdmp_recv_buf[SDMP_RECV_CHUNK_SIZE];
 
-static int sdmp_request_filter(uint8_t);
+static int sdmp_demux(int n, const uint8_t *data);
 
+static inline int sdmp_response_is_full(void)
+{
+    return sdmp_response_num >= CUPKEE_SDMP_RESPONSE_QUEUE;
+}
+
+/* Input is parsed by chunk: text delivered by run, message copied in bulk
+ * Parse is paused while response queue is full, and resumed on drain.
+ */
 static void sdmp_do_recv(void *tty)
 {
-    uint8_t byte;
-    char buf[4];
-    int  pos = 0;
+    while (!sdmp_response_is_full()) {
+        if (sdmp_recv_pos >= sdmp_recv_end) {
+            int n = cupkee_read(tty, SDMP_RECV_CHUNK_SIZE, sdmp_recv_buf);
 
-    while (0 < cupkee_read(tty, 1, &byte)) {
-        if (sdmp_request_filter(byte)) {
-            buf[pos++] = byte;
-            if (pos >= 3 && sdmp_text_handler) {
-                sdmp_text_handler(pos, buf);
-                pos = 0;
+            if (n <= 0) {
+                break;
             }
+            sdmp_recv_pos = 0;
+            sdmp_recv_end = n;
         }
+
+        sdmp_recv_pos += sdmp_demux(sdmp_recv_end - sdmp_recv_pos, sdmp_recv_buf + sdmp_recv_pos);
     }
+}
 
-    if (pos && sdmp_text_handler) {
-        sdmp_text_handler(pos, buf);
+static void *sdmp_queue_shift(void **queue, uint8_t *num)
+{
+    void *msg;
+
+    if (*num == 0) {
+        return NULL;
+    }
+
+    msg = queue[0];
+    if (--*num) {
+        memmove(queue, queue + 1, *num * sizeof(void *));
     }
+
+    return msg;
 }
 
-static void sdmp_do_send(void *tty)
+static void sdmp_queue_clear(void)
 {
-    uint8_t c;
+    void *msg;
 
-    // Send report first
-    if (sdmp_message_pos < sdmp_message_end) {
-        uint8_t *buf = sdmp_message_buf + sdmp_message_pos;
-        int len = sdmp_message_end - sdmp_message_pos;
-        int retval = cupkee_write(tty, len, buf);
+    cupkee_buffer_release(sdmp_message_sending);
+    sdmp_message_sending = NULL;
+
+    while (NULL != (msg = sdmp_queue_shift(sdmp_response_queue, &sdmp_response_num))) {
+        cupkee_buffer_release(msg);
+    }
+    while (NULL != (msg = sdmp_queue_shift(sdmp_report_queue, &sdmp_report_num))) {
+        cupkee_buffer_release(msg);
+    }
+}
+
+static void *sdmp_window_read_next(void);
+
+static inline void *sdmp_message_next(void)
+{
+    if (sdmp_response_num) {
+        return sdmp_queue_shift(sdmp_response_queue, &sdmp_response_num);
+    } else
+    if (sdmp_window_rd_mask) {
+        return sdmp_window_read_next();
+    } else {
+        return sdmp_queue_shift(sdmp_report_queue, &sdmp_report_num);
+    }
+}
+
+/* Write out as much as the stream take, a message in sending is never interrupted */
+static int sdmp_write_buf(void *tty, void *buf)
+{
+    void *ptr;
+    int n;
+
+    while (0 < (n = cupkee_buffer_data_window(buf, &ptr))) {
+        int retval = cupkee_write(tty, n, ptr);
 
         if (retval <= 0) {
-            return;
+            return 0;
         }
+        cupkee_buffer_consume(buf, retval);
+    }
 
-        sdmp_message_pos += retval;
-        if (retval < len) {
+    return 1;
+}
+
+static void sdmp_do_send(void *tty)
+{
+    while (sdmp_message_sending || NULL != (sdmp_message_sending = sdmp_message_next())) {
+        if (!sdmp_write_buf(tty, sdmp_message_sending)) {
             return;
         }
+
+        cupkee_buffer_release(sdmp_message_sending);
+        sdmp_message_sending = NULL;
     }
 
-    // Send text
-    while (cupkee_buffer_shift(sdmp_mux_text_buf, &c)) {
-        if (!cupkee_write(tty, 1, &c)) {
-            cupkee_buffer_unshift(sdmp_mux_text_buf, c);
-            break;
-        }
+    // Send text, when no message wait
+    if (sdmp_mux_text_buf) {
+        sdmp_write_buf(tty, sdmp_mux_text_buf);
     }
 }
 
-static inline int sdmp_message_init(sdmp_message_t *msg, uint8_t code, uint8_t param_size, uint8_t data_size)
+static int sdmp_message_init(sdmp_message_t *msg, uint8_t code, size_t param_size, size_t data_size)
 {
     size_t body_size = param_size + data_size;
     size_t total_size = SDMP_HEAD_SIZE + 1 + body_size;
     uint8_t *head;
 
-    if (sdmp_message_pos == sdmp_message_end) {
-        sdmp_message_pos = 0;
-        sdmp_message_end = 0;
+    if (body_size >= SDMP_BODY_MAX_SIZE) {
+        return 0; // false
     }
 
-    if (sdmp_message_end + total_size > SDMP_MSG_BUF_SIZE) {
+    if (NULL == (msg->buf = cupkee_buffer_alloc(total_size))) {
         return 0; // false
     }
+    cupkee_buffer_extend(msg->buf, total_size);
 
-    head = sdmp_message_buf + sdmp_message_end;
+    head = cupkee_buffer_ptr(msg->buf);
     head[0] = SDMP_SYNC_BYTE;
     head[1] = 0x00;
-    head[2] = body_size;
-    head[3] = ~(SDMP_SYNC_BYTE+ body_size) + 1; // CheckSum
 
     head[4] = code;
     msg->param = head + SDMP_HEAD_SIZE + 1;
@@ -173,12 +267,63 @@ static inline int sdmp_message_init(sdmp_message_t *msg, uint8_t code, uint8_t p
     return total_size; // ok
 }
 
-static inline void sdmp_message_send(int len)
+/* Fill body size and checksum, message may be cut shorter than initialized */
+static void sdmp_message_finish(sdmp_message_t *msg, int len)
+{
+    uint8_t *head = msg->param - SDMP_HEAD_SIZE - 1;
+    uint8_t body_size = len - SDMP_HEAD_SIZE - 1;
+
+    cupkee_buffer_extend(msg->buf, len - cupkee_buffer_length(msg->buf));
+
+    head[2] = body_size;
+    head[3] = ~(SDMP_SYNC_BYTE + body_size) + 1; // CheckSum
+}
+
+static void sdmp_message_send(sdmp_message_t *msg, int len)
 {
-    sdmp_message_end += len;
+    sdmp_message_finish(msg, len);
+
+    // Never full here: one response per request, input is held while queue is full
+    if (!sdmp_response_is_full()) {
+        sdmp_response_queue[sdmp_response_num++] = msg->buf;
+    } else {
+        cupkee_buffer_release(msg->buf);
+    }
+
     sdmp_do_send(sdmp_io_stream);
 }
 
+/* Pending report of the same state is replaced, only the latest value is sent */
+static int sdmp_report_send(sdmp_message_t *msg, int len)
+{
+    uint8_t code = msg->param[-1];
+    uint8_t id = msg->param[0];
+    int i;
+
+    sdmp_message_finish(msg, len);
+
+    // Batch is never replaced
+    for (i = 0; code == SDMP_REPORT && i < sdmp_report_num; i++) {
+        uint8_t *head = cupkee_buffer_ptr(sdmp_report_queue[i]);
+
+        if (head[SDMP_HEAD_SIZE] == SDMP_REPORT && head[SDMP_HEAD_SIZE + 1] == id) {
+            cupkee_buffer_release(sdmp_report_queue[i]);
+            sdmp_report_queue[i] = msg->buf;
+            return 0;
+        }
+    }
+
+    if (sdmp_report_num >= CUPKEE_SDMP_REPORT_QUEUE) {
+        cupkee_buffer_release(msg->buf);
+        return -CUPKEE_EBUSY;
+    }
+
+    sdmp_report_queue[sdmp_report_num++] = msg->buf;
+    sdmp_do_send(sdmp_io_stream);
+
+    return 0;
+}
+
 static void sdmp_response_status(uint8_t req, uint8_t err)
 {
     sdmp_message_t msg;
@@ -188,7 +333,7 @@ static void sdmp_response_status(uint8_t req, uint8_t err)
         msg.param[0] = req;
         msg.param[1] = err;
 
-        sdmp_message_send(len);
+        sdmp_message_send(&msg, len);
     }
 }
 
@@ -199,7 +344,8 @@ static inline void sdmp_script_buf_free(void)
         sdmp_script_buf = NULL;
     }
 
-    sdmp_script_buf_size = 0;
+    sdmp_script_len = 0;
+    sdmp_script_next = 0;
 }
 
 static void sdmp_response_cont(uint8_t req, uint8_t next)
@@ -212,7 +358,7 @@ static void sdmp_response_cont(uint8_t req, uint8_t next)
         msg.param[1] = SDMP_CONT;
         msg.param[2] = next;
 
-        sdmp_message_send(len);
+        sdmp_message_send(&msg, len);
     }
 }
 
@@ -258,7 +404,7 @@ static void sdmp_hello(void)
         msg.param[1] = SDMP_CONT;
         msg.param[2] = SDMP_VERSION;
 
-        sdmp_message_send(len);
+        sdmp_message_send(&msg, len);
     }
 }
 
@@ -274,17 +420,68 @@ static void sdmp_query_sysinfo(void)
         cupkee_sysinfo_get(msg.param + 2);
         memcpy(msg.param + 2 + CUPKEE_INFO_SIZE, sdmp_app_interface, CUPKEE_UID_SIZE);
 
-        sdmp_message_send(len);
+        sdmp_message_send(&msg, len);
     } else {
         sdmp_response_status(SDMP_REQ_QUERY_SYSINFO, SDMP_MemNotEnought);
     }
 }
 
+static inline uint8_t *sdmp_put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t) (v >> 8);
+    p[1] = (uint8_t) (v);
+    return p + 2;
+}
+
+static inline uint8_t *sdmp_put_u32(uint8_t *p, uint32_t v)
+{
+    return sdmp_put_u16(sdmp_put_u16(p, v >> 16), v);
+}
+
+/* CRC-16/CCITT: poly 0x1021, init 0xffff */
+static uint16_t sdmp_crc16(const uint8_t *data, size_t n)
+{
+    uint16_t crc = 0xffff;
+
+    while (n--) {
+        int i;
+
+        crc ^= (uint16_t) (*data++) << 8;
+        for (i = 0; i < 8; i++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+/* Response param: code, status, sector, block, crc16, data: block content */
+static int sdmp_sysdata_block(sdmp_message_t *msg, uint8_t code, uint8_t sector, uint8_t block)
+{
+    int len;
+
+    if ((len = sdmp_message_init(msg, SDMP_RESPONSE, 6, CUPKEE_BLOCK_SIZE)) > 0) {
+        msg->param[0] = code;
+        msg->param[1] = SDMP_OK;
+        msg->param[2] = sector;
+        msg->param[3] = block;
+
+        if (0 != cupkee_storage_block_read(sector, block, msg->data)) {
+            msg->param[1] = SDMP_Unreadable;
+            msg->param[4] = 0;
+            msg->param[5] = 0;
+            len -= CUPKEE_BLOCK_SIZE;
+        } else {
+            sdmp_put_u16(msg->param + 4, sdmp_crc16(msg->data, CUPKEE_BLOCK_SIZE));
+        }
+    }
+
+    return len;
+}
+
 static void sdmp_query_sysdata(uint16_t req_len, uint8_t *req)
 {
     sdmp_message_t msg;
-    uint8_t sector;
-    uint8_t block;
     int len;
 
     if (req_len < 3) {
@@ -292,23 +489,163 @@ static void sdmp_query_sysdata(uint16_t req_len, uint8_t *req)
         return;
     }
 
-    sector = req[1];
-    block  = req[2];
+    if ((len = sdmp_sysdata_block(&msg, SDMP_REQ_QUERY_SYSDATA, req[1], req[2])) > 0) {
+        sdmp_message_send(&msg, len);
+    } else {
+        sdmp_response_status(SDMP_REQ_QUERY_SYSDATA, SDMP_MemNotEnought);
+    }
+}
 
-    if ((len = sdmp_message_init(&msg, SDMP_RESPONSE, 6, CUPKEE_BLOCK_SIZE)) > 0) {
-        msg.param[0] = SDMP_REQ_QUERY_SYSDATA;
-        msg.param[1] = SDMP_OK;
-        msg.param[2] = sector;
-        msg.param[3] = block;
-        msg.param[4] = 0;
-        msg.param[5] = 0;
+/* Return first block of window, or -1 if window is invalid */
+static int sdmp_window_start(uint8_t sector, uint8_t block, uint8_t num)
+{
+    int start = sector * SDMP_SECTOR_BLOCKS + block;
 
-        if (0 != cupkee_storage_block_read(sector, block, msg.data)) {
-            msg.param[1] = SDMP_Unreadable;
-            len -= CUPKEE_BLOCK_SIZE;
+    if (block >= SDMP_SECTOR_BLOCKS || num == 0 || num > SDMP_WINDOW_MAX) {
+        return -1;
+    }
+
+    return start;
+}
+
+static inline uint32_t sdmp_window_bits(uint8_t num)
+{
+    return num < 32 ? (1U << num) - 1 : 0xffffffff;
+}
+
+/* Block of read window, sent when no other response wait
+ * status is SDMP_CONT for all but the last block of window
+ */
+static void *sdmp_window_read_next(void)
+{
+    sdmp_message_t msg;
+    int i = 0, at, len;
+
+    while (!(sdmp_window_rd_mask & (1U << i))) {
+        i++;
+    }
+    at = sdmp_window_rd_start + i;
+
+    len = sdmp_sysdata_block(&msg, SDMP_REQ_READ_SYSDATA_WINDOW, at / SDMP_SECTOR_BLOCKS, at % SDMP_SECTOR_BLOCKS);
+    if (len <= 0) {
+        // Give up, host request the window again on timeout
+        sdmp_window_rd_mask = 0;
+        return NULL;
+    }
+
+    if (msg.param[1] != SDMP_OK) {
+        sdmp_window_rd_mask = 0;
+    } else {
+        sdmp_window_rd_mask &= ~(1U << i);
+        if (sdmp_window_rd_mask) {
+            msg.param[1] = SDMP_CONT;
+        }
+    }
+
+    sdmp_message_finish(&msg, len);
+    return msg.buf;
+}
+
+/* Request param: sector, block, num, [mask: u32]
+ * Blocks selected by mask (all if absent) are streamed without ack,
+ * host ask the corrupted or lost ones again with a mask.
+ */
+static void sdmp_read_sysdata_window(uint16_t req_len, uint8_t *req)
+{
+    uint32_t mask;
+    int start;
+
+    if (req_len < 4 || (start = sdmp_window_start(req[1], req[2], req[3])) < 0) {
+        sdmp_response_status(SDMP_REQ_READ_SYSDATA_WINDOW, SDMP_InvalidParam);
+        return;
+    }
+
+    mask = sdmp_window_bits(req[3]);
+    if (req_len >= 8) {
+        mask &= ((uint32_t)req[4] << 24) | ((uint32_t)req[5] << 16) | ((uint32_t)req[6] << 8) | req[7];
+    }
+
+    if (!mask) {
+        sdmp_response_status(SDMP_REQ_READ_SYSDATA_WINDOW, SDMP_InvalidParam);
+        return;
+    }
+
+    sdmp_window_rd_start = start;
+    sdmp_window_rd_mask = mask;
+
+    sdmp_do_send(sdmp_io_stream);
+}
+
+/* Response param: code, status, sector, block, num, mask of blocks written: u32 */
+static void sdmp_window_write_ack(uint8_t *req, uint8_t status)
+{
+    sdmp_message_t msg;
+    int len;
+
+    if ((len = sdmp_message_init(&msg, SDMP_RESPONSE, 9, 0)) > 0) {
+        msg.param[0] = SDMP_REQ_WRITE_SYSDATA_WINDOW;
+        msg.param[1] = status;
+        msg.param[2] = req[1];
+        msg.param[3] = req[2];
+        msg.param[4] = req[3];
+        sdmp_put_u32(msg.param + 5, sdmp_window_wr_mask);
+
+        sdmp_message_send(&msg, len);
+    } else {
+        sdmp_response_status(SDMP_REQ_WRITE_SYSDATA_WINDOW, SDMP_MemNotEnought);
+    }
+}
+
+/* Request param: sector, block, num, index | SDMP_WINDOW_ACK, crc16, data: block content
+ * or without crc and data, to ask the window status only.
+ * Blocks with bad crc are dropped silently, the status tell host which to send again.
+ */
+static void sdmp_write_sysdata_window(uint16_t req_len, uint8_t *req)
+{
+    uint8_t index, ack;
+    int start;
+
+    if ((req_len != 5 && req_len != 7 + CUPKEE_BLOCK_SIZE) ||
+        (start = sdmp_window_start(req[1], req[2], req[3])) < 0) {
+        sdmp_response_status(SDMP_REQ_WRITE_SYSDATA_WINDOW, SDMP_InvalidParam);
+        return;
+    }
+
+    index = req[4] & ~SDMP_WINDOW_ACK;
+    ack = req_len == 5 || (req[4] & SDMP_WINDOW_ACK);
+
+    if (start != sdmp_window_wr_start || req[3] != sdmp_window_wr_num) {
+        sdmp_window_wr_start = start;
+        sdmp_window_wr_num = req[3];
+        sdmp_window_wr_mask = 0;
+    }
+
+    if (req_len > 5) {
+        uint8_t *data = req + 7;
+        uint32_t bit;
+
+        if (index >= sdmp_window_wr_num) {
+            sdmp_response_status(SDMP_REQ_WRITE_SYSDATA_WINDOW, SDMP_InvalidParam);
+            return;
         }
+        bit = 1U << index;
+
+        if (!(sdmp_window_wr_mask & bit) &&
+            sdmp_crc16(data, CUPKEE_BLOCK_SIZE) == (req[5] << 8 | req[6])) {
+            int at = start + index;
 
-        sdmp_message_send(len);
+            if (0 > cupkee_storage_block_write(at / SDMP_SECTOR_BLOCKS, at % SDMP_SECTOR_BLOCKS, data)) {
+                sdmp_window_write_ack(req, SDMP_Unwriteable);
+                return;
+            }
+            sdmp_window_wr_mask |= bit;
+        }
+    }
+
+    if (ack) {
+        int done = sdmp_window_wr_mask == sdmp_window_bits(sdmp_window_wr_num);
+
+        sdmp_window_write_ack(req, done ? SDMP_OK : SDMP_CONT);
     }
 }
 
@@ -324,10 +661,10 @@ static void sdmp_execute_func(uint16_t req_len, uint8_t *req)
         cupkee_data_init(&args, req_len - 2, req + 2);
 
         msg.param[0] = SDMP_REQ_EXECUTE_FUNC;
-        msg.param[2] = sdmp_do_call(func_id, &args);
+        msg.param[1] = sdmp_do_call(func_id, &args);
         msg.param[2] = func_id;
 
-        sdmp_message_send(len);
+        sdmp_message_send(&msg, len);
     } else {
         sdmp_response_status(SDMP_REQ_EXECUTE_FUNC, SDMP_InvalidParam);
     }
@@ -352,7 +689,7 @@ static void sdmp_erase_sysdata(uint16_t req_len, uint8_t *req)
             msg.param[1] = SDMP_OK;
         }
 
-        sdmp_message_send(len);
+        sdmp_message_send(&msg, len);
     } else {
         sdmp_response_status(SDMP_REQ_ERASE_SYSDATA, SDMP_InvalidParam);
     }
@@ -373,7 +710,6 @@ static void sdmp_write_sysdata(uint16_t req_len, uint8_t *req)
 
     sector = req[1];
     block  = req[2];
-    // checkSum == req[3] * 256 + req[4]
     data = req + 5;
 
     if ((len = sdmp_message_init(&msg, SDMP_RESPONSE, 4, 0)) > 0) {
@@ -382,19 +718,174 @@ static void sdmp_write_sysdata(uint16_t req_len, uint8_t *req)
         msg.param[2] = sector;
         msg.param[3] = block;
 
+        // checkSum: crc16 of data, req[3] * 256 + req[4]
+        if (sdmp_crc16(data, CUPKEE_BLOCK_SIZE) != (req[3] << 8 | req[4])) {
+            msg.param[1] = SDMP_InvalidContent;
+        } else
         if (0 > cupkee_storage_block_write(sector, block, data)) {
             msg.param[1] = SDMP_Unwriteable;
         }
 
-        sdmp_message_send(len);
+        sdmp_message_send(&msg, len);
+    } else {
+        sdmp_response_status(SDMP_REQ_WRITE_SYSDATA, SDMP_MemNotEnought);
+    }
+}
+
+static inline int sdmp_script_is_word(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '$';
+}
+
+static inline int sdmp_script_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* Statement may go on after a closing brace: if {} else {}, try {} catch {}, do {} while () */
+static int sdmp_script_is_continue(const char *word, int n)
+{
+    static const char *words[] = {"else", "catch", "finally", "while"};
+    unsigned i;
+
+    for (i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        if ((int) strlen(words[i]) == n && !memcmp(words[i], word, n)) {
+            return 1;
+        }
     }
+    return 0;
+}
+
+/* Return length of complete top level statements in head of script
+ *
+ * A statement end at ';' or '}' out of any bracket, string and comment,
+ * unless the next word go on with it: if () x; else y;
+ * Text after an end not yet decided is left to next chunk.
+ */
+static int sdmp_script_complete(const char *s, int n)
+{
+    int depth = 0, done = 0, end = 0, brace = 0;
+    int i = 0;
+
+    while (i < n) {
+        char c = s[i];
+
+        if (c == '/' && i + 1 < n && s[i + 1] == '/') {
+            const char *eol = memchr(s + i, '\n', n - i);
+
+            if (!eol) {
+                break;
+            }
+            i = eol - s + 1;
+            continue;
+        }
+
+        if (c == '/' && i + 1 < n && s[i + 1] == '*') {
+            for (i += 2; i + 1 < n && !(s[i] == '*' && s[i + 1] == '/'); i++)
+                ;
+            if (i + 1 >= n) {
+                break;
+            }
+            i += 2;
+            continue;
+        }
+
+        // Decide the last end by next word: '}' should be followed by a word
+        if (end && !sdmp_script_is_space(c)) {
+            if (sdmp_script_is_word(c)) {
+                int w = i;
+
+                while (w < n && sdmp_script_is_word(s[w])) {
+                    w++;
+                }
+                if (w >= n) {
+                    break;
+                }
+                if (!sdmp_script_is_continue(s + i, w - i)) {
+                    done = end;
+                }
+            } else
+            if (!brace) {
+                done = end;
+            }
+            end = 0;
+        }
+
+        if (c == '"' || c == '\'') {
+            for (i++; i < n && s[i] != c; i++) {
+                if (s[i] == '\\') {
+                    i++;
+                }
+            }
+            if (i++ >= n) {
+                break;
+            }
+            continue;
+        }
+
+        if (c == '(' || c == '[' || c == '{') {
+            depth++;
+        } else
+        if (c == ')' || c == ']' || c == '}') {
+            if (--depth == 0 && c == '}') {
+                end = i + 1;
+                brace = 1;
+            }
+        } else
+        if (c == ';' && depth == 0) {
+            end = i + 1;
+            brace = 0;
+        }
+        i++;
+    }
+
+    return done;
+}
+
+/* Append chunk to the tail, execute statements completed, return SDMP status */
+static int sdmp_script_feed(int n, const uint8_t *text, int last)
+{
+    int total = sdmp_script_len + n;
+    int done;
+    char *buf;
+
+    // Terminator of statements executed take one byte
+    if (total >= CUPKEE_SDMP_SCRIPT_TAIL_MAX) {
+        return SDMP_MemNotEnought;
+    }
+
+    if (!sdmp_script_buf && NULL == (sdmp_script_buf = cupkee_malloc(CUPKEE_SDMP_SCRIPT_TAIL_MAX))) {
+        return SDMP_MemNotEnought;
+    }
+    buf = sdmp_script_buf;
+
+    memcpy(buf + sdmp_script_len, text, n);
+    sdmp_script_len = total;
+
+    done = last ? total : sdmp_script_complete(buf, total);
+    if (done > 0) {
+        char c = buf[done];
+        int retval;
+
+        buf[done] = 0;
+        retval = sdmp_script_executor(buf);
+        buf[done] = c;
+
+        if (retval < 0) {
+            return SDMP_ExecuteError;
+        }
+
+        sdmp_script_len = total - done;
+        memmove(buf, buf + done, sdmp_script_len);
+    }
+
+    return SDMP_OK;
 }
 
 static void sdmp_execute_script(uint16_t req_len, uint8_t *req)
 {
-    uint8_t *script;
     uint8_t cur, next, end, len;
-    int offset, error;
+    int error;
 
     if (req_len <= 4) {
         error = SDMP_InvalidParam;
@@ -410,42 +901,24 @@ static void sdmp_execute_script(uint16_t req_len, uint8_t *req)
     }
 
     if (cur == 0) {
-        int total = end * 252;
         sdmp_script_buf_free();
-
-        sdmp_script_buf = cupkee_malloc(total);
-        if (!sdmp_script_buf) {
-            error = SDMP_MemNotEnought;
-            goto DO_ERROR;
-        }
-        sdmp_script_buf_size = total;
-
-        memset(sdmp_script_buf, 0, total);
-    }
-
-    script = req + 4;
-    offset = cur * 252;
-
-    if (!sdmp_script_buf || offset + len > sdmp_script_buf_size) {
+    } else
+    if (cur != sdmp_script_next) {
         sdmp_script_buf_free();
 
         error = SDMP_ProcessError;
         goto DO_ERROR;
-    } else {
-        memcpy(sdmp_script_buf + offset, script, len);
     }
 
     next = cur + 1;
-    if (next == end) {
-        if (0 > cupkee_execute_string(sdmp_script_buf, NULL)) {
-            sdmp_response_status(req[0], SDMP_ExecuteError);
-        } else {
-            sdmp_response_status(req[0], SDMP_OK);
-        }
-    } else {
-        sdmp_response_cont(req[0], next);
+    error = sdmp_script_feed(len, req + 4, next == end);
+    if (error != SDMP_OK || next == end) {
+        sdmp_script_buf_free();
+        goto DO_ERROR;
     }
 
+    sdmp_script_next = next;
+    sdmp_response_cont(req[0], next);
     return;
 
 DO_ERROR:
@@ -465,7 +938,7 @@ static void sdmp_query_interface(void)
 
         memcpy(ptr, sdmp_app_interface, CUPKEE_UID_SIZE);
 
-        sdmp_message_send(len);
+        sdmp_message_send(&msg, len);
     } else {
         sdmp_response_status(SDMP_REQ_QUERY_INTERFACE, SDMP_MemNotEnought);
     }
@@ -502,6 +975,56 @@ static void sdmp_write_appdata(uint16_t req_len, uint8_t *req)
     sdmp_response_status(req[0], SDMP_NotImplemented);
 }
 
+/* Response param:
+ *   pages, free, peak, malloc fails: u16, frag: u8
+ *   order num: u8, [free blocks: u16, fails: u16, allocs: u32] ...
+ *   class num: u8, [size, pages, inuse, peak, fails: u16] ...
+ */
+static void sdmp_query_meminfo(void)
+{
+    cupkee_memory_stat_t st;
+    sdmp_message_t msg;
+    int class_num = cupkee_memory_class_num();
+    int len, i;
+
+    len = 2 + 9 + 1 + CUPKEE_PAGE_ORDERR_MAX * 8 + 1 + class_num * 10;
+    if ((len = sdmp_message_init(&msg, SDMP_RESPONSE, len, 0)) > 0) {
+        uint8_t *p = msg.param + 2;
+
+        msg.param[0] = SDMP_REQ_QUERY_MEMINFO;
+        msg.param[1] = SDMP_OK;
+
+        cupkee_memory_stat(&st);
+        p = sdmp_put_u16(p, st.pages);
+        p = sdmp_put_u16(p, st.pages_free);
+        p = sdmp_put_u16(p, st.pages_peak);
+        p = sdmp_put_u16(p, st.malloc_fails);
+        *p++ = st.frag;
+
+        *p++ = CUPKEE_PAGE_ORDERR_MAX;
+        for (i = 0; i < CUPKEE_PAGE_ORDERR_MAX; i++) {
+            p = sdmp_put_u16(p, st.free_blocks[i]);
+            p = sdmp_put_u16(p, st.fails[i]);
+            p = sdmp_put_u32(p, st.allocs[i]);
+        }
+
+        *p++ = class_num;
+        for (i = 0; i < class_num; i++) {
+            const cupkee_slab_t *q = cupkee_memory_class(i);
+
+            p = sdmp_put_u16(p, q->size);
+            p = sdmp_put_u16(p, q->pages);
+            p = sdmp_put_u16(p, q->inuse);
+            p = sdmp_put_u16(p, q->peak);
+            p = sdmp_put_u16(p, q->fails);
+        }
+
+        sdmp_message_send(&msg, len);
+    } else {
+        sdmp_response_status(SDMP_REQ_QUERY_MEMINFO, SDMP_MemNotEnought);
+    }
+}
+
 static void sdmp_request_handler(uint16_t len, uint8_t *req)
 {
     uint8_t code = req[0];
@@ -521,6 +1044,9 @@ static void sdmp_request_handler(uint16_t len, uint8_t *req)
     case SDMP_REQ_QUERY_APPSTATE:   sdmp_query_appstate(len, req); break;
     case SDMP_REQ_QUERY_APPDATA:    sdmp_query_appdata(len, req); break;
     case SDMP_REQ_WRITE_APPDATA:    sdmp_write_appdata(len, req); break;
+    case SDMP_REQ_QUERY_MEMINFO:    sdmp_query_meminfo(); break;
+    case SDMP_REQ_READ_SYSDATA_WINDOW:  sdmp_read_sysdata_window(len, req); break;
+    case SDMP_REQ_WRITE_SYSDATA_WINDOW: sdmp_write_sysdata_window(len, req); break;
     default: sdmp_response_status(code, SDMP_InvalidReq);
     }
 }
@@ -534,21 +1060,25 @@ static int sdmp_request_head_verify(uint8_t *head)
     return (uint8_t) (head[0] + head[1] + head[2] + head[3]) == 0;
 }
 
-static int sdmp_request_filter(uint8_t byte)
+/* Take up to n bytes of message head or body, return bytes used */
+static int sdmp_demux_take(int n, const uint8_t *data)
 {
-    if (sdmp_demux_state == DEMUX_KEY) {
-        if (byte != SDMP_SYNC_BYTE) {
-            return 1;
-        } else {
-            sdmp_demux_state = DEMUX_MSG_HEAD;
-            sdmp_request_pos = 0;
-        }
-    }
+    int want;
 
     if (sdmp_demux_state == DEMUX_MSG_HEAD) {
-        sdmp_request_buf[sdmp_request_pos++] = byte;
+        want = SDMP_HEAD_SIZE - sdmp_request_pos;
+    } else {
+        want = sdmp_request_len + 1 - sdmp_request_pos;
+    }
+    if (want > n) {
+        want = n;
+    }
 
-        if (sdmp_request_pos >= 4) {
+    memcpy(sdmp_request_buf + sdmp_request_pos, data, want);
+    sdmp_request_pos += want;
+
+    if (sdmp_demux_state == DEMUX_MSG_HEAD) {
+        if (sdmp_request_pos >= SDMP_HEAD_SIZE) {
             if (sdmp_request_head_verify(sdmp_request_buf)) {
                 sdmp_request_len = sdmp_request_buf[2];
                 sdmp_request_pos = 0;
@@ -558,19 +1088,43 @@ static int sdmp_request_filter(uint8_t byte)
             }
         }
     } else
-    if (sdmp_demux_state == DEMUX_MSG_BODY) {
-        sdmp_request_buf[sdmp_request_pos++] = byte;
-        if (sdmp_request_pos > sdmp_request_len) {
-            sdmp_demux_state = DEMUX_KEY;
-            sdmp_request_handler(sdmp_request_pos,
-                                 sdmp_request_buf);
-        }
-    } else {
+    if (sdmp_request_pos > sdmp_request_len) {
         sdmp_demux_state = DEMUX_KEY;
-        return 1;
+        sdmp_request_handler(sdmp_request_pos, sdmp_request_buf);
     }
 
-    return 0;
+    return want;
+}
+
+/* Return bytes parsed, stop when response queue is full */
+static int sdmp_demux(int n, const uint8_t *data)
+{
+    int parsed = 0;
+
+    while (n > 0 && !sdmp_response_is_full()) {
+        int used;
+
+        if (sdmp_demux_state == DEMUX_KEY) {
+            const uint8_t *sync = memchr(data, SDMP_SYNC_BYTE, n);
+
+            used = sync ? sync - data : n;
+            if (used && sdmp_text_handler) {
+                sdmp_text_handler(used, data);
+            }
+            if (sync) {
+                sdmp_demux_state = DEMUX_MSG_HEAD;
+                sdmp_request_pos = 0;
+            }
+        } else {
+            used = sdmp_demux_take(n, data);
+        }
+
+        data += used;
+        n -= used;
+        parsed += used;
+    }
+
+    return parsed;
 }
 
 static int sdmp_stream_handle(void *tty, int event, intptr_t param)
@@ -582,22 +1136,48 @@ static int sdmp_stream_handle(void *tty, int event, intptr_t param)
     } else
     if (event == CUPKEE_EVENT_DRAIN) {
         sdmp_do_send(tty);
+        // Input held by full response queue
+        sdmp_do_recv(tty);
     }
 
     return 0;
 }
 
+/* Shrinker: text buffer is allocated again when needed */
+static size_t sdmp_shrink(size_t want)
+{
+    size_t n = 0;
+
+    (void) want;
+
+    if (sdmp_mux_text_buf && cupkee_buffer_is_empty(sdmp_mux_text_buf)) {
+        n = cupkee_buffer_capacity(sdmp_mux_text_buf);
+        cupkee_buffer_release(sdmp_mux_text_buf);
+        sdmp_mux_text_buf = NULL;
+    }
+
+    return n;
+}
+
 int cupkee_sdmp_init(void *stream)
 {
     sdmp_request_len = 0;
     sdmp_request_pos = 0;
     sdmp_demux_state = DEMUX_KEY;
+    sdmp_recv_pos = 0;
+    sdmp_recv_end = 0;
 
-    sdmp_message_pos = 0;
-    sdmp_message_end = 0;
+    sdmp_queue_clear();
 
-    sdmp_script_buf_size = 0;
-    sdmp_script_buf = NULL;
+    if (sdmp_batch_len) {
+        cupkee_buffer_release(sdmp_batch.buf);
+        sdmp_batch_len = 0;
+    }
+
+    sdmp_window_rd_mask = 0;
+    sdmp_window_wr_num = 0;
+
+    sdmp_script_buf_free();
 
     memset(sdmp_app_interface, 0, CUPKEE_UID_SIZE);
 
@@ -612,12 +1192,14 @@ int cupkee_sdmp_init(void *stream)
     cupkee_listen(stream, CUPKEE_EVENT_DATA);
     cupkee_listen(stream, CUPKEE_EVENT_DRAIN);
 
+    cupkee_buffer_release(sdmp_mux_text_buf);
     sdmp_mux_text_buf = cupkee_buffer_alloc(SDMP_SEND_BUF_SIZE);
     if (!sdmp_mux_text_buf) {
         return -CUPKEE_ERESOURCE;
     }
 
     sdmp_io_stream = stream;
+    cupkee_memory_shrinker(sdmp_shrink);
 
     return 0;
 }
@@ -626,7 +1208,13 @@ int cupkee_sdmp_tty_write(size_t len, const char *text)
 {
 
     if (sdmp_io_stream) {
-        int cached = cupkee_buffer_give(sdmp_mux_text_buf, len, text);
+        int cached;
+
+        if (!sdmp_mux_text_buf && !(sdmp_mux_text_buf = cupkee_buffer_alloc(SDMP_SEND_BUF_SIZE))) {
+            return -CUPKEE_ENOMEM;
+        }
+
+        cached = cupkee_buffer_give(sdmp_mux_text_buf, len, text);
 
         if (cached > 0 && (size_t) cached == cupkee_buffer_length(sdmp_mux_text_buf)) {
             sdmp_do_send(sdmp_io_stream);
@@ -677,20 +1265,26 @@ int cupkee_sdmp_set_query_handler(int (*handler)(uint16_t flags))
     return 0;
 }
 
+/* Script is executed by the shell, unless replaced. NULL to restore */
+int cupkee_sdmp_set_script_executor(int (*executor)(const char *script))
+{
+    sdmp_script_executor = executor ? executor : sdmp_script_execute;
+    return 0;
+}
+
 int cupkee_sdmp_update_state_trigger(int id)
 {
     sdmp_message_t msg;
     int len;
 
-    if ((len = sdmp_message_init(&msg, SDMP_REPORT, 2, 0))) {
+    if ((len = sdmp_message_init(&msg, SDMP_REPORT, 2, 0)) > 0) {
         msg.param[0] = id;
         msg.param[1] = CUPKEE_DATA_NONE;
 
-        sdmp_message_send(len);
-        return 0;
+        return sdmp_report_send(&msg, len);
     }
 
-    return CUPKEE_EBUSY;
+    return -CUPKEE_ENOMEM;
 }
 
 int cupkee_sdmp_update_state_boolean(int id, int v)
@@ -698,16 +1292,15 @@ int cupkee_sdmp_update_state_boolean(int id, int v)
     sdmp_message_t msg;
     int len;
 
-    if ((len = sdmp_message_init(&msg, SDMP_REPORT, 2, 1))) {
+    if ((len = sdmp_message_init(&msg, SDMP_REPORT, 2, 1)) > 0) {
         msg.param[0] = id;
         msg.param[1] = CUPKEE_DATA_BOOLEAN;
         msg.data[0] = v != 0;
 
-        sdmp_message_send(len);
-        return 0;
+        return sdmp_report_send(&msg, len);
     }
 
-    return CUPKEE_EBUSY;
+    return -CUPKEE_ENOMEM;
 }
 
 int cupkee_sdmp_update_state_number(int id, double v)
@@ -715,7 +1308,7 @@ int cupkee_sdmp_update_state_number(int id, double v)
     sdmp_message_t msg;
     int len;
 
-    if ((len = sdmp_message_init(&msg, SDMP_REPORT, 2, 8))) {
+    if ((len = sdmp_message_init(&msg, SDMP_REPORT, 2, 8)) > 0) {
         union {
             uint64_t u;
             double   d;
@@ -733,11 +1326,10 @@ int cupkee_sdmp_update_state_number(int id, double v)
         msg.data[6] = (uint8_t) (x->u >> 8);
         msg.data[7] = (uint8_t) (x->u);
 
-        sdmp_message_send(len);
-        return 0;
+        return sdmp_report_send(&msg, len);
     }
 
-    return CUPKEE_EBUSY;
+    return -CUPKEE_ENOMEM;
 }
 
 int cupkee_sdmp_update_state_string(int id, const char *s)
@@ -746,17 +1338,161 @@ int cupkee_sdmp_update_state_string(int id, const char *s)
     int data_len = strlen(s);
     int len;
 
-    if ((len = sdmp_message_init(&msg, SDMP_REPORT, 2, data_len))) {
+    if ((len = sdmp_message_init(&msg, SDMP_REPORT, 2, data_len)) > 0) {
         msg.param[0] = id;
         msg.param[1] = CUPKEE_DATA_STRING;
 
         memcpy(msg.data, s, data_len);
 
-        sdmp_message_send(len);
+        return sdmp_report_send(&msg, len);
+    }
+
+    return -CUPKEE_ENOMEM;
+}
+
+/* Space for item in batch, the batch in building is sent if it is full.
+ * The batch is kept if it could not be sent, the report queue is full.
+ */
+static int sdmp_batch_reserve(int id, size_t n, uint8_t **ptr)
+{
+    uint8_t *item;
+    int err;
+
+    if (id < 0 || id > 255 || SDMP_HEAD_SIZE + 1 + 1 + n > SDMP_BATCH_SIZE) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (sdmp_batch_len + 1 + n > SDMP_BATCH_SIZE && 0 != (err = cupkee_sdmp_batch_flush())) {
+        return err;
+    }
+
+    if (!sdmp_batch_len) {
+        if (0 >= sdmp_message_init(&sdmp_batch, SDMP_REPORT_BATCH, 0, SDMP_BATCH_SIZE - SDMP_HEAD_SIZE - 1)) {
+            return -CUPKEE_ENOMEM;
+        }
+        sdmp_batch_len = SDMP_HEAD_SIZE + 1;
+    }
+
+    item = sdmp_batch.param + (sdmp_batch_len - SDMP_HEAD_SIZE - 1);
+    item[0] = id;
+    sdmp_batch_len += 1 + n;
+
+    *ptr = item + 1;
+    return 0;
+}
+
+int cupkee_sdmp_batch_trigger(int id)
+{
+    uint8_t *p;
+    int err;
+
+    if (0 == (err = sdmp_batch_reserve(id, 1, &p))) {
+        p[0] = CUPKEE_DATA_NONE;
+    }
+    return err;
+}
+
+int cupkee_sdmp_batch_boolean(int id, int v)
+{
+    uint8_t *p;
+    int err;
+
+    if (0 == (err = sdmp_batch_reserve(id, 2, &p))) {
+        p[0] = CUPKEE_DATA_BOOLEAN;
+        p[1] = v != 0;
+    }
+    return err;
+}
+
+/* Number is packed in the shortest encoding keep its value */
+int cupkee_sdmp_batch_number(int id, double v)
+{
+    uint8_t data[CUPKEE_DATA_NUMBER_MAX];
+    int n = cupkee_data_put_number(data, v);
+    uint8_t *p;
+    int err;
+
+    if (0 == (err = sdmp_batch_reserve(id, n, &p))) {
+        memcpy(p, data, n);
+    }
+    return err;
+}
+
+int cupkee_sdmp_batch_string(int id, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    uint8_t *p;
+    int err;
+
+    if (0 == (err = sdmp_batch_reserve(id, 1 + n, &p))) {
+        p[0] = CUPKEE_DATA_STRING;
+        memcpy(p + 1, s, n);
+    }
+    return err;
+}
+
+/* -CUPKEE_EBUSY if report queue is full, the batch is kept to flush later */
+int cupkee_sdmp_batch_flush(void)
+{
+    int len = sdmp_batch_len;
+
+    if (!len) {
         return 0;
     }
 
-    return CUPKEE_ERESOURCE;
+    // Batch is never coalesced, a free slot is all it need
+    if (sdmp_report_num >= CUPKEE_SDMP_REPORT_QUEUE) {
+        return -CUPKEE_EBUSY;
+    }
+
+    sdmp_batch_len = 0;
+    sdmp_batch_seq++;
+    return sdmp_report_send(&sdmp_batch, len);
+}
+
+/* Room for n bytes of items in the batch in building, it is flushed first
+ * if no room. Items of n bytes appended then are sent in one frame.
+ */
+int cupkee_sdmp_batch_prepare(size_t n)
+{
+    if (SDMP_HEAD_SIZE + 1 + n > SDMP_BATCH_SIZE) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (sdmp_batch_len + n > SDMP_BATCH_SIZE) {
+        return cupkee_sdmp_batch_flush();
+    }
+
+    return 0;
+}
+
+/* Mark of the batch in building, items appended after it could be dropped
+ * by cupkee_sdmp_batch_rollback, unless they have been sent.
+ */
+int cupkee_sdmp_batch_mark(void)
+{
+    return (sdmp_batch_seq & 0x7fff) << 16 | sdmp_batch_len;
+}
+
+void cupkee_sdmp_batch_rollback(int mark)
+{
+    int len = mark & 0xffff;
+
+    // Sent since marked, drop what is appended after that
+    if ((mark >> 16) != (sdmp_batch_seq & 0x7fff)) {
+        len = 0;
+    }
+
+    if (len >= sdmp_batch_len) {
+        return;
+    }
+
+    if (len > SDMP_HEAD_SIZE + 1) {
+        sdmp_batch_len = len;
+    } else {
+        cupkee_buffer_release(sdmp_batch.buf);
+        sdmp_batch_len = 0;
+    }
 }
 
 static int char2hex(char c)
@@ -38,6 +38,9 @@ static int device_setup(void *entry, env_t *env, val_t *setting)
         if (val_is_number(val)) {
             cupkee_prop_set(entry, key, CUPKEE_OBJECT_ELEM_INT, val_2_integer(val));
         } else
+        if (val_is_boolean(val)) {
+            cupkee_prop_set(entry, key, CUPKEE_OBJECT_ELEM_BOOL, val_is_true(val));
+        } else
         if (val_is_array(val)){
             array_t *array = (array_t *)val_2_intptr(val);
             val_t   *elem;
@@ -435,21 +438,33 @@ static void device_map_data_proc(cupkee_device_t *dev, env_t *env, val_t *handle
     shell_do_callback(env, handle, 1, &info);
 }
 
+/* Data is read from the stream cache in place, and left there if no memory */
 static void device_data_proc(cupkee_device_t *dev, env_t *env, val_t *handle)
 {
-    size_t n;
+    type_buffer_t *b;
+    val_t data;
+    void *ptr;
+    int n, len, got;
 
-    if (0 == cupkee_device_io_cached(dev, &n, NULL) && n > 0) {
-        int err;
-        val_t data;
+    if (!dev->s || 0 >= (n = cupkee_stream_readable(dev->s))) {
+        return;
+    }
 
-        err = device_read_2_buffer(dev, env, n, &data);
-        if (err < 0) {
-            shell_do_callback_error(env, handle, err);
-        } else {
-            shell_do_callback(env, handle, 1, &data);
+    if (NULL == (b = buffer_create(env, n))) {
+        shell_do_callback_error(env, handle, -CUPKEE_ENOMEM);
+        return;
+    }
+
+    for (len = 0; len < n && 0 < (got = cupkee_device_read_reserve(dev, &ptr)); len += got) {
+        if (got > n - len) {
+            got = n - len;
         }
+        memcpy(b->buf + len, ptr, got);
+        cupkee_device_read_commit(dev, got);
     }
+
+    val_set_buffer(&data, b);
+    shell_do_callback(env, handle, 1, &data);
 }
 
 static void device_event_handle_wrap(cupkee_device_t *dev, uint8_t code, intptr_t param)
@@ -108,6 +108,92 @@ val_t native_report(env_t *env, int ac, val_t *av)
     }
 }
 
+static int report_batch_item(int id, val_t *v)
+{
+    if (!v) {
+        return cupkee_sdmp_batch_trigger(id);
+    } else
+    if (val_is_boolean(v)) {
+        return cupkee_sdmp_batch_boolean(id, val_is_true(v));
+    } else
+    if (val_is_number(v)) {
+        return cupkee_sdmp_batch_number(id, val_2_double(v));
+    } else {
+        const char *s = val_2_cstring(v);
+
+        return s ? cupkee_sdmp_batch_string(id, s) : -CUPKEE_EINVAL;
+    }
+}
+
+/* Bytes of item in batch: id, type, value */
+static int report_batch_item_size(int id, val_t *v)
+{
+    uint8_t data[CUPKEE_DATA_NUMBER_MAX];
+
+    if (id < 0 || id > 255) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!v) {
+        return 2;
+    } else
+    if (val_is_boolean(v)) {
+        return 3;
+    } else
+    if (val_is_number(v)) {
+        return 1 + cupkee_data_put_number(data, val_2_double(v));
+    } else {
+        const char *s = val_2_cstring(v);
+
+        return s ? 3 + strlen(s) : -CUPKEE_EINVAL;
+    }
+}
+
+/* reports(id, value, id, value, ...): report states in one message,
+ * an id without value is reported as trigger.
+ * All or nothing: items are checked and room is made before any appended,
+ * so none of them could be sent by a batch full half way.
+ */
+val_t native_report_batch(env_t *env, int ac, val_t *av)
+{
+    int i, n, size, mark;
+
+    (void) env;
+
+    if (ac < 1) {
+        return VAL_FALSE;
+    }
+
+    for (i = 0, size = 0; i < ac; i += 2, size += n) {
+        if (!val_is_number(av + i)) {
+            return VAL_FALSE;
+        }
+        n = report_batch_item_size(val_2_integer(av + i), i + 1 < ac ? av + i + 1 : NULL);
+        if (n < 0) {
+            return VAL_FALSE;
+        }
+    }
+
+    if (cupkee_sdmp_batch_prepare(size)) {
+        return VAL_FALSE;
+    }
+
+    mark = cupkee_sdmp_batch_mark();
+    for (i = 0; i < ac; i += 2) {
+        if (report_batch_item(val_2_integer(av + i), i + 1 < ac ? av + i + 1 : NULL)) {
+            goto DO_ROLLBACK;
+        }
+    }
+
+    if (0 == cupkee_sdmp_batch_flush()) {
+        return VAL_TRUE;
+    }
+
+DO_ROLLBACK:
+    cupkee_sdmp_batch_rollback(mark);
+    return VAL_FALSE;
+}
+
 val_t native_interface(env_t *env, int ac, val_t *av)
 {
     const char *id;
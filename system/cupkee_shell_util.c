@@ -200,6 +200,31 @@ void shell_print_error(int error)
     }
 }
 
+static void shell_memory_info(void)
+{
+    cupkee_memory_stat_t st;
+    int i, n = cupkee_memory_class_num();
+
+    cupkee_memory_stat(&st);
+
+    console_log_sync("=============================\r\n");
+    console_log_sync("Page: %d/%d, peak: %d, frag: %d%%, fails: %d\r\n",
+                     st.pages - st.pages_free, st.pages, st.pages_peak, st.frag, st.malloc_fails);
+
+    console_log_sync("Order(free/alloc/fail):");
+    for (i = 0; i < CUPKEE_PAGE_ORDERR_MAX; i++) {
+        console_log_sync(" %d/%lu/%d", st.free_blocks[i], (unsigned long)st.allocs[i], st.fails[i]);
+    }
+    console_log_sync("\r\n");
+
+    console_log_sync("Block(size:inuse/peak):");
+    for (i = 0; i < n; i++) {
+        const cupkee_slab_t *q = cupkee_memory_class(i);
+        console_log_sync(" %d:%d/%d", q->size, q->inuse, q->peak);
+    }
+    console_log_sync("\r\n");
+}
+
 val_t native_sysinfos(env_t *env, int ac, val_t *av)
 {
     hw_info_t hw;
@@ -220,6 +245,8 @@ val_t native_sysinfos(env_t *env, int ac, val_t *av)
     console_log_sync("Function: %d/%d, ", env->exe.func_num, env->exe.func_max);
     console_log_sync("Variable: %d\r\n", env->main_var_num);
 
+    shell_memory_info();
+
     return val_mk_undefined();
 }
 
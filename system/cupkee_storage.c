@@ -109,6 +109,10 @@ int cupkee_storage_block_write(uint32_t sector, uint32_t block, const uint8_t *d
 {
     intptr_t base = hw_storage_base() + sector * CUPKEE_SECTOR_SIZE;
 
+    if (sector >= sector_total_num) {
+        return -CUPKEE_EINVAL;
+    }
+
     base += block * CUPKEE_BLOCK_SIZE;
 
     //console_log("write sector: %x, %x\r\n", base, CUPKEE_BLOCK_SIZE);
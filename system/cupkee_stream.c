@@ -35,12 +35,34 @@ static inline int stream_tx_request(cupkee_stream_t *s) {
     return s->_write(s, 0, NULL);
 }
 
+/* Caches are movable, compactor keep s->rx_buf & s->tx_buf up to date.
+ * Pointers got from the windows are valid till commit, which should be
+ * called in the same context.
+ */
+static inline void *stream_cache_set(void **cache, void *buf)
+{
+    if ((*cache = buf) != NULL) {
+        cupkee_buffer_ref(buf, cache);
+    }
+    return buf;
+}
+
+static inline void *stream_cache_out(void **cache)
+{
+    void *buf = *cache;
+
+    *cache = NULL;
+    cupkee_buffer_ref(buf, NULL);
+
+    return buf;
+}
+
 static inline void *stream_tx_cache(cupkee_stream_t *s)
 {
     if (s->tx_buf) {
         return s->tx_buf;
     } else {
-        return (s->tx_buf = cupkee_buffer_alloc(s->tx_buf_size));
+        return stream_cache_set(&s->tx_buf, cupkee_buffer_alloc_movable(s->tx_buf_size));
     }
 }
 
@@ -49,8 +71,130 @@ static inline void *stream_rx_cache(cupkee_stream_t *s)
     if (s->rx_buf) {
         return s->rx_buf;
     } else {
-        return (s->rx_buf = cupkee_buffer_alloc(s->rx_buf_size));
+        return stream_cache_set(&s->rx_buf, cupkee_buffer_alloc_movable(s->rx_buf_size));
+    }
+}
+
+static inline int stream_is_adaptive(cupkee_stream_t *s) {
+    return s->flags & CUPKEE_STREAM_FL_ADAPTIVE;
+}
+
+static inline size_t stream_rx_watermark(cupkee_stream_t *s) {
+    return s->rx_watermark ? s->rx_watermark : s->rx_buf_size / 2 + 1;
+}
+
+static inline void stream_drops_add(uint16_t *drops, size_t n) {
+    *drops = (*drops + n > 0xffff) ? 0xffff : *drops + n;
+}
+
+static void stream_rx_notify(cupkee_stream_t *s)
+{
+    size_t len = cupkee_buffer_length(s->rx_buf);
+
+    if (s->flags & CUPKEE_STREAM_FL_NOTIFY_DATA && len >= stream_rx_watermark(s)) {
+        cupkee_object_event_post(s->id, CUPKEE_EVENT_DATA);
+    }
+    if (len > s->rx_peak) {
+        s->rx_peak = len;
+    }
+    s->last_push = _cupkee_systicks;
+}
+
+static void *stream_cache_resize(void *cache, size_t size)
+{
+    void *buf, *ptr;
+    size_t n;
+
+    if (size < cupkee_buffer_length(cache) || !(buf = cupkee_buffer_alloc_movable(size))) {
+        return NULL;
+    }
+
+    while (0 < (n = cupkee_buffer_data_window(cache, &ptr))) {
+        cupkee_buffer_give(buf, n, ptr);
+        cupkee_buffer_consume(cache, n);
+    }
+    cupkee_buffer_release(cache);
+
+    return buf;
+}
+
+static size_t stream_size_grow(size_t size, size_t want)
+{
+    while (size < want && size < CUPKEE_STREAM_BUF_MAX) {
+        size *= 2;
+    }
+    return size < CUPKEE_STREAM_BUF_MAX ? size : CUPKEE_STREAM_BUF_MAX;
+}
+
+static int stream_rx_grow(cupkee_stream_t *s, size_t want)
+{
+    size_t size = stream_size_grow(s->rx_buf_size, cupkee_buffer_length(s->rx_buf) + want);
+    void *buf;
+
+    if (size <= s->rx_buf_size || !(buf = stream_cache_resize(s->rx_buf, size))) {
+        return 0;
+    }
+    stream_cache_set(&s->rx_buf, buf);
+    s->rx_buf_size = size;
+
+    return 1;
+}
+
+static int stream_tx_grow(cupkee_stream_t *s, size_t want)
+{
+    size_t size = stream_size_grow(s->tx_buf_size, cupkee_buffer_length(s->tx_buf) + want);
+    void *buf;
+
+    if (size <= s->tx_buf_size || !(buf = stream_cache_resize(s->tx_buf, size))) {
+        return 0;
+    }
+    stream_cache_set(&s->tx_buf, buf);
+    s->tx_buf_size = size;
+
+    return 1;
+}
+
+static size_t stream_size_shrink(size_t size, size_t base, size_t peak, size_t drops)
+{
+    // Halve the cache, if less than a quarter used and nothing dropped in last period
+    if (size > base && peak * 4 <= size && !drops) {
+        size /= 2;
+    }
+    return size > base ? size : base;
+}
+
+static void stream_adapt(cupkee_stream_t *s, uint32_t systicks)
+{
+    size_t size;
+    void *buf;
+
+    size = stream_size_shrink(s->rx_buf_size, s->rx_buf_base, s->rx_peak, s->rx_drops);
+    if (size < s->rx_buf_size) {
+        if (!s->rx_buf) {
+            s->rx_buf_size = size;
+        } else
+        if (NULL != (buf = stream_cache_resize(s->rx_buf, size))) {
+            stream_cache_set(&s->rx_buf, buf);
+            s->rx_buf_size = size;
+        }
+    }
+
+    size = stream_size_shrink(s->tx_buf_size, s->tx_buf_base, s->tx_peak, s->tx_drops);
+    if (size < s->tx_buf_size) {
+        if (!s->tx_buf) {
+            s->tx_buf_size = size;
+        } else
+        if (NULL != (buf = stream_cache_resize(s->tx_buf, size))) {
+            stream_cache_set(&s->tx_buf, buf);
+            s->tx_buf_size = size;
+        }
     }
+
+    s->rx_peak = s->rx_buf ? cupkee_buffer_length(s->rx_buf) : 0;
+    s->tx_peak = s->tx_buf ? cupkee_buffer_length(s->tx_buf) : 0;
+    s->rx_drops = 0;
+    s->tx_drops = 0;
+    s->adapt_stamp = systicks;
 }
 
 int cupkee_stream_init(
@@ -80,11 +224,72 @@ int cupkee_stream_init(
     }
     s->id = id;
     s->rx_state = CUPKEE_STREAM_STATE_IDLE;
+    s->rx_idle = CUPKEE_STREAM_IDLE_TICKS;
+    s->rx_buf_base = s->rx_buf_size;
+    s->tx_buf_base = s->tx_buf_size;
 
     s->flags = flags;
     return 0;
 }
 
+void cupkee_stream_set_watermark(cupkee_stream_t *s, size_t level, uint32_t idle)
+{
+    if (s) {
+        s->rx_watermark = level < s->rx_buf_size ? level : s->rx_buf_size;
+        s->rx_idle = idle < 0xffff ? idle : 0xffff;
+    }
+}
+
+void cupkee_stream_set_adaptive(cupkee_stream_t *s, int enable)
+{
+    if (s) {
+        if (enable) {
+            s->flags |= CUPKEE_STREAM_FL_ADAPTIVE;
+            s->adapt_stamp = _cupkee_systicks;
+        } else {
+            s->flags &= ~CUPKEE_STREAM_FL_ADAPTIVE;
+        }
+    }
+}
+
+static size_t stream_cache_drop(void **cache)
+{
+    size_t n = 0;
+
+    if (*cache && cupkee_buffer_is_empty(*cache)) {
+        n = cupkee_buffer_capacity(*cache);
+        cupkee_buffer_release(*cache);
+        *cache = NULL;
+    }
+    return n;
+}
+
+/* Release empty caches, they are allocated again when needed */
+size_t cupkee_stream_shrink(cupkee_stream_t *s)
+{
+    uint32_t state;
+    size_t n;
+
+    if (!s) {
+        return 0;
+    }
+
+    hw_enter_critical(&state);
+    n = stream_cache_drop(&s->rx_buf) + stream_cache_drop(&s->tx_buf);
+    hw_exit_critical(state);
+
+    if (n && stream_is_adaptive(s)) {
+        if (!s->rx_buf) {
+            s->rx_buf_size = s->rx_buf_base;
+        }
+        if (!s->tx_buf) {
+            s->tx_buf_size = s->tx_buf_base;
+        }
+    }
+
+    return n;
+}
+
 int cupkee_stream_deinit(cupkee_stream_t *s)
 {
     if (s) {
@@ -164,7 +369,7 @@ int cupkee_stream_tx_cache_space(cupkee_stream_t *s)
         if (s->tx_buf) {
             return cupkee_buffer_space(s->tx_buf);
         } else {
-            return s->rx_buf_size;
+            return s->tx_buf_size;
         }
     }
     return -CUPKEE_EINVAL;
@@ -184,11 +389,17 @@ int cupkee_stream_push(cupkee_stream_t *s, size_t n, const void *data)
     }
 
     cnt = cupkee_buffer_give(cache, n, data);
-    if (cnt > 0) {
-        if (s->flags & CUPKEE_STREAM_FL_NOTIFY_DATA && cupkee_buffer_length(cache) > s->rx_buf_size / 2) {
-            cupkee_object_event_post(s->id, CUPKEE_EVENT_DATA);
+    if (cnt < (int)n) {
+        if (stream_is_adaptive(s) && stream_rx_grow(s, n - cnt)) {
+            cnt += cupkee_buffer_give(s->rx_buf, n - cnt, (const uint8_t *)data + cnt);
+        }
+        if (cnt < (int)n) {
+            stream_drops_add(&s->rx_drops, n - cnt);
         }
-        s->last_push = _cupkee_systicks;
+    }
+
+    if (cnt > 0) {
+        stream_rx_notify(s);
     }
 
     return cnt;
@@ -198,9 +409,25 @@ void cupkee_stream_sync(cupkee_stream_t *s, uint32_t systicks)
 {
     if (s->flags & CUPKEE_STREAM_FL_NOTIFY_DATA
         && s->rx_buf && !cupkee_buffer_is_empty(s->rx_buf)
-        && (systicks - s->last_push) > 20) {
+        && (systicks - s->last_push) > s->rx_idle) {
         cupkee_object_event_post(s->id, CUPKEE_EVENT_DATA);
     }
+
+    if (stream_is_adaptive(s) && systicks - s->adapt_stamp >= CUPKEE_STREAM_ADAPT_TICKS) {
+        stream_adapt(s, systicks);
+    }
+}
+
+uint32_t cupkee_stream_sync_wait(cupkee_stream_t *s, uint32_t systicks)
+{
+    if (s->flags & CUPKEE_STREAM_FL_NOTIFY_DATA
+        && s->rx_buf && !cupkee_buffer_is_empty(s->rx_buf)) {
+        uint32_t idle = systicks - s->last_push;
+
+        return idle > s->rx_idle ? 0 : s->rx_idle + 1 - idle;
+    }
+
+    return CUPKEE_TICKS_FOREVER;
 }
 
 int cupkee_stream_pull(cupkee_stream_t *s, size_t n, void *data)
@@ -217,6 +444,189 @@ int cupkee_stream_pull(cupkee_stream_t *s, size_t n, void *data)
     return 0;
 }
 
+/*
+ * Bulk io for drivers: reserve a contiguous window of the cache, move the
+ * data in (push) or out (pull) directly, then commit the bytes moved.
+ * The window may be shorter than the free space or the cached data when
+ * the cache wraps, reserve again after commit to get the rest.
+ */
+int cupkee_stream_push_reserve(cupkee_stream_t *s, void **ptr)
+{
+    void *cache;
+
+    if (!stream_is_readable(s) || !ptr) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!(cache = stream_rx_cache(s))) {
+        return -CUPKEE_ENOMEM;
+    }
+
+    if (cupkee_buffer_is_full(cache)) {
+        if (!stream_is_adaptive(s) || !stream_rx_grow(s, 1)) {
+            stream_drops_add(&s->rx_drops, 1);
+            return 0;
+        }
+        cache = s->rx_buf;
+    }
+
+    return cupkee_buffer_space_window(cache, ptr);
+}
+
+int cupkee_stream_push_commit(cupkee_stream_t *s, size_t n)
+{
+    int cnt;
+
+    if (!stream_is_readable(s) || !s->rx_buf) {
+        return -CUPKEE_EINVAL;
+    }
+
+    cnt = cupkee_buffer_commit(s->rx_buf, n);
+    if (cnt > 0) {
+        stream_rx_notify(s);
+    }
+
+    return cnt;
+}
+
+int cupkee_stream_pull_reserve(cupkee_stream_t *s, void **ptr)
+{
+    if (!stream_is_writable(s) || !ptr) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (!s->tx_buf) {
+        return 0;
+    }
+
+    return cupkee_buffer_data_window(s->tx_buf, ptr);
+}
+
+int cupkee_stream_pull_commit(cupkee_stream_t *s, size_t n)
+{
+    int cnt;
+
+    if (!stream_is_writable(s) || !s->tx_buf) {
+        return -CUPKEE_EINVAL;
+    }
+
+    cnt = cupkee_buffer_consume(s->tx_buf, n);
+    if (cnt > 0 && cupkee_buffer_is_empty(s->tx_buf) && s->flags & CUPKEE_STREAM_FL_NOTIFY_DRAIN) {
+        cupkee_object_event_post(s->id, CUPKEE_EVENT_DRAIN);
+    }
+
+    return cnt;
+}
+
+/*
+ * Buffer hand-off: the whole cupkee buffer changes owner, no data copied.
+ *
+ * push_buf / write_buf: on success the stream owns the buffer, on error
+ * the caller keeps it. A buffer is adopted as is when the stream cache is
+ * empty and it is no smaller than the cache size, so the size configured
+ * survives. Otherwise its data is merged into the cache (and the buffer
+ * released) or -CUPKEE_EOVERFLOW returned if it does not fit. A shared
+ * buffer is never changed by stream, it is copied before adopted.
+ *
+ * pull_buf / read_buf: hand out the whole cache, the caller must release it.
+ */
+static int stream_buf_adopt(void **cache, size_t size, void *data)
+{
+    int n = cupkee_buffer_length(data);
+
+    if ((!*cache || cupkee_buffer_is_empty(*cache)) && cupkee_buffer_capacity(data) >= size) {
+        if (NULL == (data = cupkee_buffer_writable(data))) {
+            return -CUPKEE_ENOMEM;
+        }
+        if (*cache) {
+            cupkee_buffer_release(*cache);
+        }
+        stream_cache_set(cache, data);
+    } else
+    if (!*cache && !stream_cache_set(cache, cupkee_buffer_alloc_movable(size))) {
+        return -CUPKEE_ENOMEM;
+    } else
+    if ((int)cupkee_buffer_space(*cache) >= n) {
+        cupkee_iovec_t iov[2];
+
+        cupkee_buffer_data_iov(data, iov);
+        cupkee_buffer_give(*cache, iov[0].len, iov[0].ptr);
+        cupkee_buffer_give(*cache, iov[1].len, iov[1].ptr);
+        cupkee_buffer_release(data);
+    } else {
+        return -CUPKEE_EOVERFLOW;
+    }
+
+    return n;
+}
+
+int cupkee_stream_push_buf(cupkee_stream_t *s, void *data)
+{
+    int cnt;
+
+    if (!stream_is_readable(s) || !data) {
+        return -CUPKEE_EINVAL;
+    }
+
+    cnt = stream_buf_adopt(&s->rx_buf, s->rx_buf_size, data);
+    if (cnt > 0) {
+        stream_rx_notify(s);
+    }
+
+    return cnt;
+}
+
+void *cupkee_stream_pull_buf(cupkee_stream_t *s)
+{
+    void *buf;
+
+    if (!stream_is_writable(s) || !s->tx_buf || cupkee_buffer_is_empty(s->tx_buf)) {
+        return NULL;
+    }
+
+    buf = stream_cache_out(&s->tx_buf);
+
+    if (s->flags & CUPKEE_STREAM_FL_NOTIFY_DRAIN) {
+        cupkee_object_event_post(s->id, CUPKEE_EVENT_DRAIN);
+    }
+
+    return buf;
+}
+
+void *cupkee_stream_read_buf(cupkee_stream_t *s)
+{
+    if (!stream_is_readable(s)) {
+        return NULL;
+    }
+
+    if (s->rx_state == CUPKEE_STREAM_STATE_IDLE) {
+        s->rx_state = CUPKEE_STREAM_STATE_PAUSED;
+    }
+
+    if (!s->rx_buf || cupkee_buffer_is_empty(s->rx_buf)) {
+        stream_rx_request(s, s->rx_buf_size);
+        return NULL;
+    }
+
+    return stream_cache_out(&s->rx_buf);
+}
+
+int cupkee_stream_write_buf(cupkee_stream_t *s, void *data)
+{
+    int cnt;
+
+    if (!stream_is_writable(s) || !data) {
+        return -CUPKEE_EINVAL;
+    }
+
+    cnt = stream_buf_adopt(&s->tx_buf, s->tx_buf_size, data);
+    if (cnt > 0 && cnt == (int) cupkee_buffer_length(s->tx_buf)) {
+        stream_tx_request(s);
+    }
+
+    return cnt;
+}
+
 int cupkee_stream_unshift(cupkee_stream_t *s, uint8_t data)
 {
     if (!stream_is_readable(s)) {
@@ -249,6 +659,34 @@ void cupkee_stream_resume(cupkee_stream_t *s)
     }
 }
 
+/* Reader side in place: data window of rx cache, use it then commit(n) */
+int cupkee_stream_read_reserve(cupkee_stream_t *s, void **ptr)
+{
+    if (!stream_is_readable(s) || !ptr) {
+        return -CUPKEE_EINVAL;
+    }
+
+    if (s->rx_state == CUPKEE_STREAM_STATE_IDLE) {
+        s->rx_state = CUPKEE_STREAM_STATE_PAUSED;
+    }
+
+    if (!s->rx_buf || cupkee_buffer_is_empty(s->rx_buf)) {
+        stream_rx_request(s, s->rx_buf_size);
+        return 0;
+    }
+
+    return cupkee_buffer_data_window(s->rx_buf, ptr);
+}
+
+int cupkee_stream_read_commit(cupkee_stream_t *s, size_t n)
+{
+    if (!stream_is_readable(s) || !s->rx_buf) {
+        return -CUPKEE_EINVAL;
+    }
+
+    return cupkee_buffer_consume(s->rx_buf, n);
+}
+
 int cupkee_stream_read(cupkee_stream_t *s, size_t n, void *buf)
 {
     size_t max;
@@ -291,7 +729,21 @@ int cupkee_stream_write(cupkee_stream_t *s, size_t n, const void *data)
     }
 
     cached = cupkee_buffer_give(cache, n, data);
-    if (cached == (int) cupkee_buffer_length(cache)) {
+    if (cached < (int)n) {
+        if (stream_is_adaptive(s) && stream_tx_grow(s, n - cached)) {
+            cache = s->tx_buf;
+            cached += cupkee_buffer_give(cache, n - cached, (const uint8_t *)data + cached);
+        }
+        if (cached < (int)n) {
+            stream_drops_add(&s->tx_drops, n - cached);
+        }
+    }
+
+    if (cupkee_buffer_length(cache) > s->tx_peak) {
+        s->tx_peak = cupkee_buffer_length(cache);
+    }
+
+    if (cached && cached == (int) cupkee_buffer_length(cache)) {
         stream_tx_request(s);
     }
 
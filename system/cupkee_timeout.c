@@ -19,82 +19,404 @@
 
 #include <cupkee.h>
 
-#define TIMEOUT_FL_REPEAT 1
+/* Timeout wheel
+ *******************************************************
+ * Timeouts are hashed into a hierarchical timing wheel:
+ * level 0 slots hold timeouts which expire in the next
+ * WHEEL_SIZE ticks, level n slots cover WHEEL_SIZE^n ticks
+ * each, and are cascaded into the lower level when level
+ * n - 1 wrap around. Timeouts beyond the wheel range wait
+ * in the far list, till the top level wrap around.
+ ******************************************************/
+#define TIMEOUT_WHEEL_BITS      CUPKEE_TIMEOUT_WHEEL_BITS
+#define TIMEOUT_WHEEL_LEVEL     CUPKEE_TIMEOUT_WHEEL_LEVEL
+#define TIMEOUT_WHEEL_SIZE      (1U << TIMEOUT_WHEEL_BITS)
+#define TIMEOUT_WHEEL_MASK      (TIMEOUT_WHEEL_SIZE - 1)
+#define TIMEOUT_WHEEL_RANGE     (1U << (TIMEOUT_WHEEL_BITS * TIMEOUT_WHEEL_LEVEL))
+
+#define TIMEOUT_POOL_CHUNK      CUPKEE_TIMEOUT_POOL_CHUNK
+#define TIMEOUT_POOL_MAX        CUPKEE_TIMEOUT_POOL_MAX
+
+/* Timeout id: | generation | pool index | */
+#define TIMEOUT_ID_BITS         (8)
+#define TIMEOUT_ID_MASK         ((1 << TIMEOUT_ID_BITS) - 1)
+#define TIMEOUT_ID_MAX          (0x7FFFFFFF)
+#define TIMEOUT_GEN_MASK        (TIMEOUT_ID_MAX >> TIMEOUT_ID_BITS)
+
+#define TIMEOUT_FL_REPEAT       0x01
+#define TIMEOUT_FL_USER         0xFF
+#define TIMEOUT_FL_INUSED       0x100
+#define TIMEOUT_FL_RUNNING      0x200
+#define TIMEOUT_FL_CANCEL       0x400
+
+static list_head_t timeout_wheel[TIMEOUT_WHEEL_LEVEL][TIMEOUT_WHEEL_SIZE];
+static list_head_t timeout_far;
+
+static uint32_t timeout_ticks;  // systicks of last sync
+static uint32_t timeout_clock;  // next wheel tick to be processed
+static int timeout_count = 0;
+static uint32_t timeout_next = 0;    // generation, wrap around
+
+static cupkee_timeout_t *timeout_pool[TIMEOUT_POOL_MAX];
+static cupkee_timeout_t *timeout_free = NULL;
+static int timeout_pool_num = 0;
+
+static int timeout_pool_grow(void)
+{
+    cupkee_timeout_t *chunk;
+    int i, base;
 
-static cupkee_timeout_t *timeout_head = NULL;
-static int timeout_next = 0;
+    if (timeout_pool_num >= TIMEOUT_POOL_MAX) {
+        return -CUPKEE_ENOMEM;
+    }
 
-static int timeout_clear_by(int (*fn)(cupkee_timeout_t *, int), int x)
+    chunk = cupkee_malloc(sizeof(cupkee_timeout_t) * TIMEOUT_POOL_CHUNK);
+    if (!chunk) {
+        return -CUPKEE_ENOMEM;
+    }
+
+    base = timeout_pool_num * TIMEOUT_POOL_CHUNK;
+    for (i = TIMEOUT_POOL_CHUNK - 1; i >= 0; i--) {
+        cupkee_timeout_t *t = &chunk[i];
+
+        t->id = base + i;
+        t->flags = 0;
+        t->list.next = (list_head_t *)timeout_free;
+        timeout_free = t;
+    }
+    timeout_pool[timeout_pool_num++] = chunk;
+
+    return 0;
+}
+
+/* Shrinker: release chunks at the end of pool, which have no timeout in use */
+static size_t timeout_pool_shrink(size_t want)
 {
-    cupkee_timeout_t *prev = NULL, *curr = timeout_head;
-    int n = 0;
+    size_t n = 0;
 
-    while (curr) {
-        cupkee_timeout_t *next = curr->next;
+    while (timeout_pool_num > 0 && n < want) {
+        cupkee_timeout_t *chunk = timeout_pool[timeout_pool_num - 1];
+        cupkee_timeout_t **pp = &timeout_free;
+        int i;
 
-        if (fn(curr, x)) {
-            if (prev) {
-                prev->next = next;
+        for (i = 0; i < TIMEOUT_POOL_CHUNK; i++) {
+            if (chunk[i].flags & TIMEOUT_FL_INUSED) {
+                return n;
+            }
+        }
+
+        while (*pp) {
+            cupkee_timeout_t *t = *pp;
+
+            if (t >= chunk && t < chunk + TIMEOUT_POOL_CHUNK) {
+                *pp = (cupkee_timeout_t *)t->list.next;
             } else {
-                timeout_head = next;
+                pp = (cupkee_timeout_t **)&t->list.next;
             }
+        }
 
-            curr->handle(1, curr->param); // drop timer
-            cupkee_free(curr);
-            n ++;
+        cupkee_free(chunk);
+        timeout_pool[--timeout_pool_num] = NULL;
+        n += sizeof(cupkee_timeout_t) * TIMEOUT_POOL_CHUNK;
+    }
+
+    return n;
+}
+
+static cupkee_timeout_t *timeout_alloc(void)
+{
+    cupkee_timeout_t *t;
+
+    if (!timeout_free && timeout_pool_grow()) {
+        return NULL;
+    }
+
+    t = timeout_free;
+    timeout_free = (cupkee_timeout_t *)t->list.next;
+
+    t->id = ((timeout_next++ & TIMEOUT_GEN_MASK) << TIMEOUT_ID_BITS) | (t->id & TIMEOUT_ID_MASK);
+    t->flags = TIMEOUT_FL_INUSED;
+
+    return t;
+}
+
+static void timeout_release(cupkee_timeout_t *t)
+{
+    t->flags = 0;
+    timeout_count--;
+
+    t->handle(1, t->param); // drop timer
+
+    t->list.next = (list_head_t *)timeout_free;
+    timeout_free = t;
+}
+
+static cupkee_timeout_t *timeout_lookup(uint32_t id)
+{
+    unsigned index = id & TIMEOUT_ID_MASK;
+    unsigned chunk = index / TIMEOUT_POOL_CHUNK;
+    cupkee_timeout_t *t;
+
+    if (chunk >= (unsigned)timeout_pool_num) {
+        return NULL;
+    }
+
+    t = &timeout_pool[chunk][index % TIMEOUT_POOL_CHUNK];
+    if ((t->flags & TIMEOUT_FL_INUSED) && (uint32_t)t->id == id) {
+        return t;
+    }
+    return NULL;
+}
+
+static inline uint32_t timeout_current(void)
+{
+    int32_t lag = _cupkee_systicks - timeout_ticks;
+
+    if (lag < 0) {
+        // systicks was reset, and not synced yet
+        lag = _cupkee_systicks;
+    }
+
+    return timeout_clock - 1 + lag;
+}
+
+static void timeout_wheel_add(cupkee_timeout_t *t)
+{
+    int32_t idx = t->expire - timeout_clock;
+    list_head_t *head;
+
+    if (idx < 0) {
+        // expired already, wake up at next tick
+        head = &timeout_wheel[0][timeout_clock & TIMEOUT_WHEEL_MASK];
+    } else
+    if ((uint32_t)idx >= TIMEOUT_WHEEL_RANGE) {
+        head = &timeout_far;
+    } else {
+        int l = 0;
+
+        while ((uint32_t)idx >= (1U << (TIMEOUT_WHEEL_BITS * (l + 1)))) {
+            l++;
+        }
+        head = &timeout_wheel[l][(t->expire >> (TIMEOUT_WHEEL_BITS * l)) & TIMEOUT_WHEEL_MASK];
+    }
+
+    list_add_tail(&t->list, head);
+}
+
+static void timeout_wheel_readd(list_head_t *head)
+{
+    list_head_t work;
+
+    list_move_all(head, &work);
+    while (!list_is_empty(&work)) {
+        cupkee_timeout_t *t = CUPKEE_CONTAINER_OF(work.next, cupkee_timeout_t, list);
+
+        list_del(&t->list);
+        timeout_wheel_add(t);
+    }
+}
+
+static void timeout_wheel_cascade(void)
+{
+    int l;
+
+    for (l = 1; l < TIMEOUT_WHEEL_LEVEL; l++) {
+        unsigned slot = (timeout_clock >> (TIMEOUT_WHEEL_BITS * l)) & TIMEOUT_WHEEL_MASK;
+
+        timeout_wheel_readd(&timeout_wheel[l][slot]);
+        if (slot) {
+            return;
+        }
+    }
+
+    timeout_wheel_readd(&timeout_far);
+}
+
+static void timeout_reschedule(cupkee_timeout_t *t, uint32_t now)
+{
+    if (t->wait == 0) {
+        t->expire = now + 1;
+        return;
+    }
+
+    // Keep the phase of repeat timer, skip the periods missed
+    t->expire += t->wait;
+    if ((int32_t)(t->expire - now) <= 0) {
+        t->expire += ((now - t->expire) / t->wait + 1) * t->wait;
+    }
+}
+
+static void timeout_expire(list_head_t *work, uint32_t now)
+{
+    while (!list_is_empty(work)) {
+        cupkee_timeout_t *t = CUPKEE_CONTAINER_OF(work->next, cupkee_timeout_t, list);
+
+        list_del(&t->list);
+
+        t->flags |= TIMEOUT_FL_RUNNING;
+        t->handle(0, t->param);       // wake up
+        t->flags &= ~TIMEOUT_FL_RUNNING;
+
+        if ((t->flags & TIMEOUT_FL_REPEAT) && !(t->flags & TIMEOUT_FL_CANCEL)) {
+            timeout_reschedule(t, now);
+            timeout_wheel_add(t);
         } else {
-            prev = curr;
+            timeout_release(t);
         }
+    }
+}
 
-        curr = next;
+static void timeout_drop(cupkee_timeout_t *t)
+{
+    if (t->flags & TIMEOUT_FL_RUNNING) {
+        // Release it, when the handle return
+        t->flags |= TIMEOUT_FL_CANCEL;
+    } else {
+        list_del(&t->list);
+        timeout_release(t);
+    }
+}
+
+static int timeout_clear_by(int (*fn)(cupkee_timeout_t *, int), int x)
+{
+    int i, n = 0;
+
+    for (i = 0; i < timeout_pool_num * TIMEOUT_POOL_CHUNK; i++) {
+        cupkee_timeout_t *t = &timeout_pool[i / TIMEOUT_POOL_CHUNK][i % TIMEOUT_POOL_CHUNK];
+
+        if ((t->flags & TIMEOUT_FL_INUSED) && !(t->flags & TIMEOUT_FL_CANCEL) && fn(t, x)) {
+            timeout_drop(t);
+            n ++;
+        }
     }
     return n;
 }
 
 static int timeout_with_flag(cupkee_timeout_t *t, int flags)
 {
-    return t->flags == flags;
+    return (t->flags & TIMEOUT_FL_USER) == flags;
 }
 
-static int timeout_with_id(cupkee_timeout_t *t, int id)
+static int timeout_with_any(cupkee_timeout_t *t, int x)
 {
-    return t->id == id;
+    (void) t;
+    (void) x;
+
+    return 1;
 }
 
 void cupkee_timeout_setup(void)
 {
-    timeout_head = NULL;
+    int l, s;
+
+    for (l = 0; l < TIMEOUT_WHEEL_LEVEL; l++) {
+        for (s = 0; s < (int)TIMEOUT_WHEEL_SIZE; s++) {
+            list_head_init(&timeout_wheel[l][s]);
+        }
+    }
+    list_head_init(&timeout_far);
+
+    timeout_ticks = _cupkee_systicks;
+    timeout_clock = timeout_ticks + 1;
+    timeout_count = 0;
     timeout_next = 0;
+
+    timeout_free = NULL;
+    timeout_pool_num = 0;
+
+    cupkee_memory_shrinker(timeout_pool_shrink);
 }
 
 void cupkee_timeout_sync(uint32_t curr_ticks)
 {
-    cupkee_timeout_t *prev = NULL, *curr = timeout_head;
+    int32_t elapsed = curr_ticks - timeout_ticks;
+    uint32_t now;
 
-    while (curr) {
-        cupkee_timeout_t *next = curr->next;
+    if (elapsed < 0) {
+        // systicks was reset
+        elapsed = curr_ticks;
+    }
+    timeout_ticks = curr_ticks;
+    now = timeout_clock - 1 + elapsed;
 
-        if (curr_ticks - curr->from >= curr->wait) {
-            curr->handle(0, curr->param);       // wake up
+    while (elapsed > 0) {
+        list_head_t work;
+        unsigned slot;
 
-            if (curr->flags & TIMEOUT_FL_REPEAT) {
-                curr->from = curr_ticks;
-                prev = curr;
-            } else {
-                curr->handle(1, curr->param);   // drop
-                if (prev) {
-                    prev->next = next;
-                } else {
-                    // Current timer is header
-                    timeout_head = next;
-                }
-                cupkee_free(curr);
+        if (!timeout_count) {
+            timeout_clock += elapsed;
+            break;
+        }
+
+        slot = timeout_clock & TIMEOUT_WHEEL_MASK;
+        if (!slot) {
+            timeout_wheel_cascade();
+        }
+        list_move_all(&timeout_wheel[0][slot], &work);
+
+        timeout_clock++;
+        elapsed--;
+
+        timeout_expire(&work, now);
+    }
+}
+
+static inline uint32_t timeout_min(uint32_t a, uint32_t b)
+{
+    // wheel ticks after timeout_clock
+    return (a - timeout_clock) < (b - timeout_clock) ? a : b;
+}
+
+static uint32_t timeout_list_min(list_head_t *head, uint32_t next)
+{
+    list_head_t *pos;
+
+    list_for_each(pos, head) {
+        next = timeout_min(next, CUPKEE_CONTAINER_OF(pos, cupkee_timeout_t, list)->expire);
+    }
+
+    return next;
+}
+
+uint32_t cupkee_timeout_next(void)
+{
+    uint32_t next, now;
+    unsigned l, j;
+    int32_t wait;
+
+    if (!timeout_count) {
+        return CUPKEE_TICKS_FOREVER;
+    }
+
+    next = timeout_list_min(&timeout_far, timeout_clock + TIMEOUT_WHEEL_RANGE);
+
+    // Level 0 slots hold exact expire ticks
+    for (j = 0; j < TIMEOUT_WHEEL_SIZE; j++) {
+        if (!list_is_empty(&timeout_wheel[0][(timeout_clock + j) & TIMEOUT_WHEEL_MASK])) {
+            next = timeout_min(next, timeout_clock + j);
+            break;
+        }
+    }
+
+    // Slots of upper level are ordered by range, only the first one should be checked
+    for (l = 1; l < TIMEOUT_WHEEL_LEVEL; l++) {
+        unsigned shift = TIMEOUT_WHEEL_BITS * l;
+        uint32_t pos = timeout_clock >> shift;
+
+        for (j = (timeout_clock & ((1U << shift) - 1)) ? 1 : 0; j <= TIMEOUT_WHEEL_SIZE; j++) {
+            list_head_t *head = &timeout_wheel[l][(pos + j) & TIMEOUT_WHEEL_MASK];
+
+            if (!list_is_empty(head)) {
+                next = timeout_list_min(head, next);
+                break;
             }
-        } else {
-            prev = curr;
         }
-        curr = next;
     }
+
+    now = timeout_current();
+    wait = next - now;
+
+    return wait > 0 ? (uint32_t)wait : 0;
 }
 
 cupkee_timeout_t *cupkee_timeout_register(uint32_t wait, int repeat, cupkee_timeout_handle_t handle, void *param)
@@ -105,17 +427,16 @@ cupkee_timeout_t *cupkee_timeout_register(uint32_t wait, int repeat, cupkee_time
         return NULL;
     }
 
-    t = cupkee_malloc(sizeof(cupkee_timeout_t));
+    t = timeout_alloc();
     if (t) {
         t->handle = handle;
         t->param  = param;
-        t->id     = timeout_next++;
         t->wait   = wait;
-        t->from   = _cupkee_systicks;
-        t->flags  = repeat ? TIMEOUT_FL_REPEAT : 0;
+        t->expire = timeout_current() + wait;
+        t->flags |= repeat ? TIMEOUT_FL_REPEAT : 0;
 
-        t->next = timeout_head;
-        timeout_head = t;
+        timeout_wheel_add(t);
+        timeout_count++;
     }
 
     return t;
@@ -123,44 +444,14 @@ cupkee_timeout_t *cupkee_timeout_register(uint32_t wait, int repeat, cupkee_time
 
 void cupkee_timeout_unregister(cupkee_timeout_t *t)
 {
-    cupkee_timeout_t *prev = NULL, *curr = timeout_head;
-
-    while (curr) {
-        if (curr == t) {
-            if (prev) {
-                prev->next = curr->next;
-            } else {
-                timeout_head = curr->next;
-            }
-
-            curr->handle(1, curr->param); // drop timer
-            cupkee_free(curr);
-
-            return;
-        }
-
-        prev = curr;
-        curr = curr->next;
+    if (t && (t->flags & TIMEOUT_FL_INUSED) && !(t->flags & TIMEOUT_FL_CANCEL)) {
+        timeout_drop(t);
     }
 }
 
 int cupkee_timeout_clear_all(void)
 {
-    cupkee_timeout_t *curr = timeout_head;
-    int n = 0;
-
-    timeout_head = NULL;
-    while (curr) {
-        cupkee_timeout_t *next = curr->next;
-
-        curr->handle(1, curr->param); // drop timer
-        cupkee_free(curr);
-
-        curr = next;
-        n ++;
-    }
-
-    return n;
+    return timeout_clear_by(timeout_with_any, 0);
 }
 
 int cupkee_timeout_clear_with_flags(uint32_t flags)
@@ -170,7 +461,13 @@ int cupkee_timeout_clear_with_flags(uint32_t flags)
 
 int cupkee_timeout_clear_with_id(uint32_t id)
 {
-    return timeout_clear_by(timeout_with_id, id);
+    cupkee_timeout_t *t = timeout_lookup(id);
+
+    if (t && !(t->flags & TIMEOUT_FL_CANCEL)) {
+        timeout_drop(t);
+        return 1;
+    }
+    return 0;
 }
 
 volatile uint32_t _cupkee_systicks;
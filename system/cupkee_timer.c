@@ -87,6 +87,12 @@ int cupkee_timer_setup(void)
         return -1;
     }
 
+#if CUPKEE_TIMER_CACHE_RESERVE > 0
+    if (0 > cupkee_object_cache(timer_tag, CUPKEE_TIMER_CACHE_RESERVE)) {
+        return -1;
+    }
+#endif
+
     return 0;
 }
 
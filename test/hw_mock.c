@@ -26,11 +26,28 @@ static size_t   mock_flash_size = FLASH_SIZE;
 static uint8_t *mock_memory_base = NULL;
 static size_t   mock_memory_size = 0;
 static size_t   mock_memory_off  = 0;
+static void    *mock_region[CUPKEE_ZONE_MAX];
+static int      mock_region_num = 0;
 static int mock_timer_curr_inst = 0;
 static int mock_timer_curr_id   = -1;
 static int mock_timer_curr_period = -1;
 static int mock_timer_curr_duration = -1;
 static int mock_timer_curr_state = -1;  // 0: stop, 1: start, -1: noused
+static uint32_t mock_idle_request = 0;
+static uint32_t mock_idle_wakeup = CUPKEE_TICKS_FOREVER;
+
+/* UART: wire data is a byte sequence, rx generate it and tx verify it */
+#define MOCK_UART_RXE   1
+#define MOCK_UART_TXE   2
+
+static void    *mock_uart_entry = NULL;
+static uint8_t  mock_uart_flags = 0;
+static int      mock_uart_bulk = 0;
+static size_t   mock_uart_rx_pending = 0;
+static uint8_t  mock_uart_rx_seq = 0;
+static uint8_t  mock_uart_tx_seq = 0;
+static size_t   mock_uart_tx_count = 0;
+static size_t   mock_uart_tx_error = 0;
 
 void hw_mock_init(size_t mem_size)
 {
@@ -45,12 +62,40 @@ void hw_mock_init(size_t mem_size)
 
 void hw_mock_deinit(void)
 {
+    mock_idle_request = 0;
+    mock_idle_wakeup = CUPKEE_TICKS_FOREVER;
+
     if (mock_memory_base) {
         free(mock_memory_base);
         mock_memory_base = NULL;
         mock_memory_size = 0;
         mock_memory_off = 0;
     }
+
+    while (mock_region_num > 0) {
+        free(mock_region[--mock_region_num]);
+    }
+}
+
+void *hw_mock_region(size_t size)
+{
+    void *region;
+
+    if (mock_region_num >= CUPKEE_ZONE_MAX || !(region = malloc(size))) {
+        return NULL;
+    }
+
+    return mock_region[mock_region_num++] = region;
+}
+
+uint32_t hw_mock_idle_request(void)
+{
+    return mock_idle_request;
+}
+
+void hw_mock_idle_wakeup_set(uint32_t ticks)
+{
+    mock_idle_wakeup = ticks;
 }
 
 int hw_mock_timer_curr_id(void)
@@ -121,6 +166,21 @@ void hw_poll(void)
 void hw_halt(void)
 {}
 
+void hw_idle(uint32_t ticks)
+{
+    mock_idle_request = ticks;
+
+    // Interrupt come before deadline
+    if (mock_idle_wakeup < ticks) {
+        ticks = mock_idle_wakeup;
+    }
+
+    if (ticks != CUPKEE_TICKS_FOREVER) {
+        _cupkee_systicks += ticks;
+        cupkee_event_post_systick();
+    }
+}
+
 void hw_info_get(hw_info_t *info)
 {
     info->ram_base = mock_memory_base;
@@ -140,20 +200,40 @@ intptr_t hw_storage_base(void)
     return mock_flash_base;
 }
 
+/* Flash is addressed by the low 32 bits of host pointer */
+static uint8_t *mock_flash_addr(uint32_t base, uint32_t size)
+{
+    uint32_t offset = base - (uint32_t)(uintptr_t)mock_flash_base;
+
+    if (offset >= mock_flash_size || size > mock_flash_size - offset) {
+        return NULL;
+    }
+
+    return mock_flash_base + offset;
+}
+
 int hw_storage_erase(uint32_t base, uint32_t size)
 {
-    (void) base;
-    (void) size;
-    return -1;
+    uint8_t *p = mock_flash_addr(base, size);
+
+    if (!p) {
+        return -1;
+    }
+
+    memset(p, 0xff, size);
+    return 0;
 }
 
 int hw_storage_program(uint32_t base, uint32_t len, const uint8_t *data)
 {
-    (void) base;
-    (void) len;
-    (void) data;
+    uint8_t *p = mock_flash_addr(base, len);
+
+    if (!p) {
+        return -1;
+    }
 
-    return -1;
+    memcpy(p, data, len);
+    return 0;
 }
 
 
@@ -334,8 +414,189 @@ int hw_timer_duration_get(int inst)
     return mock_timer_curr_duration;
 }
 
+static int mock_uart_request(int inst)
+{
+    (void) inst;
+
+    mock_uart_flags = 0;
+    return 0;
+}
+
+static int mock_uart_release(int inst)
+{
+    (void) inst;
+
+    mock_uart_entry = NULL;
+    return 0;
+}
+
+static int mock_uart_setup(int inst, void *entry)
+{
+    (void) inst;
+
+    mock_uart_entry = entry;
+    mock_uart_rx_pending = 0;
+    mock_uart_rx_seq = 0;
+    mock_uart_tx_seq = 0;
+    mock_uart_tx_count = 0;
+    mock_uart_tx_error = 0;
+
+    return 0;
+}
+
+static int mock_uart_reset(int inst)
+{
+    (void) inst;
+
+    mock_uart_flags = 0;
+    return 0;
+}
+
+static inline void mock_uart_tx_byte(uint8_t data)
+{
+    if (data != mock_uart_tx_seq++) {
+        mock_uart_tx_error++;
+    }
+    mock_uart_tx_count++;
+}
+
+static void mock_uart_poll_byte(void)
+{
+    uint8_t data;
+
+    if (mock_uart_flags & MOCK_UART_RXE) {
+        while (mock_uart_rx_pending) {
+            data = mock_uart_rx_seq;
+            if (1 != cupkee_device_push(mock_uart_entry, 1, &data)) {
+                mock_uart_flags &= ~MOCK_UART_RXE;
+                break;
+            }
+            mock_uart_rx_seq++;
+            mock_uart_rx_pending--;
+        }
+    }
+
+    if (mock_uart_flags & MOCK_UART_TXE) {
+        while (1 == cupkee_device_pull(mock_uart_entry, 1, &data)) {
+            mock_uart_tx_byte(data);
+        }
+        mock_uart_flags &= ~MOCK_UART_TXE;
+    }
+}
+
+static void mock_uart_poll_bulk(void)
+{
+    uint8_t *ptr;
+    int i, n;
+
+    if (mock_uart_flags & MOCK_UART_RXE) {
+        while (mock_uart_rx_pending) {
+            if (0 >= (n = cupkee_device_push_reserve(mock_uart_entry, (void **)&ptr))) {
+                mock_uart_flags &= ~MOCK_UART_RXE;
+                break;
+            }
+            for (i = 0; i < n && mock_uart_rx_pending; i++, mock_uart_rx_pending--) {
+                ptr[i] = mock_uart_rx_seq++;
+            }
+            cupkee_device_push_commit(mock_uart_entry, i);
+        }
+    }
+
+    if (mock_uart_flags & MOCK_UART_TXE) {
+        while (0 < (n = cupkee_device_pull_reserve(mock_uart_entry, (void **)&ptr))) {
+            for (i = 0; i < n; i++) {
+                mock_uart_tx_byte(ptr[i]);
+            }
+            cupkee_device_pull_commit(mock_uart_entry, n);
+        }
+        mock_uart_flags &= ~MOCK_UART_TXE;
+    }
+}
+
+static int mock_uart_poll(int inst)
+{
+    (void) inst;
+
+    if (mock_uart_bulk) {
+        mock_uart_poll_bulk();
+    } else {
+        mock_uart_poll_byte();
+    }
+
+    return 0;
+}
+
+static int mock_uart_read(int inst, size_t n, void *buf)
+{
+    (void) inst;
+
+    if (n && buf) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+    mock_uart_flags |= MOCK_UART_RXE;
+
+    return 0;
+}
+
+static int mock_uart_write(int inst, size_t n, const void *data)
+{
+    (void) inst;
+
+    if (n && data) {
+        return -CUPKEE_EIMPLEMENT;
+    }
+    mock_uart_flags |= MOCK_UART_TXE;
+
+    return 0;
+}
+
+static const cupkee_driver_t mock_uart_driver = {
+    .request = mock_uart_request,
+    .release = mock_uart_release,
+    .setup   = mock_uart_setup,
+    .reset   = mock_uart_reset,
+    .poll    = mock_uart_poll,
+
+    .read    = mock_uart_read,
+    .write   = mock_uart_write,
+};
+
+static const cupkee_device_desc_t mock_uart_desc = {
+    .name = "mock-uart",
+    .inst_max = 1,
+    .conf_init = NULL,
+    .driver = &mock_uart_driver
+};
+
+void hw_mock_uart_bulk_set(int bulk)
+{
+    mock_uart_bulk = bulk;
+}
+
+void hw_mock_uart_rx_feed(size_t n)
+{
+    mock_uart_rx_pending += n;
+}
+
+size_t hw_mock_uart_rx_pending(void)
+{
+    return mock_uart_rx_pending;
+}
+
+size_t hw_mock_uart_tx_count(void)
+{
+    return mock_uart_tx_count;
+}
+
+size_t hw_mock_uart_tx_error(void)
+{
+    return mock_uart_tx_error;
+}
+
 int hw_device_setup(void)
 {
+    cupkee_device_register(&mock_uart_desc);
+
     return 0;
 }
 
@@ -22,6 +22,7 @@
 
 void hw_mock_init(size_t mem_size);
 void hw_mock_deinit(void);
+void *hw_mock_region(size_t size);
 
 cupkee_device_t *mock_device_curr(void);
 size_t           mock_device_curr_want(void);
@@ -29,6 +30,17 @@ size_t           mock_device_curr_want(void);
 int  hw_mock_device_curr_id(void);
 size_t hw_mock_device_curr_want(void);
 
+/* IDLE */
+uint32_t hw_mock_idle_request(void);
+void hw_mock_idle_wakeup_set(uint32_t ticks);
+
+/* UART */
+void hw_mock_uart_bulk_set(int bulk);
+void hw_mock_uart_rx_feed(size_t n);
+size_t hw_mock_uart_rx_pending(void);
+size_t hw_mock_uart_tx_count(void);
+size_t hw_mock_uart_tx_error(void);
+
 /* TIMER */
 int hw_mock_timer_curr_id(void);
 int hw_mock_timer_curr_state(void);
@@ -35,6 +35,7 @@ int main(int argc, const char *argv[])
     test_hello();
 
     test_sys_memory();
+    test_sys_buffer();
     test_sys_event();
 
     test_sys_timeout();
@@ -46,6 +47,7 @@ int main(int argc, const char *argv[])
     test_sys_pin();
     test_sys_timer();
     test_sys_device();
+    test_sys_sdmp();
 
     /***********************************************
      * Test running
@@ -36,6 +36,7 @@ CU_pSuite test_hello(void);
 
 CU_pSuite test_sys_event(void);
 CU_pSuite test_sys_memory(void);
+CU_pSuite test_sys_buffer(void);
 CU_pSuite test_sys_timeout(void);
 CU_pSuite test_sys_process(void);
 CU_pSuite test_sys_struct(void);
@@ -45,6 +46,7 @@ CU_pSuite test_sys_object(void);
 CU_pSuite test_sys_device(void);
 CU_pSuite test_sys_pin(void);
 CU_pSuite test_sys_timer(void);
+CU_pSuite test_sys_sdmp(void);
 
 #endif /* __TEST_INC__ */
 
@@ -0,0 +1,474 @@
+/* GPLv2 License
+ *
+ * Copyright (C) 2016-2018 Lixing Ding <ding.lixing@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ **/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+
+static int test_setup(void)
+{
+    return TU_pre_init();
+}
+
+static int test_clean(void)
+{
+    return TU_pre_deinit();
+}
+
+/* Make data of buffer start at bgn: fill then drop the head */
+static void *buffer_wrapped(size_t cap, int bgn, int len)
+{
+    void *b = cupkee_buffer_alloc(cap);
+    int i;
+
+    for (i = 0; i < bgn; i++) {
+        cupkee_buffer_push(b, 0xff);
+    }
+    cupkee_buffer_consume(b, bgn);
+    for (i = 0; i < len; i++) {
+        cupkee_buffer_push(b, i);
+    }
+
+    return b;
+}
+
+static void test_iov(void)
+{
+    cupkee_iovec_t iov[2];
+    void *b;
+    int i;
+
+    CU_ASSERT_FATAL(NULL != (b = cupkee_buffer_alloc(16)));
+
+    // Empty buffer: all space in one segment
+    CU_ASSERT(16 == cupkee_buffer_space_iov(b, iov));
+    CU_ASSERT(16 == iov[0].len && 0 == iov[1].len);
+    CU_ASSERT(0 == cupkee_buffer_data_iov(b, iov));
+    CU_ASSERT(0 == iov[0].len && 0 == iov[1].len);
+
+    // Fill both segments then commit at once
+    memset(iov[0].ptr, 0, 16);
+    CU_ASSERT(10 == cupkee_buffer_commit(b, 10));
+    CU_ASSERT(6 == cupkee_buffer_consume(b, 6));
+    CU_ASSERT(12 == cupkee_buffer_space_iov(b, iov));
+    CU_ASSERT(6 == iov[0].len && 6 == iov[1].len);
+    memset(iov[0].ptr, 1, iov[0].len);
+    memset(iov[1].ptr, 2, iov[1].len);
+    CU_ASSERT(12 == cupkee_buffer_commit(b, 12));
+    CU_ASSERT(cupkee_buffer_is_full(b));
+    CU_ASSERT(0 == cupkee_buffer_space_iov(b, iov));
+    CU_ASSERT(0 == iov[0].len && 0 == iov[1].len);
+
+    // Peek both segments, data kept till consumed
+    CU_ASSERT(16 == cupkee_buffer_data_iov(b, iov));
+    CU_ASSERT(10 == iov[0].len && 6 == iov[1].len);
+    for (i = 0; i < 4; i++) {
+        CU_ASSERT(0 == ((uint8_t *)iov[0].ptr)[i]);
+    }
+    for (i = 4; i < 10; i++) {
+        CU_ASSERT(1 == ((uint8_t *)iov[0].ptr)[i]);
+    }
+    for (i = 0; i < 6; i++) {
+        CU_ASSERT(2 == ((uint8_t *)iov[1].ptr)[i]);
+    }
+    CU_ASSERT(16 == cupkee_buffer_data_iov(b, iov));
+
+    CU_ASSERT(12 == cupkee_buffer_consume(b, 12));
+    CU_ASSERT(4 == cupkee_buffer_data_iov(b, iov));
+    CU_ASSERT(4 == iov[0].len && 0 == iov[1].len);
+    CU_ASSERT(12 == cupkee_buffer_space_iov(b, iov));
+    CU_ASSERT(10 == iov[0].len && 2 == iov[1].len);
+
+    cupkee_buffer_release(b);
+}
+
+static void test_ptr(void)
+{
+    uint8_t *ptr;
+    void *b;
+    int i;
+
+    // Not wrapped
+    CU_ASSERT_FATAL(NULL != (b = buffer_wrapped(16, 4, 8)));
+    CU_ASSERT_FATAL(NULL != (ptr = cupkee_buffer_ptr(b)));
+    for (i = 0; i < 8; i++) {
+        CU_ASSERT(ptr[i] == i);
+    }
+    cupkee_buffer_release(b);
+
+    // Wrapped, with room enough
+    CU_ASSERT_FATAL(NULL != (b = buffer_wrapped(16, 12, 8)));
+    CU_ASSERT_FATAL(NULL != (ptr = cupkee_buffer_ptr(b)));
+    for (i = 0; i < 8; i++) {
+        CU_ASSERT(ptr[i] == i);
+    }
+    CU_ASSERT(8 == cupkee_buffer_length(b));
+    cupkee_buffer_release(b);
+
+    // Wrapped and full: rotate
+    for (i = 1; i < 16; i++) {
+        int j;
+
+        CU_ASSERT_FATAL(NULL != (b = buffer_wrapped(16, i, 16)));
+        CU_ASSERT_FATAL(NULL != (ptr = cupkee_buffer_ptr(b)));
+        for (j = 0; j < 16; j++) {
+            CU_ASSERT(ptr[j] == j);
+        }
+
+        // Still work as ring
+        CU_ASSERT(cupkee_buffer_is_full(b));
+        CU_ASSERT(16 == cupkee_buffer_take(b, 16, ptr) && ptr[15] == 15);
+        cupkee_buffer_release(b);
+    }
+
+    // Wrapped, no room enough
+    CU_ASSERT_FATAL(NULL != (b = buffer_wrapped(16, 6, 13)));
+    CU_ASSERT_FATAL(NULL != (ptr = cupkee_buffer_ptr(b)));
+    for (i = 0; i < 13; i++) {
+        CU_ASSERT(ptr[i] == i);
+    }
+    CU_ASSERT(1 == cupkee_buffer_push(b, 13));
+    CU_ASSERT(ptr[13] == 13);
+    cupkee_buffer_release(b);
+}
+
+static void test_chain(void)
+{
+    cupkee_chain_t c, r;
+    cupkee_iovec_t iov[16];
+    uint8_t data[600], out[600];
+    int i, n, total;
+
+    for (i = 0; i < 600; i++) {
+        data[i] = i;
+    }
+
+    cupkee_chain_init(&c);
+    CU_ASSERT(0 == cupkee_chain_length(&c));
+    CU_ASSERT(0 == cupkee_chain_iov(&c, iov, 16));
+    CU_ASSERT(0 == cupkee_chain_consume(&c, 10));
+
+    // Assembled from small blocks
+    CU_ASSERT(500 == cupkee_chain_append(&c, 500, data));
+    CU_ASSERT(100 == cupkee_chain_append(&c, 100, data + 500));
+    CU_ASSERT(600 == cupkee_chain_length(&c));
+    n = cupkee_chain_iov(&c, iov, 16);
+    CU_ASSERT(n > 1);
+    for (i = 0, total = 0; i < n; i++) {
+        CU_ASSERT(iov[i].len <= CUPKEE_CHAIN_SEG_SIZE);
+        total += iov[i].len;
+    }
+    CU_ASSERT(600 == total);
+    CU_ASSERT(600 == cupkee_chain_gather(&c, 0, 600, out));
+    CU_ASSERT(0 == memcmp(out, data, 600));
+    CU_ASSERT(5 == cupkee_chain_gather(&c, 595, 10, out));
+    CU_ASSERT(0 == memcmp(out, data + 595, 5));
+
+    // Headers
+    CU_ASSERT(-CUPKEE_EINVAL == cupkee_chain_prepend(&c, CUPKEE_CHAIN_SEG_SIZE, data));
+    CU_ASSERT(2 == cupkee_chain_prepend(&c, 2, "\x01\x02"));
+    CU_ASSERT(1 == cupkee_chain_prepend(&c, 1, "\x00"));
+    CU_ASSERT(n + 1 == cupkee_chain_iov(&c, iov, 16));
+    CU_ASSERT(603 == cupkee_chain_length(&c));
+    CU_ASSERT(4 == cupkee_chain_gather(&c, 0, 4, out));
+    CU_ASSERT(out[0] == 0 && out[1] == 1 && out[2] == 2 && out[3] == 0);
+
+    // Split in the middle of segment, and on the boundary
+    CU_ASSERT(0 == cupkee_chain_split(&c, 103, &r));
+    CU_ASSERT(103 == cupkee_chain_length(&c));
+    CU_ASSERT(500 == cupkee_chain_length(&r));
+    CU_ASSERT(500 == cupkee_chain_gather(&r, 0, 600, out));
+    CU_ASSERT(0 == memcmp(out, data + 100, 500));
+    CU_ASSERT(100 == cupkee_chain_consume(&c, 100));
+    CU_ASSERT(3 == cupkee_chain_gather(&c, 0, 10, out));
+    CU_ASSERT(0 == memcmp(out, data + 97, 3));
+    CU_ASSERT(3 == cupkee_chain_append(&c, 3, data + 100));
+    CU_ASSERT(6 == cupkee_chain_length(&c));
+    cupkee_chain_release(&c);
+
+    cupkee_chain_iov(&r, iov, 1);
+    n = iov[0].len;
+    CU_ASSERT(0 == cupkee_chain_split(&r, n, &c));
+    CU_ASSERT(1 == cupkee_chain_iov(&r, iov, 16));
+    CU_ASSERT(500 - n == (int)cupkee_chain_length(&c));
+    CU_ASSERT(0 == cupkee_chain_split(&r, 0, &c));
+    CU_ASSERT(0 == cupkee_chain_length(&r));
+    CU_ASSERT(n == (int)cupkee_chain_length(&c));
+    CU_ASSERT(n == cupkee_chain_consume(&c, 1000));
+    CU_ASSERT(0 == cupkee_chain_iov(&c, iov, 16));
+
+    // Usable after consumed
+    CU_ASSERT(10 == cupkee_chain_append(&c, 10, data));
+    CU_ASSERT(10 == cupkee_chain_gather(&c, 0, 10, out));
+    CU_ASSERT(0 == memcmp(out, data, 10));
+    cupkee_chain_release(&c);
+    cupkee_chain_release(&r);
+}
+
+static void test_access(void)
+{
+    uint8_t d, out[16];
+    void *b, *s;
+    int i;
+
+    // Data wrapped at offset 4
+    CU_ASSERT_FATAL(NULL != (b = buffer_wrapped(16, 12, 10)));
+
+    CU_ASSERT(1 == cupkee_buffer_get(b, 0, &d) && d == 0);
+    CU_ASSERT(1 == cupkee_buffer_get(b, 9, &d) && d == 9);
+    CU_ASSERT(0 == cupkee_buffer_get(b, 10, &d));
+    CU_ASSERT(0 == cupkee_buffer_get(b, -1, &d));
+    CU_ASSERT(1 == cupkee_buffer_set(b, 5, 0x55));
+    CU_ASSERT(0 == cupkee_buffer_set(b, 10, 0x55));
+    CU_ASSERT(1 == cupkee_buffer_get(b, 5, &d) && d == 0x55);
+    CU_ASSERT(1 == cupkee_buffer_set(b, 5, 5));
+
+    CU_ASSERT(6 == cupkee_buffer_peek(b, 2, 6, out));
+    for (i = 0; i < 6; i++) {
+        CU_ASSERT(out[i] == i + 2);
+    }
+    CU_ASSERT(2 == cupkee_buffer_peek(b, 8, 6, out));
+    CU_ASSERT(0 == cupkee_buffer_peek(b, 10, 6, out));
+    CU_ASSERT(10 == cupkee_buffer_length(b));
+
+    CU_ASSERT_FATAL(NULL != (s = cupkee_buffer_slice(b, 3, 4)));
+    CU_ASSERT(4 == cupkee_buffer_length(s) && 4 == cupkee_buffer_capacity(s));
+    CU_ASSERT(4 == cupkee_buffer_take(s, 16, out));
+    CU_ASSERT(out[0] == 3 && out[3] == 6);
+    cupkee_buffer_release(s);
+
+    CU_ASSERT_FATAL(NULL != (s = cupkee_buffer_slice(b, 8, 100)));
+    CU_ASSERT(2 == cupkee_buffer_length(s));
+    cupkee_buffer_release(s);
+    CU_ASSERT(NULL == cupkee_buffer_slice(b, 11, 1));
+
+    CU_ASSERT_FATAL(NULL != (s = cupkee_buffer_copy(b)));
+    CU_ASSERT(10 == cupkee_buffer_length(s) && 16 == cupkee_buffer_capacity(s));
+    CU_ASSERT(10 == cupkee_buffer_take(s, 16, out));
+    for (i = 0; i < 10; i++) {
+        CU_ASSERT(out[i] == i);
+    }
+    cupkee_buffer_release(s);
+
+    // Reverse in place, wrapped or not
+    CU_ASSERT(b == cupkee_buffer_reverse(b));
+    for (i = 0; i < 10; i++) {
+        CU_ASSERT(1 == cupkee_buffer_get(b, i, &d) && d == 9 - i);
+    }
+    CU_ASSERT(1 == cupkee_buffer_push(b, 10));
+    CU_ASSERT(b == cupkee_buffer_reverse(b));
+    CU_ASSERT(1 == cupkee_buffer_get(b, 0, &d) && d == 10);
+    CU_ASSERT(1 == cupkee_buffer_get(b, 10, &d) && d == 9);
+
+    // Sort
+    CU_ASSERT(b == cupkee_buffer_sort(b));
+    for (i = 0; i < 11; i++) {
+        CU_ASSERT(1 == cupkee_buffer_get(b, i, &d) && d == i);
+    }
+    cupkee_buffer_reset(b);
+    CU_ASSERT(b == cupkee_buffer_sort(b));
+    CU_ASSERT(b == cupkee_buffer_reverse(b));
+    cupkee_buffer_give(b, 8, "\x05\x01\xff\x05\x00\x80\x01\x7f");
+    cupkee_buffer_sort(b);
+    CU_ASSERT(8 == cupkee_buffer_take(b, 8, out));
+    CU_ASSERT(0 == memcmp(out, "\x00\x01\x01\x05\x05\x7f\x80\xff", 8));
+
+    cupkee_buffer_release(b);
+}
+
+static void test_order(void)
+{
+    uint8_t out[64];
+    int bgn, len, i;
+    void *b;
+
+    // Every start and length, word and byte paths, wrapped or not
+    for (bgn = 0; bgn < 64; bgn += 5) {
+        for (len = 1; len <= 64; len += 3) {
+            CU_ASSERT_FATAL(NULL != (b = buffer_wrapped(64, bgn, len)));
+
+            CU_ASSERT(b == cupkee_buffer_reverse(b));
+            CU_ASSERT(len == cupkee_buffer_peek(b, 0, 64, out));
+            for (i = 0; i < len && out[i] == len - 1 - i; i++)
+                ;
+            CU_ASSERT(i == len);
+
+            CU_ASSERT(b == cupkee_buffer_sort(b));
+            CU_ASSERT(len == cupkee_buffer_peek(b, 0, 64, out));
+            for (i = 0; i < len && out[i] == i; i++)
+                ;
+            CU_ASSERT(i == len);
+
+            cupkee_buffer_release(b);
+        }
+    }
+}
+
+static void test_read(void)
+{
+    static const uint8_t data[] = {
+        0xfe, 0x12, 0x34, 0x56, 0x78, 0x3f, 0x80, 0x00, 0x00,
+        0x3f, 0xf0, 0, 0, 0, 0, 0, 0
+    };
+    int8_t i8;
+    uint8_t u8;
+    int16_t i16;
+    uint16_t u16, a16[8];
+    int32_t i32;
+    uint32_t u32, a32[4];
+    float f;
+    double d;
+    void *b;
+    int i;
+
+    // Wrapped inside the float
+    CU_ASSERT_FATAL(NULL != (b = buffer_wrapped(20, 13, 0)));
+    CU_ASSERT(sizeof(data) == cupkee_buffer_give(b, sizeof(data), data));
+
+    CU_ASSERT(1 == cupkee_buffer_read_int8(b, 0, &i8) && i8 == -2);
+    CU_ASSERT(1 == cupkee_buffer_read_uint8(b, 0, &u8) && u8 == 0xfe);
+    CU_ASSERT(2 == cupkee_buffer_read_int16_le(b, 0, &i16) && i16 == 0x12fe);
+    CU_ASSERT(2 == cupkee_buffer_read_int16_be(b, 0, &i16) && i16 == (int16_t)0xfe12);
+    CU_ASSERT(2 == cupkee_buffer_read_uint16_le(b, 1, &u16) && u16 == 0x3412);
+    CU_ASSERT(2 == cupkee_buffer_read_uint16_be(b, 1, &u16) && u16 == 0x1234);
+    CU_ASSERT(4 == cupkee_buffer_read_int32_be(b, 0, &i32) && i32 == (int32_t)0xfe123456);
+    CU_ASSERT(4 == cupkee_buffer_read_int32_le(b, 0, &i32) && i32 == 0x563412fe);
+    CU_ASSERT(4 == cupkee_buffer_read_uint32_be(b, 1, &u32) && u32 == 0x12345678);
+    CU_ASSERT(4 == cupkee_buffer_read_uint32_le(b, 1, &u32) && u32 == 0x78563412);
+    CU_ASSERT(4 == cupkee_buffer_read_float_be(b, 5, &f) && f == 1.0);
+    CU_ASSERT(8 == cupkee_buffer_read_double_be(b, 9, &d) && d == 1.0);
+
+    CU_ASSERT(0 == cupkee_buffer_read_double_be(b, 10, &d));
+    CU_ASSERT(0 == cupkee_buffer_read_uint8(b, 17, &u8));
+    CU_ASSERT(0 == cupkee_buffer_read_uint8(b, -1, &u8));
+
+    // Arrays
+    CU_ASSERT(8 == cupkee_buffer_read_be(b, 1, 2, 100, a16));
+    CU_ASSERT(a16[0] == 0x1234 && a16[1] == 0x5678 && a16[2] == 0x3f80 && a16[4] == 0x3ff0);
+    CU_ASSERT(3 == cupkee_buffer_read_le(b, 1, 2, 3, a16));
+    CU_ASSERT(a16[0] == 0x3412 && a16[1] == 0x7856 && a16[2] == 0x803f);
+    CU_ASSERT(4 == cupkee_buffer_read_be(b, 1, 4, 4, a32));
+    CU_ASSERT(a32[0] == 0x12345678 && a32[1] == 0x3f800000 && a32[2] == 0x3ff00000);
+    CU_ASSERT(0 == cupkee_buffer_read_be(b, 1, 3, 4, a32));
+    CU_ASSERT(0 == cupkee_buffer_read_be(b, 17, 1, 4, a32));
+    for (i = 0; i < 4; i++) {
+        CU_ASSERT(1 == cupkee_buffer_read_le(b, i, 1, 1, &u8) && u8 == data[i]);
+    }
+
+    cupkee_buffer_release(b);
+}
+
+static void test_share(void)
+{
+    uint8_t out[8];
+    void *b, *w;
+    int i;
+
+    CU_ASSERT_FATAL(NULL != (b = cupkee_buffer_create(8, "12345678")));
+    CU_ASSERT(!cupkee_buffer_is_shared(b));
+    CU_ASSERT(b == cupkee_buffer_writable(b));
+
+    // Three holders
+    CU_ASSERT(b == cupkee_buffer_share(b));
+    CU_ASSERT(b == cupkee_buffer_share(b));
+    CU_ASSERT(cupkee_buffer_is_shared(b));
+
+    // Not changed by any holder
+    CU_ASSERT(0 == cupkee_buffer_shift(b, out));
+    CU_ASSERT(0 == cupkee_buffer_pop(b, out));
+    CU_ASSERT(0 == cupkee_buffer_take(b, 8, out));
+    CU_ASSERT(0 == cupkee_buffer_consume(b, 4));
+    CU_ASSERT(0 == cupkee_buffer_set(b, 0, 'x'));
+    CU_ASSERT(NULL == cupkee_buffer_sort(b));
+    CU_ASSERT(NULL == cupkee_buffer_reverse(b));
+    cupkee_buffer_reset(b);
+    CU_ASSERT(8 == cupkee_buffer_extend(b, -4));
+    CU_ASSERT(8 == cupkee_buffer_length(b));
+    CU_ASSERT(8 == cupkee_buffer_peek(b, 0, 8, out));
+    CU_ASSERT(0 == memcmp(out, "12345678", 8));
+
+    // Copy on write
+    CU_ASSERT_FATAL(NULL != (w = cupkee_buffer_writable(b)));
+    CU_ASSERT(w != b && !cupkee_buffer_is_shared(w));
+    CU_ASSERT(8 == cupkee_buffer_take(w, 8, out));
+    CU_ASSERT(0 == memcmp(out, "12345678", 8));
+    CU_ASSERT(8 == cupkee_buffer_length(b));
+    cupkee_buffer_release(w);
+
+    // Freed by the last holder
+    cupkee_buffer_release(b);
+    CU_ASSERT(!cupkee_buffer_is_shared(b));
+    CU_ASSERT(b == cupkee_buffer_writable(b));
+    cupkee_buffer_release(b);
+
+    // Wrapped shared data is not filled
+    CU_ASSERT_FATAL(NULL != (b = cupkee_buffer_alloc(8)));
+    CU_ASSERT(6 == cupkee_buffer_give(b, 6, "abcdef"));
+    CU_ASSERT(4 == cupkee_buffer_consume(b, 4));
+    CU_ASSERT(4 == cupkee_buffer_give(b, 4, "ghij"));
+    CU_ASSERT(b == cupkee_buffer_share(b));
+    CU_ASSERT(0 == cupkee_buffer_give(b, 2, "kl"));
+    CU_ASSERT(0 == cupkee_buffer_push(b, 'k'));
+    CU_ASSERT(0 == cupkee_buffer_unshift(b, 'k'));
+    cupkee_buffer_release(b);
+    CU_ASSERT(NULL != (w = cupkee_buffer_ptr(b)));
+    CU_ASSERT(0 == memcmp(w, "efghij", 6));
+    cupkee_buffer_release(b);
+
+    // Reference saturated
+    CU_ASSERT_FATAL(NULL != (b = cupkee_buffer_alloc(8)));
+    for (i = 1; i < 255; i++) {
+        CU_ASSERT(b == cupkee_buffer_share(b));
+    }
+    CU_ASSERT(NULL == cupkee_buffer_share(b));
+    for (i = 0; i < 254; i++) {
+        cupkee_buffer_release(b);
+    }
+    CU_ASSERT(!cupkee_buffer_is_shared(b));
+    cupkee_buffer_release(b);
+
+    // Shared movable buffer is pinned
+    CU_ASSERT_FATAL(NULL != (b = cupkee_buffer_alloc_movable(2000)));
+    cupkee_buffer_ref(b, &b);
+    CU_ASSERT(b == cupkee_buffer_share(b));
+    w = b;
+    cupkee_memory_compact(100);
+    CU_ASSERT(w == b);
+    cupkee_buffer_release(b);
+    cupkee_buffer_release(b);
+}
+
+CU_pSuite test_sys_buffer(void)
+{
+    CU_pSuite suite = CU_add_suite("system buffer", test_setup, test_clean);
+
+    if (suite) {
+        CU_add_test(suite, "iovec            ", test_iov);
+        CU_add_test(suite, "ptr              ", test_ptr);
+        CU_add_test(suite, "chain            ", test_chain);
+        CU_add_test(suite, "access           ", test_access);
+        CU_add_test(suite, "order            ", test_order);
+        CU_add_test(suite, "read             ", test_read);
+        CU_add_test(suite, "share            ", test_share);
+    }
+
+    return suite;
+}
+
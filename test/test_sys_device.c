@@ -19,6 +19,9 @@
 
 #include <stdio.h>
 #include <string.h>
+#ifdef CUPKEE_TEST_BENCH
+#include <time.h>
+#endif
 
 #include "test.h"
 
@@ -29,6 +32,7 @@ struct mock_data_t {
     int want;
     int r_req;
     int w_req;
+    int polls;
 };
 
 struct mock_handle_param_t {
@@ -77,6 +81,14 @@ static int mock_reset(int inst)
     return 0;
 }
 
+static int mock_poll(int inst)
+{
+    (void) inst;
+
+    mock_data.polls++;
+    return 0;
+}
+
 static int mock_query(int inst, int want)
 {
     mock_data.inst = inst;
@@ -162,6 +174,7 @@ static const cupkee_driver_t mock_driver = {
     .release = mock_release,
     .setup   = mock_setup,
     .reset   = mock_reset,
+    .poll    = mock_poll,
 
     .query   = mock_query,
 
@@ -243,12 +256,19 @@ static int test_clean(void)
 
 static void test_request(void)
 {
+    cupkee_object_stat_t stat;
     void *d1;
     void *d2;
 
+    // Device objects come from slab cache, once it is enabled
+    CU_ASSERT(0 == cupkee_object_cache(cupkee_device_tag(), 1));
+
     CU_ASSERT(NULL != (d1 = cupkee_device_request("mock", 0)));
     CU_ASSERT(0 == mock_curr_inst());
 
+    CU_ASSERT(0 == cupkee_object_stat(cupkee_device_tag(), &stat));
+    CU_ASSERT(1 == stat.inuse && 1 == stat.pages);
+
     CU_ASSERT(NULL != (d2 = cupkee_device_request("mock", 1)));
     CU_ASSERT(1 == mock_curr_inst());
 
@@ -390,6 +410,128 @@ static void test_query(void)
     CU_ASSERT(mock_curr_event() == CUPKEE_EVENT_DESTROY);
 }
 
+static void test_poll(void)
+{
+    void *d;
+
+    CU_ASSERT_FATAL(NULL != (d = cupkee_device_request("mock", 0)));
+    CU_ASSERT(-CUPKEE_EINVAL == cupkee_device_poll_set(NULL, 0));
+
+    _cupkee_systicks = 100;
+    mock_data.polls = 0;
+
+    // Polled in every loop by default
+    CU_ASSERT(0 == cupkee_device_enable(d));
+    cupkee_device_poll();
+    cupkee_device_poll();
+    CU_ASSERT(2 == mock_data.polls);
+    CU_ASSERT(0 == cupkee_device_next(_cupkee_systicks));
+
+    // Only polled when marked ready
+    CU_ASSERT(0 == cupkee_device_poll_set(d, CUPKEE_DEVICE_POLL_NONE));
+    cupkee_device_poll();
+    CU_ASSERT(2 == mock_data.polls);
+    CU_ASSERT(CUPKEE_TICKS_FOREVER == cupkee_device_next(_cupkee_systicks));
+
+    cupkee_device_ready(d);
+    CU_ASSERT(0 == cupkee_device_next(_cupkee_systicks));
+    cupkee_device_poll();
+    cupkee_device_poll();
+    CU_ASSERT(3 == mock_data.polls);
+
+    // Polled periodically
+    CU_ASSERT(0 == cupkee_device_poll_set(d, 10));
+    CU_ASSERT(10 == cupkee_device_next(_cupkee_systicks));
+    cupkee_device_poll();
+    CU_ASSERT(3 == mock_data.polls);
+
+    _cupkee_systicks += 9;
+    CU_ASSERT(1 == cupkee_device_next(_cupkee_systicks));
+    cupkee_device_poll();
+    CU_ASSERT(3 == mock_data.polls);
+
+    _cupkee_systicks += 1;
+    CU_ASSERT(0 == cupkee_device_next(_cupkee_systicks));
+    cupkee_device_poll();
+    CU_ASSERT(4 == mock_data.polls);
+    CU_ASSERT(10 == cupkee_device_next(_cupkee_systicks));
+
+    // Not polled after disabled
+    CU_ASSERT(0 == cupkee_device_disable(d));
+    _cupkee_systicks += 10;
+    cupkee_device_poll();
+    CU_ASSERT(4 == mock_data.polls);
+
+    cupkee_device_release(d);
+    while (TU_object_event_dispatch())
+        ;
+}
+
+static int mock_queue_resp[CUPKEE_DEVICE_QUERY_MAX];
+static int mock_queue_cnt;
+
+static int mock_queue_handle(void *entry, int event, intptr_t param)
+{
+    void *resp = cupkee_device_response_take(entry);
+
+    (void) event;
+
+    mock_queue_resp[param] = resp ? (int)cupkee_buffer_length(resp) : -1;
+    mock_queue_cnt++;
+
+    if (resp) {
+        cupkee_buffer_release(resp);
+    }
+    return 0;
+}
+
+static void test_query_queue(void)
+{
+    void *d;
+    int i;
+
+    CU_ASSERT_FATAL(NULL != (d = cupkee_device_request("mock", 0)));
+    CU_ASSERT(0 == cupkee_device_enable(d));
+
+    mock_queue_cnt = 0;
+    for (i = 0; i < CUPKEE_DEVICE_QUERY_MAX; i++) {
+        mock_queue_resp[i] = 0;
+        CU_ASSERT(0 == cupkee_device_query(d, 1, "x", i + 1, mock_queue_handle, i));
+    }
+    // Queue is full
+    CU_ASSERT(-CUPKEE_EBUSY == cupkee_device_query(d, 1, "x", 1, mock_queue_handle, 0));
+
+    // Only the first one started
+    CU_ASSERT(1 == mock_curr_want());
+
+    // Next query start from response end, without dispatch
+    for (i = 0; i < 4; i++) {
+        CU_ASSERT(i + 1 == (int)mock_curr_want());
+        CU_ASSERT(i + 1 == cupkee_device_response_push(d, 8, "12345678"));
+        cupkee_device_response_end(d);
+    }
+    CU_ASSERT(5 == mock_curr_want());
+    CU_ASSERT(0 == mock_queue_cnt);
+
+    while (TU_object_event_dispatch())
+        ;
+    CU_ASSERT(4 == mock_queue_cnt);
+    for (i = 0; i < 4; i++) {
+        CU_ASSERT(i + 1 == mock_queue_resp[i]);
+    }
+
+    // Pending queries are aborted when disabled
+    CU_ASSERT(0 == cupkee_device_disable(d));
+    CU_ASSERT(CUPKEE_DEVICE_QUERY_MAX == mock_queue_cnt);
+    for (i = 4; i < CUPKEE_DEVICE_QUERY_MAX; i++) {
+        CU_ASSERT(-1 == mock_queue_resp[i]);
+    }
+
+    cupkee_device_release(d);
+    while (TU_object_event_dispatch())
+        ;
+}
+
 static void test_read(void)
 {
     void *dev;
@@ -552,6 +694,171 @@ static void test_config(void)
     cupkee_release(dev);
 }
 
+static void test_stream_conf(void)
+{
+    void *dev;
+    intptr_t n;
+    uint8_t buf[64];
+
+    memset(buf, 1, sizeof(buf));
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("mock", 1)));
+
+    // default
+    CU_ASSERT(cupkee_prop_get(dev, "rxBufSize", &n) == CUPKEE_OBJECT_ELEM_INT && n == CUPKEE_STREAM_BUF_SIZE);
+    CU_ASSERT(cupkee_prop_get(dev, "txBufSize", &n) == CUPKEE_OBJECT_ELEM_INT && n == CUPKEE_STREAM_BUF_SIZE);
+    CU_ASSERT(cupkee_prop_get(dev, "adaptive",  &n) == CUPKEE_OBJECT_ELEM_BOOL && n == 0);
+
+    // invalid setting
+    CU_ASSERT(0 > cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, 0));
+    CU_ASSERT(0 > cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, CUPKEE_STREAM_BUF_MAX + 1));
+
+    CU_ASSERT(0 < cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, 64));
+    CU_ASSERT(0 < cupkee_prop_set(dev, "rxWatermark", CUPKEE_OBJECT_ELEM_INT, 8));
+    CU_ASSERT(0 < cupkee_prop_set(dev, "rxIdle", CUPKEE_OBJECT_ELEM_INT, 0xffff));
+    CU_ASSERT(cupkee_prop_get(dev, "rxIdle", &n) == CUPKEE_OBJECT_ELEM_INT && n == 0xffff);
+    CU_ASSERT(0 > cupkee_prop_set(dev, "rxIdle", CUPKEE_OBJECT_ELEM_INT, 0x10000));
+    CU_ASSERT(0 > cupkee_prop_set(dev, "rxIdle", CUPKEE_OBJECT_ELEM_INT, -1));
+    CU_ASSERT(0 < cupkee_prop_set(dev, "rxIdle", CUPKEE_OBJECT_ELEM_INT, 5));
+    CU_ASSERT(0 > cupkee_prop_set(dev, "rxWatermark", CUPKEE_OBJECT_ELEM_INT, 65));
+
+    CU_ASSERT(0 == cupkee_device_enable(dev));
+    CU_ASSERT(0 == cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, 32));
+    CU_ASSERT(0 == cupkee_device_handle_set(dev, mock_handle, (intptr_t) &mock_handle_arg));
+    cupkee_listen(dev, CUPKEE_EVENT_DATA);
+    while (TU_object_event_dispatch())
+        ;
+    mock_arg_release();
+
+    // Notify at water mark
+    CU_ASSERT(7 == cupkee_device_push(dev, 7, buf));
+    CU_ASSERT(0 == TU_object_event_dispatch());
+    CU_ASSERT(1 == cupkee_device_push(dev, 1, buf));
+    CU_ASSERT(1 == TU_object_event_dispatch());
+    CU_ASSERT(mock_handle_arg.event == CUPKEE_EVENT_DATA);
+    CU_ASSERT(56 == cupkee_device_push(dev, 64, buf));
+    CU_ASSERT(64 == cupkee_read(dev, 64, buf));
+    while (TU_object_event_dispatch())
+        ;
+
+    // Notify after idle ticks
+    _cupkee_systicks = 0;
+    CU_ASSERT(1 == cupkee_device_push(dev, 1, buf));
+    cupkee_device_sync(5);
+    CU_ASSERT(0 == TU_object_event_dispatch());
+    cupkee_device_sync(6);
+    CU_ASSERT(1 == TU_object_event_dispatch());
+    CU_ASSERT(1 == cupkee_read(dev, 1, buf));
+
+    CU_ASSERT(0 == cupkee_device_disable(dev));
+    // setting reset after disable
+    CU_ASSERT(cupkee_prop_get(dev, "rxBufSize", &n) == CUPKEE_OBJECT_ELEM_INT && n == CUPKEE_STREAM_BUF_SIZE);
+
+    // Adaptive: grow when overflow, shrink back when idle
+    CU_ASSERT(0 < cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, 16));
+    CU_ASSERT(0 < cupkee_prop_set(dev, "adaptive", CUPKEE_OBJECT_ELEM_BOOL, 1));
+    _cupkee_systicks = 0;
+    CU_ASSERT(0 == cupkee_device_enable(dev));
+
+    CU_ASSERT(40 == cupkee_device_push(dev, 40, buf));
+    CU_ASSERT(cupkee_prop_get(dev, "rxBufSize", &n) == CUPKEE_OBJECT_ELEM_INT && n == 64);
+    CU_ASSERT(40 == cupkee_read(dev, 64, buf));
+
+    cupkee_device_sync(CUPKEE_STREAM_ADAPT_TICKS);
+    CU_ASSERT(cupkee_prop_get(dev, "rxBufSize", &n) == CUPKEE_OBJECT_ELEM_INT && n == 64);
+    cupkee_device_sync(CUPKEE_STREAM_ADAPT_TICKS * 2);
+    CU_ASSERT(cupkee_prop_get(dev, "rxBufSize", &n) == CUPKEE_OBJECT_ELEM_INT && n == 32);
+    cupkee_device_sync(CUPKEE_STREAM_ADAPT_TICKS * 3);
+    cupkee_device_sync(CUPKEE_STREAM_ADAPT_TICKS * 4);
+    CU_ASSERT(cupkee_prop_get(dev, "rxBufSize", &n) == CUPKEE_OBJECT_ELEM_INT && n == 16);
+
+    cupkee_release(dev);
+    while (TU_object_event_dispatch())
+        ;
+    mock_arg_release();
+}
+
+static void mock_uart_loopback(void *dev, size_t total)
+{
+    uint8_t buf[64];
+    int n, off;
+
+    hw_mock_uart_rx_feed(total);
+    while (hw_mock_uart_tx_count() < total) {
+        cupkee_device_poll();
+
+        n = cupkee_read(dev, sizeof(buf), buf);
+        for (off = 0; off < n; cupkee_device_poll()) {
+            off += cupkee_write(dev, n - off, buf + off);
+        }
+    }
+}
+
+static void test_bulk_io(void)
+{
+    void *dev;
+    size_t total = 1000;
+
+    // byte by byte
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("mock-uart", 0)));
+    CU_ASSERT(0 == cupkee_device_enable(dev));
+
+    hw_mock_uart_bulk_set(0);
+    mock_uart_loopback(dev, total);
+    CU_ASSERT(total == hw_mock_uart_tx_count());
+    CU_ASSERT(0 == hw_mock_uart_tx_error());
+
+    cupkee_release(dev);
+    while (TU_object_event_dispatch())
+        ;
+
+    // reserve & commit
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("mock-uart", 0)));
+    CU_ASSERT(0 == cupkee_device_enable(dev));
+
+    hw_mock_uart_bulk_set(1);
+    mock_uart_loopback(dev, total);
+    CU_ASSERT(total == hw_mock_uart_tx_count());
+    CU_ASSERT(0 == hw_mock_uart_tx_error());
+
+    cupkee_release(dev);
+    while (TU_object_event_dispatch())
+        ;
+}
+
+#ifdef CUPKEE_TEST_BENCH
+/* Loopback throughput in bytes per second, byte by byte or bulk */
+static double mock_uart_bench(int bulk, size_t total)
+{
+    void *dev;
+    clock_t begin;
+    double secs;
+
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("mock-uart", 0)));
+    CU_ASSERT(0 == cupkee_device_enable(dev));
+
+    hw_mock_uart_bulk_set(bulk);
+    begin = clock();
+    mock_uart_loopback(dev, total);
+    secs = (double)(clock() - begin) / CLOCKS_PER_SEC;
+    CU_ASSERT(total == hw_mock_uart_tx_count());
+
+    cupkee_release(dev);
+    while (TU_object_event_dispatch())
+        ;
+
+    return secs > 0 ? total / secs : 0;
+}
+
+static void bench_bulk_io(void)
+{
+    size_t total = 1024 * 64;
+    double byte_rate = mock_uart_bench(0, total);
+    double bulk_rate = mock_uart_bench(1, total);
+
+    printf("\n    loopback byte: %.0f B/s, bulk: %.0f B/s ", byte_rate, bulk_rate);
+}
+#endif
+
 CU_pSuite test_sys_device(void)
 {
     CU_pSuite suite = CU_add_suite("system device", test_setup, test_clean);
@@ -559,10 +866,17 @@ CU_pSuite test_sys_device(void)
     if (suite) {
         CU_add_test(suite, "device request   ", test_request);
         CU_add_test(suite, "device enable    ", test_enable);
+        CU_add_test(suite, "device poll      ", test_poll);
 
         CU_add_test(suite, "device query     ", test_query);
+        CU_add_test(suite, "device query fifo", test_query_queue);
         CU_add_test(suite, "device read      ", test_read);
         CU_add_test(suite, "device write     ", test_write);
+        CU_add_test(suite, "device bulk io   ", test_bulk_io);
+#ifdef CUPKEE_TEST_BENCH
+        CU_add_test(suite, "device bulk bench", bench_bulk_io);
+#endif
+        CU_add_test(suite, "device stream cfg", test_stream_conf);
 
         CU_add_test(suite, "device event     ", test_event);
 
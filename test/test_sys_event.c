@@ -67,6 +67,78 @@ static void test_post_take(void)
     cupkee_event_reset();
 }
 
+static void test_overflow(void)
+{
+    int i;
+    cupkee_event_t e;
+
+    cupkee_event_setup();
+
+    CU_ASSERT(cupkee_event_is_empty());
+    for (i = 0; i < CUPKEE_EVENTQ_SIZE; i++) {
+        CU_ASSERT(1 == cupkee_event_post(EVENT_OBJECT, 1, i));
+    }
+    CU_ASSERT(0 == cupkee_event_post(EVENT_OBJECT, 1, i));
+    CU_ASSERT(0 == cupkee_event_post(EVENT_PIN, 1, i));
+    CU_ASSERT(0 == cupkee_event_post(EVENT_PIN, 1, i));
+    CU_ASSERT(0 == cupkee_event_post(99, 1, i));
+
+    CU_ASSERT(1 == cupkee_event_drops(EVENT_OBJECT));
+    CU_ASSERT(2 == cupkee_event_drops(EVENT_PIN));
+    CU_ASSERT(0 == cupkee_event_drops(EVENT_SYSTICK));
+    CU_ASSERT(1 == cupkee_event_drops(EVENT_TYPE_MAX));
+    CU_ASSERT(CUPKEE_EVENTQ_SIZE == cupkee_event_high_water());
+
+    for (i = 0; i < CUPKEE_EVENTQ_SIZE; i++) {
+        CU_ASSERT(1 == cupkee_event_take(&e));
+        CU_ASSERT(e.type == EVENT_OBJECT && e.which == i);
+    }
+    CU_ASSERT(0 == cupkee_event_take(&e));
+    CU_ASSERT(cupkee_event_is_empty());
+
+    // Ring wrap around
+    for (i = 0; i < CUPKEE_EVENTQ_SIZE * 3; i++) {
+        CU_ASSERT(1 == cupkee_event_post(EVENT_PIN, 0, i));
+        CU_ASSERT(1 == cupkee_event_take(&e));
+        CU_ASSERT(e.type == EVENT_PIN && e.which == i);
+    }
+    CU_ASSERT(2 == cupkee_event_drops(EVENT_PIN));
+
+    cupkee_event_stat_reset();
+    CU_ASSERT(0 == cupkee_event_drops(EVENT_PIN));
+    CU_ASSERT(0 == cupkee_event_high_water());
+
+    cupkee_event_reset();
+}
+
+static void test_systick_merge(void)
+{
+    int i;
+    cupkee_event_t e;
+
+    cupkee_event_setup();
+
+    for (i = 0; i < 5; i++) {
+        CU_ASSERT(1 == cupkee_event_post_systick());
+    }
+    CU_ASSERT(1 == cupkee_event_post(EVENT_PIN, 1, 2));
+    CU_ASSERT(1 == cupkee_event_post_systick());
+
+    CU_ASSERT(1 == cupkee_event_take(&e));
+    CU_ASSERT(e.type == EVENT_SYSTICK && e.which == 6);
+    CU_ASSERT(1 == cupkee_event_take(&e));
+    CU_ASSERT(e.type == EVENT_PIN);
+    CU_ASSERT(0 == cupkee_event_take(&e));
+
+    CU_ASSERT(1 == cupkee_event_post_systick());
+    CU_ASSERT(1 == cupkee_event_take(&e));
+    CU_ASSERT(e.type == EVENT_SYSTICK && e.which == 1);
+
+    CU_ASSERT(0 == cupkee_event_drops(EVENT_SYSTICK));
+
+    cupkee_event_reset();
+}
+
 #if 0
 static uint8_t emitter1_storage;
 static uint8_t emitter2_storage;
@@ -149,6 +221,8 @@ CU_pSuite test_sys_event(void)
 
     if (suite) {
         CU_add_test(suite, "post & take      ", test_post_take);
+        CU_add_test(suite, "overflow         ", test_overflow);
+        CU_add_test(suite, "systick merge    ", test_systick_merge);
 //        CU_add_test(suite, "emitter          ", test_emitter);
 //        CU_add_test(suite, "emitter emit     ", test_emitter_emit);
     }
@@ -281,6 +281,434 @@ static void test_memory_alloc(void)
     hw_mock_deinit();
 }
 
+static int free_page_total(void)
+{
+    int i, n = 0;
+
+    for (i = 0; i < CUPKEE_PAGE_ORDERR_MAX; i++) {
+        n += cupkee_free_pages(i) << i;
+    }
+    return n;
+}
+
+static void test_memory_class(void)
+{
+    int i;
+    void *mem[15 * 64];
+
+    hw_mock_init(16 * 1024 + 1023);
+
+    CU_ASSERT(0 == cupkee_memory_setup());
+    CU_ASSERT(15 == free_page_total());
+
+    // 17 ~ 24 Bytes share the 24 Bytes class: 42 blocks per page
+    for (i = 0; i < 42; i++) {
+        CU_ASSERT_FATAL(NULL != (mem[i] = cupkee_malloc(i & 1 ? 20 : 24)));
+    }
+    CU_ASSERT(14 == free_page_total());
+    CU_ASSERT_FATAL(NULL != (mem[42] = cupkee_malloc(17)));
+    CU_ASSERT(13 == free_page_total());
+
+    // Partial page should be reused before a new page taken
+    cupkee_free(mem[3]);
+    CU_ASSERT(mem[3] == cupkee_malloc(24));
+    CU_ASSERT(13 == free_page_total());
+
+    // Empty page return to buddy immediately
+    cupkee_free(mem[42]);
+    CU_ASSERT(14 == free_page_total());
+    for (i = 0; i < 42; i++) {
+        cupkee_free(mem[i]);
+    }
+    CU_ASSERT(15 == free_page_total());
+
+    // Smallest class: 64 blocks per page
+    for (i = 0; i < 15 * 64; i++) {
+        CU_ASSERT_FATAL(NULL != (mem[i] = cupkee_malloc(i % 16 + 1)));
+    }
+    CU_ASSERT(0 == free_page_total());
+    CU_ASSERT(NULL == cupkee_malloc(1));
+    for (i = 0; i < 15 * 64; i++) {
+        cupkee_free(mem[i]);
+    }
+    CU_ASSERT(15 == free_page_total());
+
+    // Mixed classes, one page each
+    CU_ASSERT_FATAL(NULL != (mem[0] = cupkee_malloc(40)));
+    CU_ASSERT_FATAL(NULL != (mem[1] = cupkee_malloc(48)));
+    CU_ASSERT_FATAL(NULL != (mem[2] = cupkee_malloc(96)));
+    CU_ASSERT_FATAL(NULL != (mem[3] = cupkee_malloc(150)));
+    CU_ASSERT_FATAL(NULL != (mem[4] = cupkee_malloc(192)));
+    CU_ASSERT(12 == free_page_total());
+    CU_ASSERT(cupkee_memory_page(mem[0]) == cupkee_memory_page(mem[1]));
+    CU_ASSERT(cupkee_memory_page(mem[3]) == cupkee_memory_page(mem[4]));
+    for (i = 0; i < 5; i++) {
+        cupkee_free(mem[i]);
+    }
+    CU_ASSERT(15 == free_page_total());
+
+    hw_mock_deinit();
+}
+
+static void test_memory_zone(void)
+{
+    int i, boot, slow, n;
+    void *mem[16], *p, *q;
+    void *region;
+
+    hw_mock_init(4 * 1024 + 1023);
+
+    CU_ASSERT(0 == cupkee_memory_setup());
+    boot = free_page_total();
+    CU_ASSERT(boot > 0);
+
+    // Extend zones
+    region = hw_mock_region(4 * 1024 + 1023);
+    CU_ASSERT(0 == cupkee_memory_extend((intptr_t)region, 4 * 1024 + 1023, CUPKEE_MEM_DMA));
+    slow = free_page_total() - boot;
+    CU_ASSERT(slow >= 3);
+
+    region = hw_mock_region(2 * 1024 + 1023);
+    CU_ASSERT(0 == cupkee_memory_extend((intptr_t)region, 2 * 1024 + 1023, CUPKEE_MEM_RETAIN));
+    CU_ASSERT(free_page_total() > boot + slow);
+
+    region = hw_mock_region(64);
+    CU_ASSERT(-CUPKEE_ENOMEM == cupkee_memory_extend((intptr_t)region, 64, 0));
+    region = hw_mock_region(2 * 1024);
+    CU_ASSERT(0 == cupkee_memory_extend((intptr_t)region, 2 * 1024, 0));
+    CU_ASSERT(-CUPKEE_ELIMIT == cupkee_memory_extend((intptr_t)region, 2 * 1024, 0));
+
+    CU_ASSERT(-CUPKEE_EINVAL == cupkee_memory_attr(&n));
+
+    // Default allocation never go to retained zone
+    p = cupkee_malloc_hint(32, CUPKEE_MEM_RETAIN);
+    q = cupkee_malloc(32);
+    CU_ASSERT_FATAL(p && q);
+    CU_ASSERT(CUPKEE_MEM_RETAIN == cupkee_memory_attr(p));
+    CU_ASSERT(CUPKEE_ZONE_BOOT_ATTR == cupkee_memory_attr(q));
+    cupkee_free(p);
+    cupkee_free(q);
+
+    // Fast hint prefer fast zone, fall back to others
+    for (i = 0; i < boot; i++) {
+        CU_ASSERT_FATAL(NULL != (mem[i] = cupkee_malloc_hint(1024, CUPKEE_MEM_FAST)));
+        CU_ASSERT(CUPKEE_ZONE_BOOT_ATTR == cupkee_memory_attr(mem[i]));
+    }
+    p = cupkee_malloc_hint(1024, CUPKEE_MEM_FAST);
+    q = cupkee_malloc_hint(48, CUPKEE_MEM_FAST);
+    CU_ASSERT(p && !(cupkee_memory_attr(p) & CUPKEE_MEM_FAST));
+    CU_ASSERT(q && !(cupkee_memory_attr(q) & CUPKEE_MEM_FAST));
+    cupkee_free(p);
+    cupkee_free(q);
+
+    // DMA is requirement
+    for (i = 0, n = 0; i < slow; i++) {
+        p = cupkee_malloc_hint(1024, CUPKEE_MEM_DMA);
+        CU_ASSERT(p && (cupkee_memory_attr(p) & CUPKEE_MEM_DMA));
+        n += p ? 1 : 0;
+    }
+    CU_ASSERT(n == slow);
+    CU_ASSERT(NULL == cupkee_malloc_hint(32, CUPKEE_MEM_DMA));
+    CU_ASSERT(NULL != (p = cupkee_malloc(32)));
+    CU_ASSERT(0 == cupkee_memory_attr(p));
+    cupkee_free(p);
+
+    for (i = 0; i < boot; i++) {
+        cupkee_free(mem[i]);
+    }
+    CU_ASSERT(NULL != (p = cupkee_malloc_hint(32, CUPKEE_MEM_DMA)));
+    CU_ASSERT(CUPKEE_ZONE_BOOT_ATTR == cupkee_memory_attr(p));
+
+    hw_mock_deinit();
+}
+
+static void test_memory_stat(void)
+{
+    int i;
+    void *mem[16];
+    cupkee_memory_stat_t st;
+    const cupkee_slab_t *q;
+
+    hw_mock_init(16 * 1024 + 1023);
+
+    CU_ASSERT(0 == cupkee_memory_setup());
+
+    cupkee_memory_stat(&st);
+    CU_ASSERT(15 == st.pages && 15 == st.pages_free);
+    CU_ASSERT(0 == st.pages_peak && 0 == st.malloc_fails);
+    // Free: 8 + 4 + 2 + 1, the largest is 8 pages
+    CU_ASSERT(1 == st.free_blocks[3]);
+    CU_ASSERT(100 - 8 * 100 / 15 == st.frag);
+
+    CU_ASSERT(NULL == cupkee_memory_class(-1));
+    CU_ASSERT(NULL == cupkee_memory_class(cupkee_memory_class_num()));
+
+    // Block class counter
+    for (i = 0; i < 3; i++) {
+        CU_ASSERT_FATAL(NULL != (mem[i] = cupkee_malloc(20)));
+    }
+    q = cupkee_memory_class(1);
+    CU_ASSERT(24 == q->size);
+    CU_ASSERT(3 == q->inuse && 3 == q->peak && 1 == q->pages);
+    cupkee_free(mem[0]);
+    CU_ASSERT(2 == q->inuse && 3 == q->peak);
+
+    // Order counter & peak
+    CU_ASSERT(NULL != (mem[0] = cupkee_malloc(2048)));
+    CU_ASSERT(NULL != (mem[3] = cupkee_malloc(4096)));
+    CU_ASSERT(NULL == cupkee_malloc(16 * 1024));
+    cupkee_memory_stat(&st);
+    CU_ASSERT(1 == st.allocs[0] && 1 == st.allocs[1] && 1 == st.allocs[2]);
+    CU_ASSERT(1 == st.malloc_fails);
+    // Counted once, by the order wanted
+    CU_ASSERT(1 == st.fails[4]);
+    CU_ASSERT(0 == st.fails[5] && 0 == st.fails[6] && 0 == st.fails[7]);
+    CU_ASSERT(7 == st.pages_peak);
+    CU_ASSERT(8 == st.pages_free);
+
+    cupkee_free(mem[0]);
+    cupkee_free(mem[3]);
+    cupkee_free(mem[1]);
+    cupkee_free(mem[2]);
+    cupkee_memory_stat(&st);
+    CU_ASSERT(15 == st.pages_free);
+    CU_ASSERT(7 == st.pages_peak);
+    CU_ASSERT(0 == q->pages);
+
+    // Fragmentation: hold one page in every 2 pages
+    for (i = 0; i < 15; i++) {
+        mem[i] = cupkee_malloc(1024);
+    }
+    for (i = 0; i < 15; i += 2) {
+        cupkee_free(mem[i]);
+    }
+    cupkee_memory_stat(&st);
+    CU_ASSERT(8 == st.pages_free);
+    CU_ASSERT(100 - 100 / 8 == st.frag);
+
+    hw_mock_deinit();
+}
+
+static void test_memory_exact(void)
+{
+    int i;
+    void *a, *b, *c;
+
+    hw_mock_init(16 * 1024 + 1023);
+
+    CU_ASSERT(0 == cupkee_memory_setup());
+    CU_ASSERT(15 == free_page_total());
+
+    // Tail of the block is given back
+    CU_ASSERT_FATAL(NULL != (a = cupkee_malloc(5 * 1024 - 10)));
+    CU_ASSERT(10 == free_page_total());
+    memset(a, 0x5a, 5 * 1024 - 10);
+
+    CU_ASSERT_FATAL(NULL != (b = cupkee_malloc(3 * 1024)));
+    CU_ASSERT(7 == free_page_total());
+    memset(b, 0xa5, 3 * 1024);
+
+    CU_ASSERT_FATAL(NULL != (c = cupkee_malloc(1024 + 1)));
+    CU_ASSERT(5 == free_page_total());
+
+    // Recombine on free, in any order
+    cupkee_free(b);
+    CU_ASSERT(8 == free_page_total());
+    cupkee_free(a);
+    CU_ASSERT(13 == free_page_total());
+    cupkee_free(c);
+    CU_ASSERT(15 == free_page_total());
+    for (i = 0; i < 4; i++) {
+        CU_ASSERT(1 == cupkee_free_pages(i));
+    }
+
+    // 7 pages out of the 8 pages block
+    CU_ASSERT_FATAL(NULL != (a = cupkee_malloc(7 * 1024)));
+    CU_ASSERT(8 == free_page_total());
+    CU_ASSERT(2 == cupkee_free_pages(0));
+    CU_ASSERT(NULL == cupkee_malloc(7 * 1024));
+    CU_ASSERT_FATAL(NULL != (b = cupkee_malloc(3 * 1024)));
+    CU_ASSERT(NULL == cupkee_malloc(3 * 1024));
+    CU_ASSERT_FATAL(NULL != (c = cupkee_malloc(2 * 1024)));
+    CU_ASSERT(3 == free_page_total());
+    cupkee_free(a);
+    cupkee_free(c);
+    cupkee_free(b);
+    for (i = 0; i < 4; i++) {
+        CU_ASSERT(1 == cupkee_free_pages(i));
+    }
+
+    hw_mock_deinit();
+}
+
+static void *shrink_cache[4];
+static int    shrink_calls;
+
+static size_t test_shrinker(size_t want)
+{
+    int i;
+
+    (void) want;
+
+    shrink_calls++;
+    for (i = 0; i < 4; i++) {
+        if (shrink_cache[i]) {
+            cupkee_free(shrink_cache[i]);
+            shrink_cache[i] = NULL;
+            return 1024;
+        }
+    }
+    return 0;
+}
+
+static size_t test_shrinker_none(size_t want)
+{
+    (void) want;
+
+    shrink_calls++;
+    return 0;
+}
+
+static void test_memory_reclaim(void)
+{
+    int i;
+    void *mem[16], *p;
+    cupkee_memory_stat_t st;
+
+    hw_mock_init(16 * 1024 + 1023);
+
+    CU_ASSERT(0 == cupkee_memory_setup());
+    CU_ASSERT(-CUPKEE_EINVAL == cupkee_memory_shrinker(NULL));
+    CU_ASSERT(0 == cupkee_memory_shrinker(test_shrinker_none));
+    CU_ASSERT(0 == cupkee_memory_shrinker(test_shrinker));
+    CU_ASSERT(0 == cupkee_memory_shrinker(test_shrinker));
+
+    for (i = 0; i < 4; i++) {
+        CU_ASSERT_FATAL(NULL != (shrink_cache[i] = cupkee_malloc(1024)));
+    }
+    for (i = 0; i < 11; i++) {
+        CU_ASSERT_FATAL(NULL != (mem[i] = cupkee_malloc(1024)));
+    }
+    CU_ASSERT(0 == free_page_total());
+
+    // Shrinkers are called in order, till one of them release something
+    shrink_calls = 0;
+    CU_ASSERT(NULL != (p = cupkee_malloc(100)));
+    CU_ASSERT(2 == shrink_calls);
+    CU_ASSERT(NULL == shrink_cache[0]);
+    CU_ASSERT(NULL != (mem[11] = cupkee_page_alloc(0)));
+    CU_ASSERT(4 == shrink_calls);
+
+    cupkee_memory_stat(&st);
+    CU_ASSERT(2 == st.reclaims);
+    CU_ASSERT(0 == st.malloc_fails);
+
+    // Every shrinker called once
+    CU_ASSERT(1024 == cupkee_memory_reclaim(4096));
+    CU_ASSERT(NULL == shrink_cache[2]);
+    CU_ASSERT(NULL != cupkee_malloc(1024));
+    CU_ASSERT(NULL != cupkee_malloc(1024));
+    CU_ASSERT(NULL == shrink_cache[3]);
+
+    // Fail after all shrinkers tried
+    shrink_calls = 0;
+    CU_ASSERT(NULL == cupkee_malloc(1024));
+    CU_ASSERT(2 == shrink_calls);
+    cupkee_memory_stat(&st);
+    CU_ASSERT(1 == st.malloc_fails);
+
+    hw_mock_deinit();
+}
+
+static void test_memory_movable(void)
+{
+    int i;
+    void *x[16], *m1, *m2, *m3, *a, *b, *p;
+    uint8_t data[1500];
+    cupkee_memory_stat_t st;
+
+    hw_mock_init(16 * 1024 + 1023);
+
+    CU_ASSERT(0 == cupkee_memory_setup());
+
+    // Blocks: movable ones leave the sparse page
+    for (i = 0; i < 16; i++) {
+        CU_ASSERT_FATAL(NULL != (x[i] = cupkee_malloc(64)));
+    }
+    CU_ASSERT(14 == free_page_total());
+    CU_ASSERT_FATAL(NULL != (m1 = cupkee_movable_alloc(32, 0)));
+    CU_ASSERT_FATAL(NULL != (m2 = cupkee_movable_alloc(32, 0)));
+    CU_ASSERT(13 == free_page_total());
+    memset(m1, 0x11, 16);
+    memset(m2, 0x22, 16);
+    for (i = 0; i < 4; i++) {
+        cupkee_free(x[i]);
+    }
+
+    // Not moved without ref
+    CU_ASSERT(0 == cupkee_memory_compact(4));
+    cupkee_movable_ref(m1, &m1);
+    cupkee_movable_ref(m2, &m2);
+
+    // Nor while locked
+    cupkee_movable_lock(m1);
+    p = m1;
+    CU_ASSERT(1 == cupkee_memory_compact(4));
+    CU_ASSERT(p == m1);
+    CU_ASSERT(cupkee_memory_page(m2) == cupkee_memory_page(x[4]));
+    CU_ASSERT(13 == free_page_total());
+
+    cupkee_movable_unlock(m1);
+    CU_ASSERT(1 == cupkee_memory_compact(4));
+    CU_ASSERT(p != m1);
+    CU_ASSERT(cupkee_memory_page(m1) == cupkee_memory_page(x[4]));
+    CU_ASSERT(14 == free_page_total());
+    for (i = 0; i < 16; i++) {
+        CU_ASSERT(((uint8_t *)m1)[i] == 0x11);
+        CU_ASSERT(((uint8_t *)m2)[i] == 0x22);
+    }
+
+    // Nothing to do
+    CU_ASSERT(0 == cupkee_memory_compact(4));
+    cupkee_memory_stat(&st);
+    CU_ASSERT(2 == st.moves);
+
+    cupkee_movable_free(m1);
+    cupkee_movable_free(m2);
+    for (i = 4; i < 16; i++) {
+        cupkee_free(x[i]);
+    }
+    CU_ASSERT(15 == free_page_total());
+
+    // Pages: slide down to the hole, movable buffer as example
+    CU_ASSERT_FATAL(NULL != (a = cupkee_malloc(2 * 1024)));
+    CU_ASSERT_FATAL(NULL != (b = cupkee_malloc(2 * 1024)));
+    CU_ASSERT_FATAL(NULL != (m3 = cupkee_buffer_alloc_movable(1500)));
+    cupkee_buffer_ref(m3, &m3);
+    for (i = 0; i < 1500; i++) {
+        cupkee_buffer_push(m3, i);
+    }
+    CU_ASSERT(0 == cupkee_free_pages(2));
+
+    cupkee_free(b);
+    p = m3;
+    CU_ASSERT(1 == cupkee_memory_compact(4));
+    CU_ASSERT(m3 < p);
+    CU_ASSERT(cupkee_memory_page(m3) == cupkee_memory_page(b));
+    CU_ASSERT(0 == cupkee_memory_compact(4));
+
+    CU_ASSERT(1500 == cupkee_buffer_take(m3, 1500, data));
+    for (i = 0; i < 1500; i++) {
+        CU_ASSERT(data[i] == (uint8_t)i);
+    }
+
+    cupkee_buffer_release(m3);
+    cupkee_free(a);
+    CU_ASSERT(15 == free_page_total());
+
+    hw_mock_deinit();
+}
+
 CU_pSuite test_sys_memory(void)
 {
     CU_pSuite suite = CU_add_suite("system memory", test_setup, test_clean);
@@ -289,6 +717,12 @@ CU_pSuite test_sys_memory(void)
         CU_add_test(suite, "sys memory init  ", test_memory_init);
         CU_add_test(suite, "sys page alloc   ", test_page_alloc);
         CU_add_test(suite, "sys memory alloc ", test_memory_alloc);
+        CU_add_test(suite, "sys memory class ", test_memory_class);
+        CU_add_test(suite, "sys memory zone  ", test_memory_zone);
+        CU_add_test(suite, "sys memory stat  ", test_memory_stat);
+        CU_add_test(suite, "sys memory exact ", test_memory_exact);
+        CU_add_test(suite, "sys memory reclaim", test_memory_reclaim);
+        CU_add_test(suite, "sys memory movable", test_memory_movable);
     }
 
     return suite;
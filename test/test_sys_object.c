@@ -42,6 +42,95 @@ static void test_read(void)
     CU_ASSERT(1);
 }
 
+static const cupkee_desc_t test_desc = {};
+
+static void test_id(void)
+{
+    int i, tag, stale;
+    int id[100];
+
+    CU_ASSERT(0 <= (tag = cupkee_object_register(sizeof(int), &test_desc)));
+
+    // Map grow beyond one chunk
+    for (i = 0; i < 100; i++) {
+        CU_ASSERT_FATAL(0 <= (id[i] = cupkee_id(tag)));
+        CU_ASSERT(NULL != cupkee_entry(id[i], tag));
+    }
+    for (i = 1; i < 100; i++) {
+        CU_ASSERT(id[i] != id[i - 1]);
+    }
+    CU_ASSERT(NULL == cupkee_entry(id[0], tag + 1));
+
+    // Stale id is not resolved to the object reuse the slot
+    stale = id[50];
+    cupkee_release(cupkee_entry(stale, tag));
+    CU_ASSERT(NULL == cupkee_entry(stale, tag));
+    CU_ASSERT(0 <= (id[50] = cupkee_id(tag)));
+    CU_ASSERT(id[50] != stale);
+    CU_ASSERT((id[50] & 0x1ff) == (stale & 0x1ff));
+    CU_ASSERT(NULL == cupkee_entry(stale, tag));
+    CU_ASSERT(NULL != cupkee_entry(id[50], tag));
+
+    cupkee_object_event_post(stale, CUPKEE_EVENT_DESTROY);
+    CU_ASSERT(1 == TU_object_event_dispatch());
+    CU_ASSERT(NULL != cupkee_entry(id[50], tag));
+
+    for (i = 0; i < 100; i++) {
+        cupkee_release(cupkee_entry(id[i], tag));
+        CU_ASSERT(NULL == cupkee_entry(id[i], tag));
+    }
+    CU_ASSERT(NULL == cupkee_entry(-1, tag));
+    CU_ASSERT(NULL == cupkee_entry(0x7fff, tag));
+}
+
+static void test_cache(void)
+{
+    int i, tag, per_page;
+    int id[40];
+    cupkee_object_stat_t st;
+
+    CU_ASSERT(0 <= (tag = cupkee_object_register(40, &test_desc)));
+    CU_ASSERT(-CUPKEE_EINVAL == cupkee_object_cache(tag + 1, 0));
+
+    // Can not cache a tag that has object out
+    CU_ASSERT(0 <= (id[0] = cupkee_id(tag)));
+    CU_ASSERT(-CUPKEE_EBUSY == cupkee_object_cache(tag, 0));
+    CU_ASSERT(0 == cupkee_object_stat(tag, &st));
+    CU_ASSERT(1 == st.inuse && 0 == st.pages);
+    cupkee_release(cupkee_entry(id[0], tag));
+
+    CU_ASSERT(0 == cupkee_object_cache(tag, 1));
+    CU_ASSERT(0 == cupkee_object_stat(tag, &st));
+    CU_ASSERT(st.size == CUPKEE_SIZE_ALIGN(sizeof(cupkee_object_t) + 40, sizeof(intptr_t)));
+    CU_ASSERT(1 == st.pages);
+    CU_ASSERT(0 == st.inuse);
+    per_page = st.cached;
+    CU_ASSERT(per_page == (int)(CUPKEE_PAGE_SIZE / st.size));
+    CU_ASSERT_FATAL(per_page < 40);
+
+    // Tight packing, and grow by page
+    for (i = 0; i < 40; i++) {
+        CU_ASSERT_FATAL(0 <= (id[i] = cupkee_id(tag)));
+    }
+    CU_ASSERT((intptr_t)cupkee_entry(id[1], tag) - (intptr_t)cupkee_entry(id[0], tag) == st.size);
+    CU_ASSERT(0 == cupkee_object_stat(tag, &st));
+    CU_ASSERT(40 == st.inuse && 40 == st.peak);
+    CU_ASSERT(st.pages == (40 + per_page - 1) / per_page);
+    CU_ASSERT(st.cached == st.pages * per_page - 40);
+
+    // Reserved page kept, others return to buddy
+    for (i = 0; i < 40; i++) {
+        cupkee_release(cupkee_entry(id[i], tag));
+    }
+    CU_ASSERT(0 == cupkee_object_stat(tag, &st));
+    CU_ASSERT(0 == st.inuse && 40 == st.peak);
+    CU_ASSERT(1 == st.pages && per_page == st.cached);
+
+    CU_ASSERT(0 == cupkee_object_cache(tag, 0));
+    CU_ASSERT(0 == cupkee_object_stat(tag, &st));
+    CU_ASSERT(0 == st.pages);
+}
+
 CU_pSuite test_sys_object(void)
 {
     CU_pSuite suite = CU_add_suite("system object", test_setup, test_clean);
@@ -49,6 +138,8 @@ CU_pSuite test_sys_object(void)
     if (suite) {
         CU_add_test(suite, "object register  ", test_register);
         CU_add_test(suite, "object read      ", test_read);
+        CU_add_test(suite, "object id        ", test_id);
+        CU_add_test(suite, "object cache     ", test_cache);
     }
 
     return suite;
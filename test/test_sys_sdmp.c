@@ -0,0 +1,868 @@
+/* GPLv2 License
+ *
+ * Copyright (C) 2016-2018 Lixing Ding <ding.lixing@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ **/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+
+static void *mock_entry = NULL;
+static int   mock_tx_req = 0;
+
+static size_t  mock_out_len = 0;
+static uint8_t mock_out[1024];
+
+static size_t  mock_text_len = 0;
+static int     mock_text_calls = 0;
+static char    mock_text[256];
+
+/* Script executed, white space collapsed, '|' appended to each */
+static char mock_exec[1024];
+static int  mock_exec_calls = 0;
+static int  mock_exec_fail = 0;
+
+static void mock_exec_reset(void)
+{
+    mock_exec[0] = 0;
+    mock_exec_calls = 0;
+}
+
+static int mock_execute(const char *script)
+{
+    size_t len = strlen(mock_exec);
+    int space = 1;
+
+    for (; *script && len + 2 < sizeof(mock_exec); script++) {
+        char c = *script;
+
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            space = 1;
+            continue;
+        }
+        if (space && len && mock_exec[len - 1] != '|') {
+            mock_exec[len++] = ' ';
+        }
+        space = 0;
+        mock_exec[len++] = c;
+    }
+    mock_exec[len++] = '|';
+    mock_exec[len] = 0;
+
+    mock_exec_calls++;
+    return mock_exec_fail ? -1 : 0;
+}
+
+static int mock_request(int inst)
+{
+    (void) inst;
+    return 0;
+}
+
+static int mock_release(int inst)
+{
+    (void) inst;
+    return 0;
+}
+
+static int mock_setup(int inst, void *entry)
+{
+    (void) inst;
+
+    mock_entry = entry;
+    return 0;
+}
+
+static int mock_reset(int inst)
+{
+    (void) inst;
+    return 0;
+}
+
+static int mock_read(int inst, size_t n, void *buf)
+{
+    (void) inst;
+    (void) n;
+    (void) buf;
+
+    return 0;
+}
+
+static int mock_write(int inst, size_t n, const void *data)
+{
+    (void) inst;
+
+    if (data) {
+        return n;
+    }
+
+    mock_tx_req = 1;
+    return 0;
+}
+
+static const cupkee_driver_t mock_driver = {
+    .request = mock_request,
+    .release = mock_release,
+    .setup   = mock_setup,
+    .reset   = mock_reset,
+
+    .read    = mock_read,
+    .write   = mock_write,
+};
+
+static const cupkee_device_desc_t mock_device = {
+    .name = "sdmp_mock",
+    .inst_max = 1,
+    .driver = &mock_driver
+};
+
+static void mock_text_handler(int n, const void *text)
+{
+    if (mock_text_len + n <= sizeof(mock_text)) {
+        memcpy(mock_text + mock_text_len, text, n);
+        mock_text_len += n;
+    }
+    mock_text_calls++;
+}
+
+static void mock_reset_io(void)
+{
+    mock_out_len = 0;
+    mock_text_len = 0;
+    mock_text_calls = 0;
+}
+
+/* Run events and move device output to mock_out, until nothing is left */
+static void mock_run(void)
+{
+    int busy = 1;
+
+    while (busy) {
+        busy = 0;
+
+        while (TU_object_event_dispatch()) {
+            busy = 1;
+        }
+
+        if (mock_tx_req) {
+            int n;
+
+            mock_tx_req = 0;
+            while (0 < (n = cupkee_device_pull(mock_entry, sizeof(mock_out) - mock_out_len, mock_out + mock_out_len))) {
+                mock_out_len += n;
+                busy = 1;
+            }
+        }
+    }
+}
+
+/* Feed input to device, in pieces no more than step bytes */
+static void mock_feed(size_t n, const void *data, size_t step)
+{
+    const uint8_t *p = data;
+
+    while (n) {
+        size_t len = n < step ? n : step;
+        int pushed = cupkee_device_push(mock_entry, len, p);
+
+        CU_ASSERT_FATAL(pushed > 0);
+        p += pushed;
+        n -= pushed;
+
+        mock_run();
+    }
+}
+
+static int test_setup(void)
+{
+    TU_pre_init();
+
+    cupkee_device_register(&mock_device);
+
+    return 0;
+}
+
+static int test_clean(void)
+{
+    return TU_pre_deinit();
+}
+
+static void test_demux(void)
+{
+    void *dev;
+    static const uint8_t input[] = {
+        'a', 'b', 'c',
+        0xF9, 0x00, 0x00, 0x07, 0x00,           // Hello
+        'd', 'e',
+        0xF9, 0x01, 0x00, 0x06,                 // Invalid version: dropped
+        'f',
+        0xF9, 0x00, 0x00, 0x07, 0x30,           // Unknown request
+    };
+    static const uint8_t hello[] = {
+        0xF9, 0x00, 0x03, 0x04, 0x80, 0x00, 0x01, 0x00
+    };
+    static const uint8_t invalid[] = {
+        0xF9, 0x00, 0x02, 0x05, 0x80, 0x30, 0x0A
+    };
+    size_t step;
+
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("sdmp_mock", 0)));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, 128));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "txBufSize", CUPKEE_OBJECT_ELEM_INT, 128));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxWatermark", CUPKEE_OBJECT_ELEM_INT, 1));
+    CU_ASSERT_FATAL(0 == cupkee_device_enable(dev));
+
+    CU_ASSERT_FATAL(0 == cupkee_sdmp_init(dev));
+    CU_ASSERT(0 == cupkee_sdmp_set_tty_handler(mock_text_handler));
+
+    // Same result, whatever pieces input arrives in
+    for (step = 1; step <= sizeof(input); step++) {
+        mock_reset_io();
+        mock_feed(sizeof(input), input, step);
+
+        CU_ASSERT(mock_text_len == 6 && !memcmp(mock_text, "abcdef", 6));
+        CU_ASSERT(mock_out_len == sizeof(hello) + sizeof(invalid));
+        CU_ASSERT(!memcmp(mock_out, hello, sizeof(hello)));
+        CU_ASSERT(!memcmp(mock_out + sizeof(hello), invalid, sizeof(invalid)));
+    }
+
+    // Text arrive in one chunk, is delivered by one call
+    mock_reset_io();
+    mock_feed(sizeof(input), input, sizeof(input));
+    CU_ASSERT(mock_text_calls == 3);
+
+    mock_reset_io();
+    mock_feed(40, "0123456789012345678901234567890123456789", 40);
+    CU_ASSERT(mock_text_calls == 1 && mock_text_len == 40);
+
+    // Text output
+    mock_reset_io();
+    CU_ASSERT(5 == cupkee_sdmp_tty_write(5, "hello"));
+    mock_run();
+    CU_ASSERT(mock_out_len == 5 && !memcmp(mock_out, "hello", 5));
+
+    cupkee_device_release(dev);
+}
+
+/* Response is never dropped: input is held while response queue is full */
+static void test_backpressure(void)
+{
+    void *dev;
+    static const uint8_t hello_req[] = {
+        0xF9, 0x00, 0x00, 0x07, 0x00
+    };
+    static const uint8_t hello[] = {
+        0xF9, 0x00, 0x03, 0x04, 0x80, 0x00, 0x01, 0x00
+    };
+    uint8_t input[12 * sizeof(hello_req)];
+    int i;
+
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("sdmp_mock", 0)));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, 128));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "txBufSize", CUPKEE_OBJECT_ELEM_INT, 16));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxWatermark", CUPKEE_OBJECT_ELEM_INT, 1));
+    CU_ASSERT_FATAL(0 == cupkee_device_enable(dev));
+    CU_ASSERT_FATAL(0 == cupkee_sdmp_init(dev));
+
+    for (i = 0; i < 12; i++) {
+        memcpy(input + i * sizeof(hello_req), hello_req, sizeof(hello_req));
+    }
+
+    mock_reset_io();
+    CU_ASSERT(sizeof(input) == cupkee_device_push(mock_entry, sizeof(input), input));
+    while (TU_object_event_dispatch())
+        ;
+
+    mock_run();
+    CU_ASSERT_FATAL(mock_out_len == 12 * sizeof(hello));
+    for (i = 0; i < 12; i++) {
+        CU_ASSERT(!memcmp(mock_out + i * sizeof(hello), hello, sizeof(hello)));
+    }
+
+    cupkee_device_release(dev);
+}
+
+/* Report frame: head, code, id, type, data */
+static int mock_report_is(const uint8_t *frame, uint8_t id, uint8_t data0)
+{
+    return frame[0] == 0xF9 && frame[4] == 0x81 && frame[5] == id && frame[7] == data0;
+}
+
+static void test_queue(void)
+{
+    void *dev;
+    static const uint8_t hello_req[] = {
+        0xF9, 0x00, 0x00, 0x07, 0x00
+    };
+    static const uint8_t hello[] = {
+        0xF9, 0x00, 0x03, 0x04, 0x80, 0x00, 0x01, 0x00
+    };
+    const uint8_t *p;
+    int i;
+
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("sdmp_mock", 0)));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, 16));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "txBufSize", CUPKEE_OBJECT_ELEM_INT, 16));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxWatermark", CUPKEE_OBJECT_ELEM_INT, 1));
+    CU_ASSERT_FATAL(0 == cupkee_device_enable(dev));
+    CU_ASSERT_FATAL(0 == cupkee_sdmp_init(dev));
+
+    mock_reset_io();
+
+    // Number report take 15 bytes, the second one fill the stream
+    CU_ASSERT(0 == cupkee_sdmp_update_state_number(1, 1.0));
+    CU_ASSERT(0 == cupkee_sdmp_update_state_number(2, 2.0));
+    CU_ASSERT(2 == cupkee_sdmp_tty_write(2, "hi"));
+
+    // Pending report of state 1 is replaced by the latest one
+    CU_ASSERT(0 == cupkee_sdmp_update_state_number(1, 3.0));
+    CU_ASSERT(0 == cupkee_sdmp_update_state_boolean(3, 1));
+    CU_ASSERT(0 == cupkee_sdmp_update_state_number(1, 4.0));
+
+    // Response go before reports
+    CU_ASSERT(sizeof(hello_req) == cupkee_device_push(mock_entry, sizeof(hello_req), hello_req));
+    while (TU_object_event_dispatch())
+        ;
+
+    mock_run();
+    CU_ASSERT_FATAL(mock_out_len == 15 + 15 + sizeof(hello) + 15 + 8 + 2);
+
+    p = mock_out;
+    CU_ASSERT(mock_report_is(p, 1, 0x3F)); p += 15;
+    CU_ASSERT(mock_report_is(p, 2, 0x40)); p += 15;
+    CU_ASSERT(!memcmp(p, hello, sizeof(hello))); p += sizeof(hello);
+    CU_ASSERT(mock_report_is(p, 1, 0x40) && p[8] == 0x10); p += 15;
+    CU_ASSERT(mock_report_is(p, 3, 1)); p += 8;
+    CU_ASSERT(!memcmp(p, "hi", 2));
+
+    // Reports of different state are limited
+    mock_reset_io();
+    CU_ASSERT(0 == cupkee_sdmp_update_state_number(0, 0.0));
+    CU_ASSERT(0 == cupkee_sdmp_update_state_number(0, 0.0));
+    for (i = 1; i <= CUPKEE_SDMP_REPORT_QUEUE; i++) {
+        CU_ASSERT(0 == cupkee_sdmp_update_state_trigger(i));
+    }
+    CU_ASSERT(-CUPKEE_EBUSY == cupkee_sdmp_update_state_trigger(i));
+    CU_ASSERT(0 == cupkee_sdmp_update_state_trigger(1));
+
+    mock_run();
+    CU_ASSERT(mock_out_len == 15 + 15 + CUPKEE_SDMP_REPORT_QUEUE * 7);
+
+    cupkee_device_release(dev);
+}
+
+static uint16_t mock_crc16(const uint8_t *data, size_t n)
+{
+    uint16_t crc = 0xffff;
+
+    while (n--) {
+        int i;
+
+        crc ^= (uint16_t) (*data++) << 8;
+        for (i = 0; i < 8; i++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+/* Frame request body, then run until all responses are out */
+static void mock_request_send(size_t n, const uint8_t *body)
+{
+    uint8_t frame[4 + 256];
+
+    frame[0] = 0xF9;
+    frame[1] = 0x00;
+    frame[2] = n - 1;
+    frame[3] = ~(0xF9 + frame[2]) + 1;
+    memcpy(frame + 4, body, n);
+
+    mock_reset_io();
+    mock_feed(4 + n, frame, 64);
+}
+
+static const uint8_t *mock_flash_block(int sector, int block)
+{
+    return (const uint8_t *) cupkee_storage_base(CUPKEE_STORAGE_BANK_SYS) + sector * CUPKEE_SECTOR_SIZE + block * CUPKEE_BLOCK_SIZE;
+}
+
+static void mock_block_fill(uint8_t *data, uint8_t seed)
+{
+    int i;
+
+    for (i = 0; i < CUPKEE_BLOCK_SIZE; i++) {
+        data[i] = seed + i;
+    }
+}
+
+static void mock_window_block(uint8_t *req, uint8_t index, uint8_t seed)
+{
+    uint16_t crc;
+
+    mock_block_fill(req + 7, seed);
+    crc = mock_crc16(req + 7, CUPKEE_BLOCK_SIZE);
+
+    req[4] = index;
+    req[5] = crc >> 8;
+    req[6] = crc;
+}
+
+static void test_sysdata(void)
+{
+    void *dev;
+    uint8_t req[7 + CUPKEE_BLOCK_SIZE];
+    uint8_t data[CUPKEE_BLOCK_SIZE];
+    const uint8_t *p;
+    uint16_t crc;
+    int i;
+
+    CU_ASSERT(0x29B1 == mock_crc16((const uint8_t *)"123456789", 9));
+
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("sdmp_mock", 0)));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, 128));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "txBufSize", CUPKEE_OBJECT_ELEM_INT, 64));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxWatermark", CUPKEE_OBJECT_ELEM_INT, 1));
+    CU_ASSERT_FATAL(0 == cupkee_device_enable(dev));
+    CU_ASSERT_FATAL(0 == cupkee_sdmp_init(dev));
+
+    // Single block write, checksum verified
+    mock_block_fill(data, 3);
+    crc = mock_crc16(data, CUPKEE_BLOCK_SIZE);
+    req[0] = 0x05; req[1] = 1; req[2] = 0; req[3] = crc >> 8; req[4] = crc ^ 1;
+    memcpy(req + 5, data, CUPKEE_BLOCK_SIZE);
+    mock_request_send(5 + CUPKEE_BLOCK_SIZE, req);
+    CU_ASSERT(mock_out_len == 9 && mock_out[4] == 0x80 && mock_out[5] == 0x05 && mock_out[6] == 12);
+    CU_ASSERT(memcmp(mock_flash_block(1, 0), data, CUPKEE_BLOCK_SIZE));
+
+    req[4] = crc;
+    mock_request_send(5 + CUPKEE_BLOCK_SIZE, req);
+    CU_ASSERT(mock_out_len == 9 && mock_out[6] == 0 && mock_out[7] == 1 && mock_out[8] == 0);
+    CU_ASSERT(!memcmp(mock_flash_block(1, 0), data, CUPKEE_BLOCK_SIZE));
+
+    // Single block read, with crc
+    req[0] = 0x03; req[1] = 1; req[2] = 0;
+    mock_request_send(3, req);
+    CU_ASSERT(mock_out_len == 11 + CUPKEE_BLOCK_SIZE && mock_out[6] == 0);
+    CU_ASSERT(mock_out[9] == (crc >> 8) && mock_out[10] == (uint8_t) crc);
+    CU_ASSERT(!memcmp(mock_out + 11, data, CUPKEE_BLOCK_SIZE));
+
+    // Window write: sector 2 block 62, 4 blocks, block 1 corrupted
+    req[0] = 0x0D; req[1] = 2; req[2] = 62; req[3] = 4;
+    for (i = 0; i < 4; i++) {
+        mock_window_block(req, i == 3 ? i | 0x80 : i, i * 16);
+        if (i == 1) {
+            req[7] ^= 0xff;
+        }
+        mock_request_send(7 + CUPKEE_BLOCK_SIZE, req);
+        CU_ASSERT(mock_out_len == (i == 3 ? 14 : 0));
+    }
+    // Status: continue, mask of written blocks
+    CU_ASSERT(mock_out[5] == 0x0D && mock_out[6] == 1 && mock_out[7] == 2 && mock_out[8] == 62 && mock_out[9] == 4);
+    CU_ASSERT(mock_out[10] == 0 && mock_out[11] == 0 && mock_out[12] == 0 && mock_out[13] == 0x0D);
+
+    // Selective retransmit
+    mock_window_block(req, 1 | 0x80, 16);
+    mock_request_send(7 + CUPKEE_BLOCK_SIZE, req);
+    CU_ASSERT(mock_out_len == 14 && mock_out[6] == 0 && mock_out[13] == 0x0F);
+
+    // Status only
+    mock_request_send(5, req);
+    CU_ASSERT(mock_out_len == 14 && mock_out[6] == 0 && mock_out[13] == 0x0F);
+
+    // Block index out of window, shift count beyond mask width included
+    mock_window_block(req, 4, 0);
+    mock_request_send(7 + CUPKEE_BLOCK_SIZE, req);
+    CU_ASSERT(mock_out_len == 7 && mock_out[5] == 0x0D && mock_out[6] == 11);
+    mock_window_block(req, 0x7f, 0);
+    mock_request_send(7 + CUPKEE_BLOCK_SIZE, req);
+    CU_ASSERT(mock_out_len == 7 && mock_out[5] == 0x0D && mock_out[6] == 11);
+
+    for (i = 0; i < 4; i++) {
+        mock_block_fill(data, i * 16);
+        CU_ASSERT(!memcmp(mock_flash_block(2 + (62 + i) / 64, (62 + i) % 64), data, CUPKEE_BLOCK_SIZE));
+    }
+
+    // Window read: blocks streamed without ack
+    req[0] = 0x0C; req[1] = 2; req[2] = 62; req[3] = 4;
+    mock_request_send(4, req);
+    CU_ASSERT_FATAL(mock_out_len == 4 * (11 + CUPKEE_BLOCK_SIZE));
+    for (i = 0, p = mock_out; i < 4; i++, p += 11 + CUPKEE_BLOCK_SIZE) {
+        mock_block_fill(data, i * 16);
+        crc = mock_crc16(data, CUPKEE_BLOCK_SIZE);
+
+        CU_ASSERT(p[5] == 0x0C && p[6] == (i < 3 ? 1 : 0));
+        CU_ASSERT(p[7] == 2 + (62 + i) / 64 && p[8] == (62 + i) % 64);
+        CU_ASSERT(p[9] == (crc >> 8) && p[10] == (uint8_t) crc);
+        CU_ASSERT(!memcmp(p + 11, data, CUPKEE_BLOCK_SIZE));
+    }
+
+    // Read again, the selected ones only
+    req[4] = 0; req[5] = 0; req[6] = 0; req[7] = 0x0A;
+    mock_request_send(8, req);
+    CU_ASSERT_FATAL(mock_out_len == 2 * (11 + CUPKEE_BLOCK_SIZE));
+    CU_ASSERT(mock_out[6] == 1 && mock_out[7] == 2 && mock_out[8] == 63);
+    p = mock_out + 11 + CUPKEE_BLOCK_SIZE;
+    CU_ASSERT(p[6] == 0 && p[7] == 3 && p[8] == 1);
+
+    // Invalid window
+    req[3] = 0;
+    mock_request_send(4, req);
+    CU_ASSERT(mock_out_len == 7 && mock_out[5] == 0x0C && mock_out[6] == 11);
+    req[3] = 33;
+    mock_request_send(4, req);
+    CU_ASSERT(mock_out_len == 7 && mock_out[6] == 11);
+
+    cupkee_device_release(dev);
+}
+
+static void mock_script_chunk(uint8_t cur, uint8_t end, size_t n, const char *text)
+{
+    uint8_t req[4 + 252];
+
+    req[0] = 0x06;
+    req[1] = 0;
+    req[2] = cur;
+    req[3] = end;
+    memcpy(req + 4, text, n);
+
+    mock_request_send(4 + n, req);
+}
+
+static int mock_script_status(uint8_t status)
+{
+    return mock_out_len >= 7 && mock_out[4] == 0x80 && mock_out[5] == 0x06 && mock_out[6] == status;
+}
+
+/* Script is taken by chunk, padded with spaces but the last one */
+static void mock_script_send(int num, const char *chunks[])
+{
+    char text[252];
+    int i;
+
+    for (i = 0; i < num; i++) {
+        size_t n = strlen(chunks[i]);
+
+        memset(text, ' ', sizeof(text));
+        memcpy(text, chunks[i], n);
+        mock_script_chunk(i, num, i + 1 < num ? 252 : n, text);
+    }
+}
+
+static void test_script(void)
+{
+    void *dev;
+    char text[252];
+    int i;
+    const char *split[] = {
+        "var a = 1; if (a) { b(\"};\"); }",
+        " else { c(); }\nd(); // x; y",
+        "\n/* ; */ e();"
+    };
+    const char *follow[] = {
+        "if (a) b();\n",
+        "else c();\ndo x++;\n",
+        "while (x < 3);\nf();"
+    };
+
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("sdmp_mock", 0)));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxBufSize", CUPKEE_OBJECT_ELEM_INT, 128));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "rxWatermark", CUPKEE_OBJECT_ELEM_INT, 1));
+    CU_ASSERT_FATAL(0 == cupkee_device_enable(dev));
+    CU_ASSERT_FATAL(0 == cupkee_sdmp_init(dev));
+    CU_ASSERT_FATAL(0 == cupkee_sdmp_set_script_executor(mock_execute));
+
+    // Chunk but the last should be full
+    mock_script_chunk(0, 2, 10, "/* comment");
+    CU_ASSERT(mock_script_status(11));
+
+    memset(text, ' ', sizeof(text));
+    memcpy(text, "/*", 2);
+    mock_script_chunk(0, 3, 252, text);
+    CU_ASSERT(mock_out_len == 8 && mock_script_status(1) && mock_out[7] == 1);
+
+    // Chunk out of order
+    mock_script_chunk(2, 3, 10, "comment */");
+    CU_ASSERT(mock_script_status(13));
+    mock_script_chunk(1, 3, 252, text);
+    CU_ASSERT(mock_script_status(13));
+
+    // Complete statements are executed as chunks arrive
+    mock_exec_reset();
+    memset(text, ' ', sizeof(text));
+    memcpy(text, split[0], strlen(split[0]));
+    mock_script_chunk(0, 3, 252, text);
+    CU_ASSERT(!strcmp(mock_exec, "var a = 1;|"));
+    mock_exec_reset();
+    mock_script_send(3, split);
+    CU_ASSERT(mock_script_status(0));
+    CU_ASSERT(!strcmp(mock_exec, "var a = 1;|if (a) { b(\"};\"); } else { c(); }|d(); // x; y /* ; */ e();|"));
+
+    // Statement go on after ';'
+    mock_exec_reset();
+    mock_script_send(3, follow);
+    CU_ASSERT(mock_script_status(0));
+    CU_ASSERT(!strcmp(mock_exec, "if (a) b(); else c();|do x++; while (x < 3); f();|"));
+
+    // Statement larger than chunks is held until completed
+    mock_exec_reset();
+    memset(text, ' ', sizeof(text));
+    memcpy(text, "function f() {", 14);
+    mock_script_chunk(0, 4, 252, text);
+    for (i = 1; i < 3; i++) {
+        memset(text, ' ', sizeof(text));
+        memcpy(text, "x = 1;", 6);
+        mock_script_chunk(i, 4, 252, text);
+        CU_ASSERT(mock_script_status(1) && mock_out[7] == i + 1);
+    }
+    CU_ASSERT(mock_exec_calls == 0);
+    mock_script_chunk(3, 4, 5, "} f()");
+    CU_ASSERT(mock_script_status(0) && mock_exec_calls == 1);
+
+    // Unfinished statement held no more than the tail cap
+    mock_exec_reset();
+    memset(text, ' ', sizeof(text));
+    memcpy(text, "function f() {", 14);
+    for (i = 0; (i + 1) * 252 < CUPKEE_SDMP_SCRIPT_TAIL_MAX; i++) {
+        mock_script_chunk(i, 9, 252, text);
+        CU_ASSERT(mock_script_status(1) && mock_out[7] == i + 1);
+    }
+    mock_script_chunk(i, 9, 252, text);
+    CU_ASSERT(mock_script_status(14) && mock_exec_calls == 0);
+
+    // Execute error
+    mock_exec_reset();
+    mock_exec_fail = 1;
+    mock_script_chunk(0, 1, 4, "a();");
+    CU_ASSERT(mock_script_status(18));
+    mock_exec_fail = 0;
+
+    cupkee_sdmp_set_script_executor(NULL);
+    cupkee_device_release(dev);
+}
+
+static int mock_number_pack(double v, int type, int size)
+{
+    uint8_t buf[CUPKEE_DATA_NUMBER_MAX];
+    cupkee_data_entry_t entry;
+    cupkee_data_t av;
+    int n = cupkee_data_put_number(buf, v);
+
+    if (n != size || buf[0] != type) {
+        return 0;
+    }
+
+    cupkee_data_init(&entry, n, buf);
+    if (CUPKEE_DATA_NUMBER != cupkee_data_shift(&entry, &av) || entry.pos != n) {
+        return 0;
+    }
+
+    return av.number == v;
+}
+
+static void test_data(void)
+{
+    uint8_t buf[16];
+    cupkee_data_entry_t entry;
+    cupkee_data_t av;
+
+    CU_ASSERT(mock_number_pack(0,       CUPKEE_DATA_INT8,  2));
+    CU_ASSERT(mock_number_pack(-128,    CUPKEE_DATA_INT8,  2));
+    CU_ASSERT(mock_number_pack(127,     CUPKEE_DATA_INT8,  2));
+    CU_ASSERT(mock_number_pack(-129,    CUPKEE_DATA_INT16, 3));
+    CU_ASSERT(mock_number_pack(32767,   CUPKEE_DATA_INT16, 3));
+    CU_ASSERT(mock_number_pack(32768,   CUPKEE_DATA_VARINT, 4));
+    CU_ASSERT(mock_number_pack(-1000000, CUPKEE_DATA_VARINT, 4));
+    CU_ASSERT(mock_number_pack(0x7fffffff, CUPKEE_DATA_INT32, 5));
+    CU_ASSERT(mock_number_pack(-2147483648.0, CUPKEE_DATA_INT32, 5));
+    CU_ASSERT(mock_number_pack(1099511627776.0, CUPKEE_DATA_VARINT, 7));
+    CU_ASSERT(mock_number_pack(-1099511627775.0, CUPKEE_DATA_VARINT, 7));
+    CU_ASSERT(mock_number_pack(0.5,     CUPKEE_DATA_FLOAT, 5));
+    CU_ASSERT(mock_number_pack(-1.25e10 + 0.5, CUPKEE_DATA_NUMBER, 9));
+    CU_ASSERT(mock_number_pack(0.1,     CUPKEE_DATA_NUMBER, 9));
+    CU_ASSERT(mock_number_pack(-0.0,    CUPKEE_DATA_FLOAT, 5));
+
+    // Float and int are big endian
+    CU_ASSERT(5 == cupkee_data_put_number(buf, 1.5));
+    CU_ASSERT(buf[1] == 0x3F && buf[2] == 0xC0 && buf[3] == 0 && buf[4] == 0);
+    CU_ASSERT(3 == cupkee_data_put_number(buf, -200));
+    CU_ASSERT(buf[1] == 0xFF && buf[2] == 0x38);
+
+    // Truncated value and empty entry
+    cupkee_data_put_number(buf, 0.5);
+    cupkee_data_init(&entry, 4, buf);
+    CU_ASSERT(CUPKEE_DATA_NONE == cupkee_data_shift(&entry, &av));
+    buf[0] = CUPKEE_DATA_VARINT; buf[1] = 0x80; buf[2] = 0x80;
+    cupkee_data_init(&entry, 3, buf);
+    CU_ASSERT(CUPKEE_DATA_NONE == cupkee_data_shift(&entry, &av));
+    cupkee_data_init(&entry, 0, buf);
+    CU_ASSERT(CUPKEE_DATA_NONE == cupkee_data_shift(&entry, &av));
+}
+
+static void test_batch(void)
+{
+    void *dev;
+    cupkee_data_entry_t entry;
+    cupkee_data_t av;
+    int i, n, frames;
+    size_t sent;
+    uint8_t *p;
+
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("sdmp_mock", 0)));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "txBufSize", CUPKEE_OBJECT_ELEM_INT, 256));
+    CU_ASSERT_FATAL(0 == cupkee_device_enable(dev));
+    CU_ASSERT_FATAL(0 == cupkee_sdmp_init(dev));
+
+    // Nothing to flush
+    mock_reset_io();
+    CU_ASSERT(0 == cupkee_sdmp_batch_flush());
+    mock_run();
+    CU_ASSERT(mock_out_len == 0);
+
+    CU_ASSERT(0 == cupkee_sdmp_batch_number(1, 100));
+    CU_ASSERT(0 == cupkee_sdmp_batch_number(2, 0.5));
+    CU_ASSERT(0 == cupkee_sdmp_batch_boolean(3, 1));
+    CU_ASSERT(0 == cupkee_sdmp_batch_string(4, "ok"));
+    CU_ASSERT(0 == cupkee_sdmp_batch_trigger(5));
+    mock_run();
+    CU_ASSERT(mock_out_len == 0);
+
+    CU_ASSERT(0 == cupkee_sdmp_batch_flush());
+    mock_run();
+
+    // One frame: id, type, value ...
+    CU_ASSERT_FATAL(mock_out_len == 5 + 3 + 6 + 3 + 5 + 2);
+    CU_ASSERT(mock_out[0] == 0xF9 && mock_out[2] == 19 && (uint8_t)(0xF9 + mock_out[2] + mock_out[3]) == 0);
+    CU_ASSERT(mock_out[4] == 0x82);
+
+    p = mock_out + 5;
+    CU_ASSERT(p[0] == 1);
+    cupkee_data_init(&entry, 2, p + 1);
+    CU_ASSERT(CUPKEE_DATA_NUMBER == cupkee_data_shift(&entry, &av) && av.number == 100);
+    p += 3;
+    CU_ASSERT(p[0] == 2);
+    cupkee_data_init(&entry, 5, p + 1);
+    CU_ASSERT(CUPKEE_DATA_NUMBER == cupkee_data_shift(&entry, &av) && av.number == 0.5);
+    p += 6;
+    CU_ASSERT(p[0] == 3 && p[1] == CUPKEE_DATA_BOOLEAN && p[2] == 1);
+    p += 3;
+    CU_ASSERT(p[0] == 4 && p[1] == CUPKEE_DATA_STRING && !memcmp(p + 2, "ok", 3));
+    p += 5;
+    CU_ASSERT(p[0] == 5 && p[1] == CUPKEE_DATA_NONE);
+
+    // Full batch is sent, item go to the next one
+    mock_reset_io();
+    for (i = 0; i < 100; i++) {
+        CU_ASSERT(0 == cupkee_sdmp_batch_number(i, i));
+    }
+    CU_ASSERT(0 == cupkee_sdmp_batch_flush());
+    mock_run();
+
+    for (n = 0, frames = 0; n < (int) mock_out_len; frames++) {
+        CU_ASSERT(mock_out[n] == 0xF9 && mock_out[n + 4] == 0x82);
+        CU_ASSERT(5 + mock_out[n + 2] <= 240);
+        n += 5 + mock_out[n + 2];
+    }
+    CU_ASSERT(n == 100 * 3 + frames * 5);
+    CU_ASSERT(frames == 2);
+
+    // Batch is not replaced by report of same id
+    mock_reset_io();
+    CU_ASSERT(0 == cupkee_sdmp_update_state_number(0, 0.0));
+    CU_ASSERT(0 == cupkee_sdmp_batch_boolean(1, 0));
+    CU_ASSERT(0 == cupkee_sdmp_batch_flush());
+    CU_ASSERT(0 == cupkee_sdmp_update_state_boolean(1, 1));
+    mock_run();
+    CU_ASSERT(mock_out_len == 15 + 8 + 8);
+
+    // Rollback to mark
+    mock_reset_io();
+    CU_ASSERT(0 == cupkee_sdmp_batch_trigger(1));
+    n = cupkee_sdmp_batch_mark();
+    CU_ASSERT(0 == cupkee_sdmp_batch_trigger(2));
+    CU_ASSERT(0 > cupkee_sdmp_batch_trigger(256));
+    cupkee_sdmp_batch_rollback(n);
+    CU_ASSERT(0 == cupkee_sdmp_batch_flush());
+    mock_run();
+    CU_ASSERT(mock_out_len == 5 + 2 && mock_out[5] == 1);
+
+    // Room made before items appended, by flushing the batch in building
+    mock_reset_io();
+    CU_ASSERT(-CUPKEE_EINVAL == cupkee_sdmp_batch_prepare(240));
+    CU_ASSERT(0 == cupkee_sdmp_batch_prepare(200));
+    mock_run();
+    CU_ASSERT(mock_out_len == 0);
+    CU_ASSERT(0 == cupkee_sdmp_batch_trigger(1));
+    CU_ASSERT(0 == cupkee_sdmp_batch_prepare(200));
+    mock_run();
+    CU_ASSERT(mock_out_len == 0);
+    CU_ASSERT(0 == cupkee_sdmp_batch_prepare(240 - 5 - 2));
+    mock_run();
+    CU_ASSERT(mock_out_len == 0);
+    CU_ASSERT(0 == cupkee_sdmp_batch_prepare(240 - 5 - 1));
+    mock_run();
+    CU_ASSERT(mock_out_len == 5 + 2 && mock_out[5] == 1);
+
+    cupkee_device_release(dev);
+
+    // Report queue full: batch is kept, not lost
+    CU_ASSERT_FATAL(NULL != (dev = cupkee_device_request("sdmp_mock", 0)));
+    CU_ASSERT_FATAL(0 < cupkee_prop_set(dev, "txBufSize", CUPKEE_OBJECT_ELEM_INT, 16));
+    CU_ASSERT_FATAL(0 == cupkee_device_enable(dev));
+    CU_ASSERT_FATAL(0 == cupkee_sdmp_init(dev));
+
+    mock_reset_io();
+    for (i = 0; i < 32 && 0 == cupkee_sdmp_update_state_trigger(100 + i); i++)
+        ;
+    CU_ASSERT(i < 32);
+
+    CU_ASSERT(0 == cupkee_sdmp_batch_number(1, 1));
+    CU_ASSERT(-CUPKEE_EBUSY == cupkee_sdmp_batch_flush());
+    CU_ASSERT(-CUPKEE_EBUSY == cupkee_sdmp_batch_prepare(240 - 5));
+    for (n = 1; n < 100 && 0 == cupkee_sdmp_batch_number(n, n); n++)
+        ;
+    CU_ASSERT(-CUPKEE_EBUSY == cupkee_sdmp_batch_number(n, n));
+
+    mock_run();
+    sent = mock_out_len;
+    CU_ASSERT(0 == cupkee_sdmp_batch_flush());
+    mock_run();
+
+    p = mock_out + sent;
+    CU_ASSERT_FATAL(mock_out_len - sent == 5 + (size_t)n * 3);
+    CU_ASSERT(p[4] == 0x82 && p[5] == 1 && p[5 + (n - 1) * 3] == n - 1);
+
+    cupkee_device_release(dev);
+}
+
+CU_pSuite test_sys_sdmp(void)
+{
+    CU_pSuite suite = CU_add_suite("system sdmp", test_setup, test_clean);
+
+    if (suite) {
+        CU_add_test(suite, "sdmp demux       ", test_demux);
+        CU_add_test(suite, "sdmp queue       ", test_queue);
+        CU_add_test(suite, "sdmp backpressure", test_backpressure);
+        CU_add_test(suite, "sdmp sysdata     ", test_sysdata);
+        CU_add_test(suite, "sdmp script      ", test_script);
+        CU_add_test(suite, "sdmp data        ", test_data);
+        CU_add_test(suite, "sdmp batch       ", test_batch);
+    }
+
+    return suite;
+}
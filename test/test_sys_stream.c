@@ -228,6 +228,135 @@ static void test_stream_event(void)
     CU_ASSERT(0 == cupkee_stream_deinit(s));
 }
 
+static void test_stream_buf(void)
+{
+    int id;
+    cupkee_stream_t *s;
+    uint8_t buf[64];
+    void *b, *t;
+
+    CU_ASSERT(0 <= (id = cupkee_id(tag)));
+    CU_ASSERT(NULL != (s = (cupkee_stream_t *) cupkee_entry(id, tag)));
+    CU_ASSERT(0 == cupkee_stream_init(s, id, 32, 32, mock_read, mock_write));
+
+    cupkee_stream_listen(s, CUPKEE_EVENT_DRAIN);
+    mock_read_immediately = 0;
+    mock_read_trigger = 0;
+    mock_write_immediately = 0;
+    mock_write_trigger = 0;
+
+    // Nothing cached: read request issued
+    CU_ASSERT(NULL == cupkee_stream_read_buf(s));
+    CU_ASSERT(1 == mock_read_trigger);
+
+    // Empty stream adopts the buffer as is, even if larger than cache size
+    memset(buf, 1, 64);
+    CU_ASSERT(NULL != (b = cupkee_buffer_create(64, buf)));
+    CU_ASSERT(64 == cupkee_stream_push_buf(s, b));
+    CU_ASSERT(s->rx_buf == b);
+    CU_ASSERT(64 == cupkee_stream_readable(s));
+
+    // Merge into a cache with data, or refuse if not fit
+    CU_ASSERT(16 == cupkee_stream_read(s, 16, buf));
+    CU_ASSERT(NULL != (t = cupkee_buffer_create(8, buf)));
+    CU_ASSERT(8 == cupkee_stream_push_buf(s, t));
+    CU_ASSERT(56 == cupkee_stream_readable(s));
+    CU_ASSERT(NULL != (t = cupkee_buffer_create(9, buf)));
+    CU_ASSERT(-CUPKEE_EOVERFLOW == cupkee_stream_push_buf(s, t));
+    cupkee_buffer_release(t);
+
+    // Whole cache handed out
+    CU_ASSERT(b == cupkee_stream_read_buf(s));
+    CU_ASSERT(56 == cupkee_buffer_length(b));
+    CU_ASSERT(0 == cupkee_stream_readable(s));
+    cupkee_buffer_release(b);
+
+    // Buffer smaller than cache size is copied, cache size kept
+    CU_ASSERT(NULL != (t = cupkee_buffer_create(8, buf)));
+    CU_ASSERT(8 == cupkee_stream_push_buf(s, t));
+    CU_ASSERT(s->rx_buf != t && 32 == cupkee_buffer_capacity(s->rx_buf));
+    CU_ASSERT(NULL != (t = cupkee_buffer_create(8, buf)));
+    CU_ASSERT(8 == cupkee_stream_push_buf(s, t));
+    CU_ASSERT(16 == cupkee_stream_read(s, 64, buf));
+
+    // Read in place
+    mock_read_trigger = 0;
+    CU_ASSERT(0 == cupkee_stream_read_reserve(s, (void **)&t));
+    CU_ASSERT(1 == mock_read_trigger);
+    CU_ASSERT(8 == cupkee_stream_push(s, 8, "abcdefgh"));
+    CU_ASSERT(8 == cupkee_stream_read_reserve(s, (void **)&t));
+    CU_ASSERT(0 == memcmp(t, "abcdefgh", 8));
+    CU_ASSERT(3 == cupkee_stream_read_commit(s, 3));
+    CU_ASSERT(5 == cupkee_stream_readable(s));
+    CU_ASSERT(5 == cupkee_stream_read(s, 64, buf) && buf[0] == 'd');
+
+    // Write buffer adopted & tx requested
+    memset(buf, 2, 64);
+    CU_ASSERT(NULL != (b = cupkee_buffer_create(48, buf)));
+    CU_ASSERT(48 == cupkee_stream_write_buf(s, b));
+    CU_ASSERT(1 == mock_write_trigger);
+    CU_ASSERT(NULL != (t = cupkee_buffer_create(16, buf)));
+    CU_ASSERT(-CUPKEE_EOVERFLOW == cupkee_stream_write_buf(s, t));
+    CU_ASSERT(1 == mock_write_trigger);
+    cupkee_buffer_release(t);
+
+    CU_ASSERT(b == cupkee_stream_pull_buf(s));
+    CU_ASSERT(NULL == cupkee_stream_pull_buf(s));
+    CU_ASSERT(1 == TU_object_event_dispatch());
+    CU_ASSERT(mock_curr_id == id && mock_curr_event == CUPKEE_EVENT_DRAIN);
+    cupkee_buffer_release(b);
+
+    // Byte api still work after hand-off
+    CU_ASSERT(32 == cupkee_stream_write(s, 32, buf));
+    CU_ASSERT(2 == mock_write_trigger);
+    CU_ASSERT(32 == cupkee_stream_pull(s, 64, buf));
+    CU_ASSERT(1 == TU_object_event_dispatch());
+
+    // Shared buffer is copied, holders see no change
+    CU_ASSERT(NULL != (b = cupkee_buffer_create(8, "abcdefgh")));
+    CU_ASSERT(b == cupkee_buffer_share(b));
+    CU_ASSERT(8 == cupkee_stream_write_buf(s, b));
+    CU_ASSERT(s->tx_buf != b);
+    CU_ASSERT(!cupkee_buffer_is_shared(b));
+    CU_ASSERT(8 == cupkee_stream_pull(s, 64, buf));
+    CU_ASSERT(1 == TU_object_event_dispatch());
+    CU_ASSERT(8 == cupkee_buffer_length(b));
+    cupkee_buffer_release(b);
+
+    CU_ASSERT(0 == cupkee_stream_deinit(s));
+}
+
+static void test_stream_shrink(void)
+{
+    int id;
+    cupkee_stream_t *s;
+    uint8_t buf[32];
+
+    CU_ASSERT(0 <= (id = cupkee_id(tag)));
+    CU_ASSERT(NULL != (s = (cupkee_stream_t *) cupkee_entry(id, tag)));
+    CU_ASSERT(0 == cupkee_stream_init(s, id, 32, 32, mock_read, mock_write));
+
+    CU_ASSERT(0 == cupkee_stream_shrink(s));
+
+    // Cache with data is kept
+    memset(buf, 8, 32);
+    CU_ASSERT(10 == cupkee_stream_push(s, 10, buf));
+    CU_ASSERT(0 == cupkee_stream_shrink(s));
+    CU_ASSERT(NULL != s->rx_buf);
+
+    CU_ASSERT(10 == cupkee_stream_read(s, 32, buf));
+    CU_ASSERT(32 == cupkee_stream_shrink(s));
+    CU_ASSERT(NULL == s->rx_buf);
+
+    // Allocated again when needed
+    CU_ASSERT(10 == cupkee_stream_push(s, 10, buf));
+    CU_ASSERT(10 == cupkee_stream_read(s, 32, buf));
+
+    CU_ASSERT(0 == cupkee_stream_deinit(s));
+    while (TU_object_event_dispatch())
+        ;
+}
+
 CU_pSuite test_sys_stream(void)
 {
     CU_pSuite suite = CU_add_suite("system stream", test_setup, test_clean);
@@ -238,6 +367,8 @@ CU_pSuite test_sys_stream(void)
         CU_add_test(suite, "stream write     ", test_stream_write);
         CU_add_test(suite, "stream sync io   ", test_stream_sync);
         CU_add_test(suite, "stream event     ", test_stream_event);
+        CU_add_test(suite, "stream buf       ", test_stream_buf);
+        CU_add_test(suite, "stream shrink    ", test_stream_shrink);
     }
 
     return suite;
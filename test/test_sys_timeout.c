@@ -273,6 +273,169 @@ static void test_timeout_clear(void)
     return;
 }
 
+static uint32_t fired_at[4];
+static cupkee_timeout_t *self_clear;
+
+static void test_tick_handle(int drop, void *param)
+{
+    uint32_t *tick = (uint32_t *) param;
+
+    if (!drop) {
+        *tick = _cupkee_systicks;
+    }
+}
+
+static void test_self_clear_handle(int drop, void *param)
+{
+    int *pv = (int *) param;
+
+    if (drop) {
+        pv[1] += 1;
+    } else {
+        pv[0] += 1;
+        if (pv[0] == 3) {
+            cupkee_timeout_unregister(self_clear);
+        }
+    }
+}
+
+static void test_timeout_long(void)
+{
+    _cupkee_systicks = 0;
+
+    memset(fired_at, 0, sizeof(fired_at));
+
+    CU_ASSERT_FATAL(NULL != cupkee_timeout_register(7, 0, test_tick_handle, &fired_at[0]));
+    CU_ASSERT_FATAL(NULL != cupkee_timeout_register(300, 0, test_tick_handle, &fired_at[1]));
+    CU_ASSERT_FATAL(NULL != cupkee_timeout_register(5000, 0, test_tick_handle, &fired_at[2]));
+    CU_ASSERT_FATAL(NULL != cupkee_timeout_register(70000, 0, test_tick_handle, &fired_at[3]));
+
+    while (_cupkee_systicks < 80000) {
+        cupkee_timeout_sync(++_cupkee_systicks);
+    }
+
+    CU_ASSERT(fired_at[0] == 7);
+    CU_ASSERT(fired_at[1] == 300);
+    CU_ASSERT(fired_at[2] == 5000);
+    CU_ASSERT(fired_at[3] == 70000);
+}
+
+static void test_timeout_drift(void)
+{
+    cupkee_timeout_t *t1;
+
+    _cupkee_systicks = 0;
+
+    v1[0] = 0; v1[1] = 0;
+
+    CU_ASSERT_FATAL((t1 = cupkee_timeout_register(10, 1, test_handle, &v1)) != NULL);
+
+    // Sync late, repeat timer should keep its phase
+    _cupkee_systicks = 15;
+    cupkee_timeout_sync(_cupkee_systicks);
+    CU_ASSERT(v1[0] == 1);
+
+    while (_cupkee_systicks < 19) {
+        cupkee_timeout_sync(++_cupkee_systicks);
+    }
+    CU_ASSERT(v1[0] == 1);
+
+    cupkee_timeout_sync(++_cupkee_systicks);
+    CU_ASSERT(v1[0] == 2);
+
+    // Missed periods are skipped
+    _cupkee_systicks = 55;
+    cupkee_timeout_sync(_cupkee_systicks);
+    CU_ASSERT(v1[0] == 3);
+
+    while (_cupkee_systicks < 60) {
+        cupkee_timeout_sync(++_cupkee_systicks);
+    }
+    CU_ASSERT(v1[0] == 4);
+
+    CU_ASSERT(1 == cupkee_timeout_clear_all());
+    CU_ASSERT(v1[1] == 1);
+}
+
+static void test_timeout_id(void)
+{
+    cupkee_timeout_t *t1;
+    int id;
+
+    _cupkee_systicks = 0;
+
+    v1[0] = 0; v1[1] = 0;
+    v2[0] = 0; v2[1] = 0;
+
+    CU_ASSERT_FATAL((t1 = cupkee_timeout_register(10, 0, test_handle, &v1)) != NULL);
+    id = t1->id;
+
+    while (_cupkee_systicks < 20) {
+        cupkee_timeout_sync(++_cupkee_systicks);
+    }
+    CU_ASSERT(v1[0] == 1 && v1[1] == 1);
+
+    // Stale id should not clear the timeout which reuse the node
+    CU_ASSERT_FATAL(cupkee_timeout_register(10, 0, test_handle, &v2) == t1);
+    CU_ASSERT(id != t1->id);
+    CU_ASSERT(0 == cupkee_timeout_clear_with_id(id));
+    CU_ASSERT(1 == cupkee_timeout_clear_with_id(t1->id));
+    CU_ASSERT(v2[0] == 0 && v2[1] == 1);
+
+    // Clear self in handle
+    v3[0] = 0; v3[1] = 0;
+    CU_ASSERT_FATAL((self_clear = cupkee_timeout_register(10, 1, test_self_clear_handle, &v3)) != NULL);
+    while (_cupkee_systicks < 100) {
+        cupkee_timeout_sync(++_cupkee_systicks);
+    }
+    CU_ASSERT(v3[0] == 3 && v3[1] == 1);
+    CU_ASSERT(0 == cupkee_timeout_clear_all());
+}
+
+static void test_timeout_idle(void)
+{
+    int wakeup = 0;
+
+    _cupkee_systicks = 0;
+    cupkee_timeout_sync(_cupkee_systicks);
+
+    v1[0] = 0; v1[1] = 0;
+    memset(fired_at, 0, sizeof(fired_at));
+
+    CU_ASSERT(CUPKEE_TICKS_FOREVER == cupkee_idle_ticks());
+
+    CU_ASSERT_FATAL(NULL != cupkee_timeout_register(30, 0, test_tick_handle, &fired_at[0]));
+    CU_ASSERT_FATAL(NULL != cupkee_timeout_register(70000, 0, test_tick_handle, &fired_at[1]));
+    CU_ASSERT_FATAL(NULL != cupkee_timeout_register(500, 1, test_handle, &v1));
+
+    CU_ASSERT(30 == cupkee_timeout_next());
+    CU_ASSERT(30 == cupkee_idle_ticks());
+
+    while (_cupkee_systicks < 80000) {
+        cupkee_event_poll();
+        cupkee_idle();
+        wakeup++;
+    }
+    cupkee_event_poll();
+
+    CU_ASSERT(fired_at[0] == 30);
+    CU_ASSERT(fired_at[1] == 70000);
+    CU_ASSERT(v1[0] == 160);
+    CU_ASSERT(wakeup < 200);
+
+    // Wakeup by interrupt, before deadline
+    hw_mock_idle_wakeup_set(7);
+    CU_ASSERT(500 == cupkee_idle_ticks());
+    cupkee_idle();
+    CU_ASSERT(hw_mock_idle_request() == 500);
+    cupkee_event_poll();
+    CU_ASSERT(493 == cupkee_idle_ticks());
+    hw_mock_idle_wakeup_set(CUPKEE_TICKS_FOREVER);
+
+    CU_ASSERT(1 == cupkee_timeout_clear_all());
+    CU_ASSERT(CUPKEE_TICKS_FOREVER == cupkee_idle_ticks());
+}
+
 CU_pSuite test_sys_timeout(void)
 {
     CU_pSuite suite = CU_add_suite("system timeout", test_setup, test_clean);
@@ -282,6 +445,10 @@ CU_pSuite test_sys_timeout(void)
         CU_add_test(suite, "timeout running  ", test_running);
         CU_add_test(suite, "timeout clear1   ", test_self_clear);
         CU_add_test(suite, "timeout clear2   ", test_timeout_clear);
+        CU_add_test(suite, "timeout long     ", test_timeout_long);
+        CU_add_test(suite, "timeout drift    ", test_timeout_drift);
+        CU_add_test(suite, "timeout id       ", test_timeout_id);
+        CU_add_test(suite, "timeout idle     ", test_timeout_idle);
     }
 
     return suite;